@@ -4,9 +4,24 @@
  * Features:
  * - Synchronization API: Allows for inter-process signaling using synchronization objects.
  * - Shared Memory API: Allows for sharing memory between processes for data interchange.
+ * - NUMA Utils: Binds segments to a memory node and pins threads to the CPUs of a node.
  * - Callback Storage API: Provides a way to store and execute callback functions.
+ * - Traffic Tap API: Records channel traffic to a memory-mapped log and replays it against a server.
  * - High-Level C IPC API: Provides a high-level interface to create an IPC mechanism using the features.
- * - High-Level C++ IPC API: Provides a high-level implementation of an IPC mechanism in C++.
+ * - Lane API: Several independent request slots on one channel, so many client threads can be in flight.
+ * - Stream API: Transfers payloads larger than the channel in pipelined chunks.
+ * - Key-Value API: A hash map in shared memory, looked up by every process without a round-trip.
+ * - Queue API: A bounded multi-producer/multi-consumer work queue between processes.
+ * - Prefork API: Serves one lane channel from several forked worker processes (POSIX only).
+ * - Arena API: Many small channels inside one shared segment, without kernel objects per channel.
+ * - Lock API: Mutex and reader/writer lock living in shared memory, taken over from holders whose process died.
+ * - Publish API: Immutable dataset versions mapped read-only by readers, swapped atomically.
+ * - Handle Cache API: Reuses channels and segments a process opens again and again.
+ * - Anonymous Channel API: Nameless channels on memfd and eventfd, handed over by fd passing (Linux only).
+ * - Bulk API: Large payloads copied straight between process memories, the channel carries a descriptor (Linux only).
+ * - Duplex API: Channels with separate client-to-server and server-to-client regions, so both sides send at any time.
+ * - Priority API: Client-to-server messages in weighted priority classes, so control traffic overtakes bulk data.
+ * - High-Level C++ IPC API: Provides a high-level implementation of an IPC mechanism in C++, with an opt-in client reply cache.
  * 
  * The library currently supports Windows and POSIX.
  * 
@@ -33,6 +48,18 @@ extern "C" {
     #include <fcntl.h>
     #include <errno.h>
     #include <unistd.h>
+    #include <time.h>
+    #include <sys/stat.h>
+    #include <sched.h>
+    #include <sys/wait.h>
+    #ifdef __linux__
+        #define NJ_IPC_LINUX
+        #include <sys/syscall.h>
+        #include <linux/futex.h>
+        #include <sys/eventfd.h>
+        #include <sys/socket.h>
+        #include <sys/uio.h>
+    #endif
 #else 
     #define NJ_IPC_WIN
     #ifdef _MSC_VER
@@ -44,8 +71,12 @@ extern "C" {
 #endif
 
 #include <stdlib.h>
+#include <limits.h>
 #include <stdio.h>
 #include <memory.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
 
 /* Shared error codes */
 typedef enum {
@@ -74,6 +105,73 @@ typedef enum {
 
     CHANNEL_WAIT_INVALID_EVENT,
     CHANNEL_NOTIFY_INVALID_EVENT,
+
+    TAP_INVALID_OBJECT,
+    TAP_CREATE_FAIL,
+    TAP_OPEN_FAIL,
+    TAP_MAPPING_FAIL,
+    TAP_FULL,
+    TAP_END,
+
+    NUMA_UNSUPPORTED,
+    NUMA_INVALID_NODE,
+    SHMEM_NUMA_FAIL,
+    THREAD_PIN_FAIL,
+
+    LANE_INVALID_CHANNEL,
+    LANE_INVALID,
+    LANE_BUSY,
+    LANE_TOO_BIG,
+
+    STREAM_INVALID_OBJECT,
+    STREAM_INVALID_SIZE,
+    STREAM_TOO_BIG,
+    STREAM_END,
+
+    KV_INVALID_OBJECT,
+    KV_INVALID_LAYOUT,
+    KV_FULL,
+    KV_NOT_FOUND,
+
+    QUEUE_INVALID_OBJECT,
+    QUEUE_INVALID_LAYOUT,
+    QUEUE_FULL,
+    QUEUE_EMPTY,
+
+    PREFORK_UNSUPPORTED,
+    PREFORK_SPAWN_FAIL,
+
+    ARENA_INVALID_OBJECT,
+    ARENA_INVALID_LAYOUT,
+    ARENA_FULL,
+    ARENA_CHANNEL_EXISTS,
+    ARENA_CHANNEL_NOT_FOUND,
+
+    LOCK_INVALID_OBJECT,
+    LOCK_BUSY,
+    LOCK_OWNER_DEAD,
+
+    PUBLISH_INVALID_OBJECT,
+    PUBLISH_INVALID_LAYOUT,
+    PUBLISH_NONE,
+    PUBLISH_BUSY,
+
+    CACHE_SIZE_MISMATCH,
+
+    FD_SEND_FAIL,
+    FD_RECV_FAIL,
+
+    BULK_INVALID_OBJECT,
+    BULK_ACCESS_DENIED,
+    BULK_COPY_FAIL,
+    BULK_TOO_BIG,
+
+    DUPLEX_INVALID_CHANNEL,
+
+    PRIORITY_INVALID_CHANNEL,
+    PRIORITY_INVALID_CLASS,
+
+    LANE_REQUEST_FAILED,
 } nj_ipc_error;
 
 /* String Utils */
@@ -81,6 +179,277 @@ typedef enum {
 #define nj_ipc_str_copy(str) strdup(str)
 #define nj_ipc_str_invalid(str) (str == NULL || strcmp(str, "") == 0)
 
+/* Atomic Utils (sequentially consistent, usable on memory shared between processes) */
+#ifdef _MSC_VER
+    #define nj_ipc_atomic_load32(ptr) (uint32_t)InterlockedOr((volatile LONG*)(ptr), 0)
+    #define nj_ipc_atomic_store32(ptr, val) InterlockedExchange((volatile LONG*)(ptr), (LONG)(val))
+    #define nj_ipc_atomic_add32(ptr, val) (uint32_t)InterlockedExchangeAdd((volatile LONG*)(ptr), (LONG)(val))
+    #define nj_ipc_atomic_cas32(ptr, expected, desired) \
+        (InterlockedCompareExchange((volatile LONG*)(ptr), (LONG)(desired), (LONG)(expected)) == (LONG)(expected))
+    #define nj_ipc_atomic_load64(ptr) (uint64_t)InterlockedOr64((volatile LONG64*)(ptr), 0)
+    #define nj_ipc_atomic_store64(ptr, val) InterlockedExchange64((volatile LONG64*)(ptr), (LONG64)(val))
+    #define nj_ipc_atomic_add64(ptr, val) (uint64_t)InterlockedExchangeAdd64((volatile LONG64*)(ptr), (LONG64)(val))
+    #define nj_ipc_atomic_cas64(ptr, expected, desired) \
+        (InterlockedCompareExchange64((volatile LONG64*)(ptr), (LONG64)(desired), (LONG64)(expected)) == (LONG64)(expected))
+    #define nj_ipc_atomic_fence() MemoryBarrier()
+#else
+    #define nj_ipc_atomic_load32(ptr) __atomic_load_n((volatile uint32_t*)(ptr), __ATOMIC_SEQ_CST)
+    #define nj_ipc_atomic_store32(ptr, val) __atomic_store_n((volatile uint32_t*)(ptr), (uint32_t)(val), __ATOMIC_SEQ_CST)
+    #define nj_ipc_atomic_add32(ptr, val) __atomic_fetch_add((volatile uint32_t*)(ptr), (uint32_t)(val), __ATOMIC_SEQ_CST)
+    #define nj_ipc_atomic_cas32(ptr, expected, desired) \
+        __sync_bool_compare_and_swap((volatile uint32_t*)(ptr), (uint32_t)(expected), (uint32_t)(desired))
+    #define nj_ipc_atomic_load64(ptr) __atomic_load_n((volatile uint64_t*)(ptr), __ATOMIC_SEQ_CST)
+    #define nj_ipc_atomic_store64(ptr, val) __atomic_store_n((volatile uint64_t*)(ptr), (uint64_t)(val), __ATOMIC_SEQ_CST)
+    #define nj_ipc_atomic_add64(ptr, val) __atomic_fetch_add((volatile uint64_t*)(ptr), (uint64_t)(val), __ATOMIC_SEQ_CST)
+    #define nj_ipc_atomic_cas64(ptr, expected, desired) \
+        __sync_bool_compare_and_swap((volatile uint64_t*)(ptr), (uint64_t)(expected), (uint64_t)(desired))
+    #define nj_ipc_atomic_fence() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+/* Layout Utils */
+#define NJ_IPC_CACHE_LINE 64
+#define nj_ipc_align_up(size, align) (((size) + (align) - 1) & ~((size_t)(align) - 1))
+
+/**
+ * Rounds a count up to the next power of two, for rings and tables indexed with a mask.
+ *
+ * @param value The requested count.
+ * @return The rounded count, 0 when it doesn't fit in 32 bits.
+ */
+uint32_t
+nj_ipc_pow2_ceil(unsigned int value) {
+    uint32_t result = 1;
+
+    while (result < value) {
+        if (result & 0x80000000u) {
+            return 0;
+        }
+        result <<= 1;
+    }
+    return result;
+}
+
+/* Process Utils */
+
+/**
+ * Identifier of the calling process.
+ *
+ * @return The process id.
+ */
+uint32_t
+nj_ipc_process_id() {
+#ifdef NJ_IPC_WIN
+    return (uint32_t)GetCurrentProcessId();
+#endif
+#ifdef NJ_IPC_POSIX
+    return (uint32_t)getpid();
+#endif
+}
+
+/**
+ * Checks whether a process still runs.
+ *
+ * Linux reports zombies as dead. Other POSIX systems count a zombie as alive
+ * until its parent reaps it. A process id reused by a new process reads as
+ * alive everywhere.
+ *
+ * @param pid The process id.
+ * @return Non-zero while the process exists.
+ */
+int
+nj_ipc_process_alive(uint32_t pid) {
+#ifdef NJ_IPC_WIN
+    DWORD waitcode;
+    HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, (DWORD)pid);
+
+    if (!process) {
+        return GetLastError() != ERROR_INVALID_PARAMETER;
+    }
+    waitcode = WaitForSingleObject(process, 0);
+    CloseHandle(process);
+    return waitcode == WAIT_TIMEOUT;
+#endif
+#ifdef NJ_IPC_POSIX
+#ifdef NJ_IPC_LINUX
+    char path[32], line[256], *state;
+    FILE *file;
+    size_t size;
+
+    sprintf(path, "/proc/%u/stat", pid);
+
+    /* The state follows the command name, which is in parentheses and may hold anything */
+    if ((file = fopen(path, "r")) != NULL) {
+        size = fread(line, 1, sizeof(line) - 1, file);
+        fclose(file);
+        line[size] = '\0';
+
+        if ((state = strrchr(line, ')')) != NULL && state[1] == ' ') {
+            return state[2] != 'Z' && state[2] != 'X';
+        }
+    }
+#endif
+    return kill((pid_t)pid, 0) == 0 || errno != ESRCH;
+#endif
+}
+
+/**
+ * Gives up the rest of the calling thread's time slice, used while spinning on shared state.
+ *
+ * @return Nothing.
+ */
+void
+nj_ipc_thread_yield() {
+#ifdef NJ_IPC_WIN
+    SwitchToThread();
+#endif
+#ifdef NJ_IPC_POSIX
+    sched_yield();
+#endif
+}
+
+/**
+ * Spins until the lock word goes from 0 to 1.
+ *
+ * @param lock The lock word.
+ * @return Nothing.
+ */
+void
+nj_ipc_spin_lock(volatile uint32_t *lock) {
+    while (!nj_ipc_atomic_cas32(lock, 0, 1)) {
+        nj_ipc_thread_yield();
+    }
+}
+
+/* Clock Utils */
+
+/**
+ * Reads a monotonic clock shared by all processes on the host.
+ *
+ * @return The current time in nanoseconds.
+ */
+uint64_t
+nj_ipc_clock_ns() {
+#ifdef NJ_IPC_WIN
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000ull
+        + (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000ull / (uint64_t)frequency.QuadPart;
+#endif
+#ifdef NJ_IPC_POSIX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+ * Sleeps the calling thread.
+ *
+ * @param ns Time to sleep in nanoseconds.
+ * @return Nothing.
+ */
+void
+nj_ipc_clock_sleep(uint64_t ns) {
+#ifdef NJ_IPC_WIN
+    Sleep((DWORD)(ns / 1000000ull));
+#endif
+#ifdef NJ_IPC_POSIX
+    struct timespec ts;
+    ts.tv_sec = (time_t)(ns / 1000000000ull);
+    ts.tv_nsec = (long)(ns % 1000000000ull);
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR);
+#endif
+}
+
+/* Futex Utils
+ *
+ * Waiting on a 32-bit word in shared memory. Linux sleeps in the kernel with a
+ * shared futex, elsewhere the waiter polls the word.
+ */
+
+/**
+ * Sleeps while the word still holds the expected value, may return spuriously.
+ *
+ * @param word The word, in shared memory.
+ * @param expected The value the caller saw.
+ * @param timeout_ns Longest time to sleep in nanoseconds, 0 for no limit.
+ * @return Nothing.
+ */
+void
+nj_ipc_futex_wait(volatile uint32_t *word, uint32_t expected, uint64_t timeout_ns) {
+#ifdef NJ_IPC_LINUX
+    struct timespec ts;
+    ts.tv_sec = (time_t)(timeout_ns / 1000000000ull);
+    ts.tv_nsec = (long)(timeout_ns % 1000000000ull);
+    syscall(SYS_futex, word, FUTEX_WAIT, expected, timeout_ns ? &ts : NULL, NULL, 0);
+#else
+    if (nj_ipc_atomic_load32(word) == expected) {
+        nj_ipc_clock_sleep(timeout_ns && timeout_ns < 50000ull ? timeout_ns : 50000ull);
+    }
+#endif
+}
+
+/**
+ * Wakes waiters sleeping on the word.
+ *
+ * @param word The word, in shared memory.
+ * @param count Maximum number of waiters to wake.
+ * @return Nothing.
+ */
+void
+nj_ipc_futex_wake(volatile uint32_t *word, int count) {
+#ifdef NJ_IPC_LINUX
+    syscall(SYS_futex, word, FUTEX_WAKE, count, NULL, NULL, 0);
+#else
+    (void)word; (void)count;
+#endif
+}
+
+/* Counting semaphore that lives entirely in shared memory, zeroed memory starts at 0 */
+typedef struct nj_ipc_futex_sem {
+    volatile uint32_t count;
+    volatile uint32_t waiters;
+} nj_ipc_futex_sem;
+
+/**
+ * Increments the semaphore, entering the kernel only when someone sleeps on it.
+ *
+ * @param sem The semaphore.
+ * @return Nothing.
+ */
+void
+nj_ipc_futex_sem_post(nj_ipc_futex_sem *sem) {
+    nj_ipc_atomic_add32(&sem->count, 1);
+
+    if (nj_ipc_atomic_load32(&sem->waiters)) {
+        nj_ipc_futex_wake(&sem->count, 1);
+    }
+}
+
+/**
+ * Decrements the semaphore, sleeping while it is 0.
+ *
+ * @param sem The semaphore.
+ * @return Nothing.
+ */
+void
+nj_ipc_futex_sem_wait(nj_ipc_futex_sem *sem) {
+    uint32_t count;
+
+    for (;;) {
+        while ((count = nj_ipc_atomic_load32(&sem->count)) != 0) {
+            if (nj_ipc_atomic_cas32(&sem->count, count, count - 1)) {
+                return;
+            }
+        }
+
+        nj_ipc_atomic_add32(&sem->waiters, 1);
+        nj_ipc_futex_wait(&sem->count, 0, 0);
+        nj_ipc_atomic_add32(&sem->waiters, (uint32_t)-1);
+    }
+}
+
 /* Callback Storage API */
 typedef void (*nj_ipc_callback_t)(void* data);
 
@@ -140,7 +509,7 @@ nj_ipc_callback_free() {
 /* Synchronization API */
 typedef struct nj_ipc_sync {
     void *handle;
-    char *name;
+    char *name;  /* NULL for anonymous objects, whose handle is an eventfd */
     nj_ipc_error status;
 } nj_ipc_sync;
 
@@ -161,7 +530,7 @@ nj_ipc_sync_create(const char *name) {
     }
 
 #ifdef NJ_IPC_WIN
-    object.handle = CreateEventA(NULL, FALSE, FALSE, name);
+    object.handle = CreateSemaphoreA(NULL, 0, LONG_MAX, name); /* Counts like the POSIX semaphore */
 
     if (!object.handle) {
         object.status = SYNC_CREATE_FAIL;
@@ -179,7 +548,7 @@ nj_ipc_sync_create(const char *name) {
     return object;
 #endif
 #ifdef NJ_IPC_POSIX
-    object.handle = sem_open(name, O_CREAT | O_EXCL, 0644, 1); // Initial value is 1
+    object.handle = sem_open(name, O_CREAT | O_EXCL, 0644, 0); // Starts unsignaled
 
     if (object.handle == SEM_FAILED) {
         if (errno == EEXIST) {
@@ -215,7 +584,7 @@ nj_ipc_sync_open(const char *name) {
     }
 
 #ifdef NJ_IPC_WIN
-    object.handle = OpenEventA(EVENT_ALL_ACCESS, FALSE, name);
+    object.handle = OpenSemaphoreA(SEMAPHORE_ALL_ACCESS, FALSE, name);
 
     if (!object.handle) {
         object.status = SYNC_OPEN_FAIL;
@@ -255,7 +624,13 @@ nj_ipc_sync_notify(nj_ipc_sync *sync) {
         return SYNC_INVALID_OBJECT;
     }
 #ifdef NJ_IPC_WIN
-    return SetEvent(sync->handle) ? SUCCESS :  SYNC_NOTIFY_FAILED;
+    return ReleaseSemaphore(sync->handle, 1, NULL) ? SUCCESS : SYNC_NOTIFY_FAILED;
+#endif
+#ifdef NJ_IPC_LINUX
+    if (!sync->name) {
+        uint64_t one = 1;
+        return write(handle_to_fd(sync->handle), &one, sizeof(one)) == sizeof(one) ? SUCCESS : SYNC_NOTIFY_FAILED;
+    }
 #endif
 #ifdef NJ_IPC_POSIX
     return sem_post((sem_t *)sync->handle) == 0 ? SUCCESS : SYNC_NOTIFY_FAILED;
@@ -287,6 +662,14 @@ nj_ipc_sync_wait(nj_ipc_sync *sync) {
             return ERR;
     }
 #endif
+#ifdef NJ_IPC_LINUX
+    if (!sync->name) {
+        uint64_t value;
+        ssize_t result;
+        while ((result = read(handle_to_fd(sync->handle), &value, sizeof(value))) == -1 && errno == EINTR);
+        return result == sizeof(value) ? SUCCESS : SYNC_WAIT_FAILED;
+    }
+#endif
 #ifdef NJ_IPC_POSIX
     return sem_wait((sem_t *)sync->handle) == 0 ? SUCCESS : SYNC_WAIT_FAILED;
 #endif
@@ -307,437 +690,5813 @@ nj_ipc_sync_free(nj_ipc_sync *sync) {
     CloseHandle(sync->handle);
 #endif
 #ifdef NJ_IPC_POSIX
-    sem_close((sem_t *)sync->handle);
-    sem_unlink(sync->name);
+    if (!sync->name) {
+        close(handle_to_fd(sync->handle));
+    } else {
+        sem_close((sem_t *)sync->handle);
+        sem_unlink(sync->name);
+    }
 #endif
     free(sync->name);
 }
 
-/* Shared Memory API */
-typedef struct nj_ipc_shmem {
-    void *handle;
-    void *view;
-    unsigned int view_size;
-    nj_ipc_error status;
-    char *name;
-} nj_ipc_shmem;
-
 /**
- * Create a new Shared memory object.
+ * Closes a synchronization object without removing its name, so other processes can still open it.
  *
- * @param name The name of the shared memory object.
- * @return A new nj_ipc_shmem object.
+ * @param sync The synchronization object to be closed.
+ * @return Nothing.
  */
-nj_ipc_shmem
-nj_ipc_shmem_create(const char *name, unsigned int shmem_size) {
-    nj_ipc_shmem object;
-    object.status = ERR;
-
-    if (nj_ipc_str_invalid(name)) {
-        object.status = INVALID_NAME;
-        return object;
-    }
-
-    if (!shmem_size) {
-        object.status = SHMEM_INVALID_SIZE;
-        return object;
+void
+nj_ipc_sync_close(nj_ipc_sync *sync) {
+    if (!sync || !sync->handle) {
+        return;
     }
-
 #ifdef NJ_IPC_WIN
-    object.handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, shmem_size, name);
-
-    if (!object.handle) {
-        object.status = SHMEM_CREATE_FAIL;
-        return object;
+    CloseHandle(sync->handle);
+#endif
+#ifdef NJ_IPC_POSIX
+    if (!sync->name) {
+        close(handle_to_fd(sync->handle));
+    } else {
+        sem_close((sem_t *)sync->handle);
     }
+#endif
+    free(sync->name);
+    sync->handle = NULL;
+    sync->name = NULL;
+}
 
-    if (GetLastError() == ERROR_ALREADY_EXISTS) {
-        object.status = SHMEM_ALREADY_EXISTS_FAIL;
-        return object;
-    }
+/* Sleeper Utils
+ *
+ * A counter of sleepers in shared memory next to a synchronization object, so
+ * the waking side only pays for a notification when someone actually sleeps.
+ * Each notification is claimed by decrementing the counter, so none is left over.
+ */
 
-    object.view = MapViewOfFile(object.handle, FILE_MAP_ALL_ACCESS, 0, 0, shmem_size);
+/**
+ * Wakes one registered sleeper, if there is any.
+ *
+ * @param sleepers The sleepers counter.
+ * @param sync The synchronization object the sleepers wait on.
+ * @return Nothing.
+ */
+void
+nj_ipc_sleepers_wake(volatile uint32_t *sleepers, nj_ipc_sync *sync) {
+    uint32_t count;
 
-    if (!object.view) {
-        CloseHandle(object.handle);
-        object.status = SHMEM_MAPPING_FAIL;
-        return object;
+    while ((count = nj_ipc_atomic_load32(sleepers)) != 0) {
+        if (nj_ipc_atomic_cas32(sleepers, count, count - 1)) {
+            nj_ipc_sync_notify(sync);
+            return;
+        }
     }
+}
 
-    object.name = nj_ipc_str_copy(name);
-    object.view_size = shmem_size;
-    object.status = SUCCESS;
-
-    return object;
-#endif
-#ifdef NJ_IPC_POSIX
-    object.handle = fd_to_handle(shm_open(name, O_CREAT | O_RDWR | O_EXCL, 0600));
+/**
+ * Withdraws a registration made with nj_ipc_atomic_add32(sleepers, 1) when the
+ * caller found work before sleeping.
+ *
+ * @param sleepers The sleepers counter.
+ * @param sync The synchronization object the sleepers wait on.
+ * @return The status, once any notification already claimed for the caller was absorbed.
+ */
+nj_ipc_error
+nj_ipc_sleepers_cancel(volatile uint32_t *sleepers, nj_ipc_sync *sync) {
+    uint32_t count;
 
-    if (handle_to_fd(object.handle) == -1) {
-        if (errno == EEXIST) {
-            object.status = SHMEM_ALREADY_EXISTS_FAIL;
-        } else {
-            object.status = SHMEM_CREATE_FAIL;
+    while ((count = nj_ipc_atomic_load32(sleepers)) != 0) {
+        if (nj_ipc_atomic_cas32(sleepers, count, count - 1)) {
+            return SUCCESS;
         }
-        return object;
     }
+    return nj_ipc_sync_wait(sync);
+}
 
-    if (ftruncate(handle_to_fd(object.handle), shmem_size) == -1) {
-        close(handle_to_fd(object.handle));
-        shm_unlink(name);
-        object.status = SHMEM_INVALID_SIZE;
-        return object;
-    }
+/* Lock API
+ *
+ * Both locks are placed by the caller inside a shared segment, zeroed memory is
+ * an unlocked lock. Holders are recorded by process id in the same word that is
+ * swapped to take the lock, so a lock is never held without a known holder. A
+ * waiter that finds the holder process gone takes the lock over and gets
+ * LOCK_OWNER_DEAD, telling it the guarded data may be half-updated. Dead
+ * holders are found as described for nj_ipc_process_alive: a zombie holder
+ * outside Linux, or a holder whose process id was reused, keeps the lock.
+ */
+#define NJ_IPC_LOCK_CHECK_NS 10000000ull /* How often waiters look for dead holders */
+#define NJ_IPC_RWLOCK_READERS 62
 
-    void *mapped_mem = mmap(NULL, shmem_size, PROT_READ | PROT_WRITE, MAP_SHARED, handle_to_fd(object.handle), 0);
+#define NJ_IPC_MUTEX_WAITERS 0x80000000u
 
-    if (mapped_mem == MAP_FAILED) {
-        close(handle_to_fd(object.handle));
-        shm_unlink(name);
-        object.status = SHMEM_MAPPING_FAIL;
-        return object;
-    }
+/* Laid out like a Linux PI futex word, process ids must stay below NJ_IPC_MUTEX_WAITERS */
+typedef struct nj_ipc_mutex {
+    volatile uint32_t owner; /* Process id of the holder, NJ_IPC_MUTEX_WAITERS set once someone sleeps; 0 unlocked */
+    uint32_t padding;
+} nj_ipc_mutex;
 
-    object.view = mapped_mem;
-    object.view_size = shmem_size;
-    object.name = nj_ipc_str_copy(name);
-    object.status = SUCCESS;
+#define nj_ipc_mutex_owner(mutex) (nj_ipc_atomic_load32(&(mutex)->owner) & ~NJ_IPC_MUTEX_WAITERS)
 
-    return object;
-#endif
-    return object;
-}
+/* Readers register in a slot each, so a dead reader can be told apart from live ones */
+typedef struct nj_ipc_rwlock {
+    volatile uint32_t writer;  /* Process id of the writer holding or draining, 0 when none */
+    volatile uint32_t wake;    /* Bumped on every release, waiters sleep on it */
+    volatile uint32_t sleepers;
+    volatile uint32_t readers[NJ_IPC_RWLOCK_READERS]; /* Process ids of the readers */
+    uint32_t padding;
+} nj_ipc_rwlock;
 
 /**
- * Opens an existing Shared memory object.
+ * Rate-limits the checks for dead holders while waiting on a lock.
  *
- * @param name The name of the shared memory object to be open.
- * @return A new nj_ipc_shmem object.
+ * @param checked Time of the last check, updated when a check is due.
+ * @return Non-zero when the caller should check now.
  */
-nj_ipc_shmem
-nj_ipc_shmem_open(const char *name, unsigned int shmem_size) {
-    nj_ipc_shmem object;
-    object.status = ERR;
+int
+nj_ipc_lock_check_due(uint64_t *checked) {
+    uint64_t now = nj_ipc_clock_ns();
 
-    if (nj_ipc_str_invalid(name)) {
-        object.status = INVALID_NAME;
-        return object;
+    if (now - *checked < NJ_IPC_LOCK_CHECK_NS) {
+        return 0;
     }
+    *checked = now;
+    return 1;
+}
 
-    if (!shmem_size) {
-        object.status = SHMEM_INVALID_SIZE;
-        return object;
-    }
+/**
+ * Takes a mutex over if its holder process died.
+ *
+ * @param mutex The mutex.
+ * @return Non-zero when the caller now holds the mutex.
+ */
+int
+nj_ipc_mutex_recover(nj_ipc_mutex *mutex) {
+    uint32_t word = nj_ipc_atomic_load32(&mutex->owner), owner = word & ~NJ_IPC_MUTEX_WAITERS;
 
-#ifdef NJ_IPC_WIN
-    object.handle = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+    /* Others may sleep on it, keep the waiters bit so unlocking wakes them */
+    return owner && !nj_ipc_process_alive(owner)
+        && nj_ipc_atomic_cas32(&mutex->owner, word, nj_ipc_process_id() | NJ_IPC_MUTEX_WAITERS);
+}
 
-    if (!object.handle) {
-        object.status = SHMEM_OPEN_FAIL;
-        return object;
-    }
+/**
+ * Spins until a lock word goes from 0 to the caller's process id.
+ *
+ * For short critical sections that never sleep; release by storing 0.
+ *
+ * @param lock The lock word, in shared memory.
+ * @return SUCCESS, or LOCK_OWNER_DEAD when the lock was taken over from a dead holder.
+ */
+nj_ipc_error
+nj_ipc_spin_lock_owned(volatile uint32_t *lock) {
+    uint32_t pid = nj_ipc_process_id(), owner;
+    uint64_t checked;
 
-    if (GetLastError() == ERROR_ALREADY_EXISTS) {
-        object.status = SHMEM_ALREADY_EXISTS_FAIL;
-        return object;
+    if (nj_ipc_atomic_cas32(lock, 0, pid)) {
+        return SUCCESS;
     }
 
-    object.view = MapViewOfFile(object.handle, FILE_MAP_ALL_ACCESS, 0, 0, shmem_size);
-
-    if (!object.view) {
-        CloseHandle(object.handle);
-        object.status = SHMEM_MAPPING_FAIL;
-        return object;
+    checked = nj_ipc_clock_ns();
+    for (;;) {
+        owner = nj_ipc_atomic_load32(lock);
+        if (owner == 0 && nj_ipc_atomic_cas32(lock, 0, pid)) {
+            return SUCCESS;
+        }
+        if (owner && nj_ipc_lock_check_due(&checked) && !nj_ipc_process_alive(owner)
+            && nj_ipc_atomic_cas32(lock, owner, pid)) {
+            return LOCK_OWNER_DEAD;
+        }
+        nj_ipc_thread_yield();
     }
+}
 
-    object.name = nj_ipc_str_copy(name);
-    object.view_size = shmem_size;
-    object.status = SUCCESS;
+/**
+ * Locks a mutex, sleeping while another holder has it.
+ *
+ * Uncontended locking is a single compare-and-swap, without a system call.
+ *
+ * @param mutex The mutex, in shared memory.
+ * @return SUCCESS, or LOCK_OWNER_DEAD when the lock was taken over from a dead holder.
+ */
+nj_ipc_error
+nj_ipc_mutex_lock(nj_ipc_mutex *mutex) {
+    uint32_t pid = nj_ipc_process_id(), word;
+    uint64_t checked;
 
-    return object;
-#endif
-#ifdef NJ_IPC_POSIX
-    object.handle = fd_to_handle(shm_open(name, O_RDWR, 0));
+    if (!mutex) {
+        return LOCK_INVALID_OBJECT;
+    }
 
-    if (handle_to_fd(object.handle) == -1) {
-        object.status = SHMEM_OPEN_FAIL;
-        return object;
+    if (nj_ipc_atomic_cas32(&mutex->owner, 0, pid)) {
+        return SUCCESS;
     }
 
-    void *mapped_mem = mmap(NULL, shmem_size, PROT_READ | PROT_WRITE, MAP_SHARED, handle_to_fd(object.handle), 0);
+    checked = nj_ipc_clock_ns();
+    for (;;) {
+        word = nj_ipc_atomic_load32(&mutex->owner);
 
-    if (mapped_mem == MAP_FAILED) {
-        close(handle_to_fd(object.handle));
-        object.status = SHMEM_MAPPING_FAIL;
-        return object;
-    }
+        /* Once contended, take it with the waiters bit so the unlocker knows to wake the others */
+        if (word == 0) {
+            if (nj_ipc_atomic_cas32(&mutex->owner, 0, pid | NJ_IPC_MUTEX_WAITERS)) {
+                return SUCCESS;
+            }
+            continue;
+        }
+        if (!(word & NJ_IPC_MUTEX_WAITERS) && !nj_ipc_atomic_cas32(&mutex->owner, word, word | NJ_IPC_MUTEX_WAITERS)) {
+            continue;
+        }
 
-    object.view = mapped_mem;
-    object.view_size = shmem_size;
-    object.name = nj_ipc_str_copy(name);
-    object.status = SUCCESS;
+        nj_ipc_futex_wait(&mutex->owner, word | NJ_IPC_MUTEX_WAITERS, NJ_IPC_LOCK_CHECK_NS);
 
-    return object;
-#endif
-    return object;
+        if (nj_ipc_lock_check_due(&checked) && nj_ipc_mutex_recover(mutex)) {
+            return LOCK_OWNER_DEAD;
+        }
+    }
 }
 
 /**
- * Frees a shared memory object
+ * Locks a mutex if it is free.
  *
- * @param sync The shared memory object to be freed.
- * @return Nothing.
+ * @param mutex The mutex, in shared memory.
+ * @return SUCCESS, LOCK_BUSY, or LOCK_OWNER_DEAD when the lock was taken over from a dead holder.
  */
-void
-nj_ipc_shmem_free(nj_ipc_shmem *shmem) {
-    if (!shmem) {
-        return;
+nj_ipc_error
+nj_ipc_mutex_try_lock(nj_ipc_mutex *mutex) {
+    if (!mutex) {
+        return LOCK_INVALID_OBJECT;
     }
-#ifdef NJ_IPC_WIN
-    if (shmem->handle) CloseHandle(shmem->handle);
-    if (shmem->view) UnmapViewOfFile(shmem->view);
-#endif
-#ifdef NJ_IPC_POSIX
-    if (shmem->view) munmap(shmem->view, shmem->view_size);
 
-    if (shmem->handle) {
-        close((int)(intptr_t)shmem->handle);
-        shm_unlink(shmem->name); /* should client unlink it? hm... */
+    if (nj_ipc_atomic_cas32(&mutex->owner, 0, nj_ipc_process_id())) {
+        return SUCCESS;
     }
-#endif
-    free(shmem->name);
+    return nj_ipc_mutex_recover(mutex) ? LOCK_OWNER_DEAD : LOCK_BUSY;
 }
 
-/* High-Level IPC API */
-typedef struct nj_ipc_channel {
-    nj_ipc_sync server_event;
-    nj_ipc_sync client_event;
-    nj_ipc_shmem shmem;
-    nj_ipc_error status;
-    char *name;
-} nj_ipc_channel;
-
 /**
- * Create a new IPC channel.
+ * Unlocks a mutex, entering the kernel only when someone sleeps on it.
  *
- * @param name The name of the IPC channel.
- * @param shmem_size Size of the shared memory in bytes.
- * @return A new nj_ipc_channel object.
+ * @param mutex The mutex, in shared memory.
+ * @return SUCCESS, or LOCK_INVALID_OBJECT when the caller doesn't hold the mutex.
  */
-nj_ipc_channel
-nj_ipc_channel_create(const char *name, unsigned int shmem_size) {
-    char server_event_name[256], client_event_name[256];
-    nj_ipc_channel ch;
-    ch.status = ERR;
+nj_ipc_error
+nj_ipc_mutex_unlock(nj_ipc_mutex *mutex) {
+    uint32_t pid = nj_ipc_process_id();
 
-    if (nj_ipc_str_invalid(name)) {
-        ch.status = INVALID_NAME;
-        return ch;
+    if (!mutex) {
+        return LOCK_INVALID_OBJECT;
     }
 
-    sprintf(server_event_name, "%s_server_njipc", name);
-    sprintf(client_event_name, "%s_client_njipc", name);
-
-    ch.server_event = nj_ipc_sync_create(server_event_name);
-
-    if (ch.server_event.status != SUCCESS) {
-        ch.status = ch.server_event.status;
-        return ch;
+    /* Without the waiters bit nobody sleeps, and the swap fails if someone just set it */
+    if (nj_ipc_atomic_cas32(&mutex->owner, pid, 0)) {
+        return SUCCESS;
     }
 
-    ch.client_event = nj_ipc_sync_create(client_event_name);
-
-    if (ch.client_event.status != SUCCESS) {
-        nj_ipc_sync_free(&(ch.server_event));
-        ch.status = ch.client_event.status;
-        return ch;
+    /* Waiters only ever add their bit, so the word can't change under the holder */
+    if ((nj_ipc_atomic_load32(&mutex->owner) & ~NJ_IPC_MUTEX_WAITERS) != pid) {
+        return LOCK_INVALID_OBJECT;
     }
+    nj_ipc_atomic_store32(&mutex->owner, 0);
+    nj_ipc_futex_wake(&mutex->owner, 1);
+    return SUCCESS;
+}
 
-    ch.shmem = nj_ipc_shmem_create(name, shmem_size);
+/**
+ * Wakes everyone sleeping on a reader/writer lock after a release.
+ *
+ * @param rwlock The lock.
+ * @return Nothing.
+ */
+void
+nj_ipc_rwlock_wake(nj_ipc_rwlock *rwlock) {
+    nj_ipc_atomic_add32(&rwlock->wake, 1);
 
-    if (ch.shmem.status != SUCCESS) {
-        nj_ipc_sync_free(&(ch.server_event));
-        nj_ipc_sync_free(&(ch.client_event));
-        ch.status = ch.shmem.status;
-        return ch;
+    if (nj_ipc_atomic_load32(&rwlock->sleepers)) {
+        nj_ipc_futex_wake(&rwlock->wake, 0x7fffffff);
     }
-
-    ch.name = nj_ipc_str_copy(name);
-    ch.status = SUCCESS;
-
-    return ch;
 }
 
 /**
- * Open an existing IPC channel.
+ * Sleeps until the next release of a reader/writer lock, or until it is time to look for dead holders.
  *
- * @param name The name of the IPC channel.
- * @param shmem_size Size of the shared memory in bytes.
- * @return An opened nj_ipc_channel object.
+ * @param rwlock The lock.
+ * @param wake The wake counter read before the caller found the lock taken.
+ * @return Nothing.
  */
-nj_ipc_channel
-nj_ipc_channel_open(const char *name, unsigned int shmem_size) {
-    char server_event_name[256], client_event_name[256];
-    nj_ipc_channel ch;
-    ch.status = ERR;
+void
+nj_ipc_rwlock_sleep(nj_ipc_rwlock *rwlock, uint32_t wake) {
+    nj_ipc_atomic_add32(&rwlock->sleepers, 1);
+    nj_ipc_futex_wait(&rwlock->wake, wake, NJ_IPC_LOCK_CHECK_NS);
+    nj_ipc_atomic_add32(&rwlock->sleepers, (uint32_t)-1);
+}
 
-    if (nj_ipc_str_invalid(name)) {
-        ch.status = INVALID_NAME;
-        return ch;
+/**
+ * Frees the writer side of a reader/writer lock held by a dead process.
+ *
+ * @param rwlock The lock.
+ * @param writer The writer process id the caller saw.
+ * @return Non-zero when a dead writer was removed.
+ */
+int
+nj_ipc_rwlock_recover_writer(nj_ipc_rwlock *rwlock, uint32_t writer) {
+    if (writer && !nj_ipc_process_alive(writer) && nj_ipc_atomic_cas32(&rwlock->writer, writer, 0)) {
+        nj_ipc_rwlock_wake(rwlock);
+        return 1;
     }
+    return 0;
+}
 
-    sprintf(server_event_name, "%s_server_njipc", name);
-    sprintf(client_event_name, "%s_client_njipc", name);
+/**
+ * Attempts to take the read side once.
+ *
+ * @param rwlock The lock.
+ * @return SUCCESS, or LOCK_BUSY while a writer holds or waits for the lock, or every reader slot is taken.
+ */
+nj_ipc_error
+nj_ipc_rwlock_try_read(nj_ipc_rwlock *rwlock) {
+    uint32_t pid = nj_ipc_process_id();
+    uint32_t i, slot;
 
-    ch.server_event = nj_ipc_sync_open(server_event_name);
+    if (nj_ipc_atomic_load32(&rwlock->writer)) {
+        return LOCK_BUSY;
+    }
 
-    if (ch.server_event.status != SUCCESS) {
-        ch.status = ch.server_event.status;
-        return ch;
+    for (i = 0; i < NJ_IPC_RWLOCK_READERS; i++) {
+        slot = (pid + i) % NJ_IPC_RWLOCK_READERS;
+        if (nj_ipc_atomic_cas32(&rwlock->readers[slot], 0, pid)) {
+            /* A writer that showed up meanwhile waits for the slots to drain, let it go first */
+            if (nj_ipc_atomic_load32(&rwlock->writer)) {
+                nj_ipc_atomic_store32(&rwlock->readers[slot], 0);
+                nj_ipc_rwlock_wake(rwlock);
+                return LOCK_BUSY;
+            }
+            return SUCCESS;
+        }
     }
+    return LOCK_BUSY;
+}
 
-    ch.client_event = nj_ipc_sync_open(client_event_name);
+/**
+ * Locks a reader/writer lock for reading, sleeping while a writer has or waits for it.
+ *
+ * @param rwlock The lock, in shared memory.
+ * @return SUCCESS, or LOCK_OWNER_DEAD when a dead writer was pushed out.
+ */
+nj_ipc_error
+nj_ipc_rwlock_lock_shared(nj_ipc_rwlock *rwlock) {
+    nj_ipc_error err = SUCCESS;
+    uint64_t checked = nj_ipc_clock_ns();
+    uint32_t wake;
 
-    if (ch.client_event.status != SUCCESS) {
-        nj_ipc_sync_free(&(ch.server_event));
-        ch.status = ch.client_event.status;
-        return ch;
+    if (!rwlock) {
+        return LOCK_INVALID_OBJECT;
     }
 
-    ch.shmem = nj_ipc_shmem_open(name, shmem_size);
+    for (;;) {
+        wake = nj_ipc_atomic_load32(&rwlock->wake);
 
-    if (ch.shmem.status != SUCCESS) {
-        nj_ipc_sync_free(&(ch.server_event));
-        nj_ipc_sync_free(&(ch.client_event));
-        ch.status = ch.shmem.status;
-        return ch;
-    }
+        if (nj_ipc_rwlock_try_read(rwlock) == SUCCESS) {
+            return err;
+        }
 
-    ch.name = nj_ipc_str_copy(name);
-    ch.status = SUCCESS;
+        nj_ipc_rwlock_sleep(rwlock, wake);
 
-    return ch;
+        if (nj_ipc_lock_check_due(&checked)
+            && nj_ipc_rwlock_recover_writer(rwlock, nj_ipc_atomic_load32(&rwlock->writer))) {
+            err = LOCK_OWNER_DEAD;
+        }
+    }
 }
 
 /**
- * Write data into the shared memory of the IPC channel.
+ * Locks a reader/writer lock for reading if no writer has or waits for it.
  *
- * @param channel Pointer to the nj_ipc_channel object.
- * @param data The data to be written.
- * @param data_size The size of the data beign written.
- * @return The write status.
+ * @param rwlock The lock, in shared memory.
+ * @return SUCCESS, or LOCK_BUSY.
  */
 nj_ipc_error
-nj_ipc_channel_write(nj_ipc_channel *channel, void *data, size_t data_size) {
-    if (!channel || !channel->shmem.view) {
-        return CHANNEL_WRITE_INVALID_SHMEM;
+nj_ipc_rwlock_try_lock_shared(nj_ipc_rwlock *rwlock) {
+    if (!rwlock) {
+        return LOCK_INVALID_OBJECT;
     }
-
-    if (data_size > channel->shmem.view_size) {
-        return CHANNEL_WRITE_TOO_BIG;
-    }
-
-    memcpy(channel->shmem.view, data, data_size);
-    return SUCCESS;
+    return nj_ipc_rwlock_try_read(rwlock);
 }
 
 /**
- * Reads data into from the shared memory of the IPC channel.
+ * Unlocks the read side taken by the calling process.
  *
- * @param channel Pointer to the nj_ipc_channel object.
- * @param buffer The buffer to read into.
- * @param read_size The size of the data beign read.
- * @return The read status.
+ * @param rwlock The lock, in shared memory.
+ * @return SUCCESS, or LOCK_INVALID_OBJECT when the calling process holds no read side.
  */
 nj_ipc_error
-nj_ipc_channel_read(nj_ipc_channel *channel, void *buffer, size_t read_size) {
-    if (!channel || !channel->shmem.view) {
-        return CHANNEL_READ_INVALID_SHMEM;
-    }
+nj_ipc_rwlock_unlock_shared(nj_ipc_rwlock *rwlock) {
+    uint32_t pid = nj_ipc_process_id();
+    uint32_t i, slot;
 
-    if (read_size > channel->shmem.view_size) {
-        return CHANNEL_READ_TOO_BIG;
+    if (!rwlock) {
+        return LOCK_INVALID_OBJECT;
     }
 
-    memcpy(buffer, channel->shmem.view, read_size);
-    return SUCCESS;
+    /* Slots of one process are interchangeable, release any of them */
+    for (i = 0; i < NJ_IPC_RWLOCK_READERS; i++) {
+        slot = (pid + i) % NJ_IPC_RWLOCK_READERS;
+        if (nj_ipc_atomic_cas32(&rwlock->readers[slot], pid, 0)) {
+            nj_ipc_rwlock_wake(rwlock);
+            return SUCCESS;
+        }
+    }
+    return LOCK_INVALID_OBJECT;
 }
 
 /**
- * Wait for a server event on the IPC channel.
+ * Waits until every reader slot is empty, clearing slots of dead readers.
  *
- * @param ch Pointer to the nj_ipc_channel object.
- * @return The wait status.
+ * @param rwlock The lock, with the writer already registered.
+ * @return SUCCESS, or LOCK_OWNER_DEAD when a dead reader was cleared.
  */
 nj_ipc_error
-nj_ipc_channel_wait_server(nj_ipc_channel *ch) {
-    if (!ch || !ch->server_event.handle) {
-        return CHANNEL_WAIT_INVALID_EVENT;
-    }
+nj_ipc_rwlock_drain(nj_ipc_rwlock *rwlock) {
+    nj_ipc_error err = SUCCESS;
+    uint64_t checked = nj_ipc_clock_ns();
+    uint32_t i, reader, wake;
 
-    return nj_ipc_sync_wait(&(ch->server_event));
+    for (i = 0; i < NJ_IPC_RWLOCK_READERS; i++) {
+        for (;;) {
+            wake = nj_ipc_atomic_load32(&rwlock->wake);
+
+            if (!(reader = nj_ipc_atomic_load32(&rwlock->readers[i]))) {
+                break;
+            }
+            if (nj_ipc_lock_check_due(&checked) && !nj_ipc_process_alive(reader)) {
+                if (nj_ipc_atomic_cas32(&rwlock->readers[i], reader, 0)) err = LOCK_OWNER_DEAD;
+                continue;
+            }
+            nj_ipc_rwlock_sleep(rwlock, wake);
+        }
+    }
+    return err;
 }
 
 /**
- * Wait for a client event on the IPC channel.
+ * Locks a reader/writer lock for writing.
  *
- * @param ch Pointer to the nj_ipc_channel object.
- * @return The wait status.
+ * New readers hold off as soon as a writer is waiting, so writers don't starve.
+ *
+ * @param rwlock The lock, in shared memory.
+ * @return SUCCESS, or LOCK_OWNER_DEAD when a dead holder was pushed out.
  */
 nj_ipc_error
-nj_ipc_channel_wait_client(nj_ipc_channel *ch) {
-    if (!ch || !ch->client_event.handle) {
-        return CHANNEL_WAIT_INVALID_EVENT;
+nj_ipc_rwlock_lock(nj_ipc_rwlock *rwlock) {
+    nj_ipc_error err = SUCCESS;
+    uint64_t checked = nj_ipc_clock_ns();
+    uint32_t pid = nj_ipc_process_id();
+    uint32_t wake;
+
+    if (!rwlock) {
+        return LOCK_INVALID_OBJECT;
     }
 
-    return nj_ipc_sync_wait(&(ch->client_event));
+    for (;;) {
+        wake = nj_ipc_atomic_load32(&rwlock->wake);
+
+        if (nj_ipc_atomic_cas32(&rwlock->writer, 0, pid)) {
+            break;
+        }
+
+        nj_ipc_rwlock_sleep(rwlock, wake);
+
+        if (nj_ipc_lock_check_due(&checked)
+            && nj_ipc_rwlock_recover_writer(rwlock, nj_ipc_atomic_load32(&rwlock->writer))) {
+            err = LOCK_OWNER_DEAD;
+        }
+    }
+
+    return nj_ipc_rwlock_drain(rwlock) == LOCK_OWNER_DEAD ? LOCK_OWNER_DEAD : err;
 }
 
 /**
- * Notify the server event on the IPC channel.
+ * Locks a reader/writer lock for writing if nobody holds it.
  *
- * @param ch Pointer to the nj_ipc_channel object.
- * @return The notify status.
+ * @param rwlock The lock, in shared memory.
+ * @return SUCCESS, or LOCK_BUSY.
  */
 nj_ipc_error
-nj_ipc_channel_notify_server(nj_ipc_channel *ch) {
-    if (!ch || !ch->server_event.handle) {
-        return CHANNEL_NOTIFY_INVALID_EVENT;
+nj_ipc_rwlock_try_lock(nj_ipc_rwlock *rwlock) {
+    uint32_t i;
+
+    if (!rwlock) {
+        return LOCK_INVALID_OBJECT;
     }
 
-    return nj_ipc_sync_notify(&(ch->server_event));
+    if (!nj_ipc_atomic_cas32(&rwlock->writer, 0, nj_ipc_process_id())) {
+        return LOCK_BUSY;
+    }
+
+    for (i = 0; i < NJ_IPC_RWLOCK_READERS; i++) {
+        if (nj_ipc_atomic_load32(&rwlock->readers[i])) {
+            nj_ipc_atomic_store32(&rwlock->writer, 0);
+            nj_ipc_rwlock_wake(rwlock);
+            return LOCK_BUSY;
+        }
+    }
+    return SUCCESS;
 }
 
 /**
- * Notify the client event on the IPC channel.
+ * Unlocks the write side of a reader/writer lock.
+ *
+ * @param rwlock The lock, in shared memory.
+ * @return SUCCESS, or LOCK_INVALID_OBJECT when the caller doesn't hold the write side.
+ */
+nj_ipc_error
+nj_ipc_rwlock_unlock(nj_ipc_rwlock *rwlock) {
+    if (!rwlock) {
+        return LOCK_INVALID_OBJECT;
+    }
+
+    if (!nj_ipc_atomic_cas32(&rwlock->writer, nj_ipc_process_id(), 0)) {
+        return LOCK_INVALID_OBJECT;
+    }
+    nj_ipc_rwlock_wake(rwlock);
+    return SUCCESS;
+}
+
+/* Shared Memory API */
+typedef struct nj_ipc_shmem {
+    void *handle;
+    void *view;
+    unsigned int view_size;
+    nj_ipc_error status;
+    char *name;
+    int mirrored; /* view is followed by a second mapping of the same pages */
+} nj_ipc_shmem;
+
+typedef enum {
+    NJ_IPC_NUMA_DEFAULT,    /* First process to touch a page decides its node */
+    NJ_IPC_NUMA_BIND,       /* All pages on numa_node */
+    NJ_IPC_NUMA_INTERLEAVE, /* Pages spread round-robin over every node with memory */
+} nj_ipc_numa_policy;
+
+/* Optional settings for nj_ipc_shmem_create_ex and nj_ipc_shmem_open_ex, zero means default */
+typedef struct nj_ipc_shmem_options {
+    nj_ipc_numa_policy numa_policy;
+    int numa_node;
+    int read_only; /* Map without write access, nj_ipc_shmem_open_ex only */
+    int mirrored;  /* Map the segment twice back-to-back, size must be a multiple of nj_ipc_shmem_granularity */
+} nj_ipc_shmem_options;
+
+/* NUMA Utils */
+#define NJ_IPC_NUMA_MAX_BITS 1024
+#define NJ_IPC_NUMA_MASK_WORDS (NJ_IPC_NUMA_MAX_BITS / (8 * sizeof(unsigned long)))
+
+#ifdef NJ_IPC_LINUX
+#ifndef MPOL_BIND
+    #define MPOL_BIND 2
+    #define MPOL_INTERLEAVE 3
+#endif
+
+/**
+ * Parses a sysfs list such as "0-3,8-11" into a bit mask.
+ *
+ * @param path The sysfs file to read.
+ * @param mask Receives the bits, NJ_IPC_NUMA_MASK_WORDS long.
+ * @return One past the highest bit set, or -1 on failure.
+ */
+int
+nj_ipc_numa_parse_list(const char *path, unsigned long *mask) {
+    char buffer[4096], *cursor, *end;
+    long first, last, bit;
+    int highest = -1;
+    size_t read_size;
+    FILE *file = fopen(path, "r");
+
+    if (!file) {
+        return -1;
+    }
+
+    read_size = fread(buffer, 1, sizeof(buffer) - 1, file);
+    fclose(file);
+    buffer[read_size] = '\0';
+
+    memset(mask, 0, NJ_IPC_NUMA_MASK_WORDS * sizeof(unsigned long));
+    cursor = buffer;
+
+    while (*cursor >= '0' && *cursor <= '9') {
+        first = last = strtol(cursor, &end, 10);
+        if (*end == '-') {
+            last = strtol(end + 1, &end, 10);
+        }
+        for (bit = first; bit <= last && bit < NJ_IPC_NUMA_MAX_BITS; bit++) {
+            mask[bit / (8 * sizeof(unsigned long))] |= 1ul << (bit % (8 * sizeof(unsigned long)));
+            highest = (int)bit;
+        }
+        cursor = *end == ',' ? end + 1 : end;
+    }
+
+    return highest + 1;
+}
+#endif
+
+/**
+ * Number of NUMA nodes on the host.
+ *
+ * @return The node count, 1 when NUMA is not available.
+ */
+int
+nj_ipc_numa_node_count() {
+#ifdef NJ_IPC_WIN
+    ULONG highest_node;
+    return GetNumaHighestNodeNumber(&highest_node) ? (int)highest_node + 1 : 1;
+#endif
+#ifdef NJ_IPC_LINUX
+    unsigned long mask[NJ_IPC_NUMA_MASK_WORDS];
+    int count = nj_ipc_numa_parse_list("/sys/devices/system/node/online", mask);
+    return count > 0 ? count : 1;
+#endif
+    return 1;
+}
+
+/**
+ * Applies the NUMA policy of the options to a mapping, before any page of it is touched.
+ *
+ * @param view Start of the mapping.
+ * @param size Size of the mapping in bytes.
+ * @param options The options, may be NULL.
+ * @return The bind status.
+ */
+nj_ipc_error
+nj_ipc_numa_apply(void *view, size_t size, const nj_ipc_shmem_options *options) {
+    if (!options || options->numa_policy == NJ_IPC_NUMA_DEFAULT) {
+        return SUCCESS;
+    }
+
+    if (options->numa_policy == NJ_IPC_NUMA_BIND
+        && (options->numa_node < 0 || options->numa_node >= nj_ipc_numa_node_count())) {
+        return NUMA_INVALID_NODE;
+    }
+#ifdef NJ_IPC_WIN
+    /* Binding is done by CreateFileMappingNumaA/MapViewOfFileExNuma, there is no interleaving */
+    return options->numa_policy == NJ_IPC_NUMA_BIND ? SUCCESS : NUMA_UNSUPPORTED;
+#endif
+#ifdef NJ_IPC_LINUX
+    unsigned long nodes[NJ_IPC_NUMA_MASK_WORDS];
+    int mode = MPOL_BIND;
+
+    if (options->numa_policy == NJ_IPC_NUMA_INTERLEAVE) {
+        if (nj_ipc_numa_parse_list("/sys/devices/system/node/has_memory", nodes) <= 0) {
+            return SHMEM_NUMA_FAIL;
+        }
+        mode = MPOL_INTERLEAVE;
+    } else {
+        memset(nodes, 0, sizeof(nodes));
+        nodes[options->numa_node / (8 * sizeof(unsigned long))] |= 1ul << (options->numa_node % (8 * sizeof(unsigned long)));
+    }
+
+    if (syscall(SYS_mbind, view, size, mode, nodes, (unsigned long)NJ_IPC_NUMA_MAX_BITS + 1, 0) == -1) {
+        return SHMEM_NUMA_FAIL;
+    }
+    return SUCCESS;
+#endif
+    (void)view;
+    (void)size;
+    return NUMA_UNSUPPORTED;
+}
+
+/**
+ * Pins the calling thread to the CPUs of a NUMA node.
+ *
+ * Use it on the thread serving a channel whose segment is bound to that node.
+ *
+ * @param node The NUMA node.
+ * @return The pin status.
+ */
+nj_ipc_error
+nj_ipc_thread_pin_numa(int node) {
+    if (node < 0 || node >= nj_ipc_numa_node_count()) {
+        return NUMA_INVALID_NODE;
+    }
+#ifdef NJ_IPC_WIN
+    GROUP_AFFINITY affinity;
+
+    if (!GetNumaNodeProcessorMaskEx((USHORT)node, &affinity)) {
+        return THREAD_PIN_FAIL;
+    }
+    return SetThreadGroupAffinity(GetCurrentThread(), &affinity, NULL) ? SUCCESS : THREAD_PIN_FAIL;
+#endif
+#ifdef NJ_IPC_LINUX
+    char path[128];
+    unsigned long cpus[NJ_IPC_NUMA_MASK_WORDS];
+
+    sprintf(path, "/sys/devices/system/node/node%d/cpulist", node);
+
+    if (nj_ipc_numa_parse_list(path, cpus) <= 0) {
+        return THREAD_PIN_FAIL;
+    }
+
+    return syscall(SYS_sched_setaffinity, 0, sizeof(cpus), cpus) == -1 ? THREAD_PIN_FAIL : SUCCESS;
+#endif
+    return NUMA_UNSUPPORTED;
+}
+
+/**
+ * Granularity a mirrored segment's size must be a multiple of.
+ *
+ * @return The page size on POSIX, the allocation granularity on Windows.
+ */
+unsigned int
+nj_ipc_shmem_granularity() {
+#ifdef NJ_IPC_WIN
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (unsigned int)info.dwAllocationGranularity;
+#endif
+#ifdef NJ_IPC_POSIX
+    return (unsigned int)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+#define nj_ipc_shmem_mirror_invalid(options, shmem_size) \
+    ((options) && (options)->mirrored && ((shmem_size) % nj_ipc_shmem_granularity() || (shmem_size) > 0x7fffffffu))
+
+/**
+ * Maps a segment twice back-to-back, so any range of up to its size is contiguous from any offset.
+ *
+ * A region twice the size is reserved first so nothing else can land in between.
+ * Windows can't map into a reservation, so the region is released and both views
+ * placed at its address, retrying when another thread takes it in the meantime.
+ *
+ * @param handle The segment, a file mapping on Windows and a descriptor on POSIX.
+ * @param shmem_size Size of the segment in bytes, a multiple of nj_ipc_shmem_granularity.
+ * @param read_only Non-zero to map without write access.
+ * @param options Placement options, may be NULL.
+ * @return The first view, or NULL.
+ */
+void*
+nj_ipc_shmem_map_mirrored(void *handle, unsigned int shmem_size, int read_only, const nj_ipc_shmem_options *options) {
+#ifdef NJ_IPC_WIN
+    DWORD access = read_only ? FILE_MAP_READ : FILE_MAP_ALL_ACCESS;
+    DWORD node = options && options->numa_policy == NJ_IPC_NUMA_BIND ? (DWORD)options->numa_node : NUMA_NO_NODE;
+    int attempt;
+
+    for (attempt = 0; attempt < 16; attempt++) {
+        char *base = (char*)VirtualAlloc(NULL, (SIZE_T)shmem_size * 2, MEM_RESERVE, PAGE_NOACCESS);
+        void *first, *second;
+
+        if (!base) {
+            return NULL;
+        }
+        VirtualFree(base, 0, MEM_RELEASE);
+
+        first = MapViewOfFileExNuma(handle, access, 0, 0, shmem_size, base, node);
+        if (!first) {
+            continue;
+        }
+
+        second = MapViewOfFileExNuma(handle, access, 0, 0, shmem_size, base + shmem_size, node);
+        if (second) {
+            return first;
+        }
+        UnmapViewOfFile(first);
+    }
+    return NULL;
+#endif
+#ifdef NJ_IPC_POSIX
+    int prot = read_only ? PROT_READ : PROT_READ | PROT_WRITE;
+    char *base = (char*)mmap(NULL, (size_t)shmem_size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    (void)options;
+
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+
+    if (mmap(base, shmem_size, prot, MAP_SHARED | MAP_FIXED, handle_to_fd(handle), 0) == MAP_FAILED
+        || mmap(base + shmem_size, shmem_size, prot, MAP_SHARED | MAP_FIXED, handle_to_fd(handle), 0) == MAP_FAILED) {
+        munmap(base, (size_t)shmem_size * 2);
+        return NULL;
+    }
+    return base;
+#endif
+}
+
+/**
+ * Unmaps the view of a shared memory object, both halves when it is mirrored.
+ *
+ * @param shmem The shared memory object.
+ * @return Nothing.
+ */
+void
+nj_ipc_shmem_unmap(nj_ipc_shmem *shmem) {
+    if (!shmem->view) {
+        return;
+    }
+#ifdef NJ_IPC_WIN
+    if (shmem->mirrored) UnmapViewOfFile((char*)shmem->view + shmem->view_size);
+    UnmapViewOfFile(shmem->view);
+#endif
+#ifdef NJ_IPC_POSIX
+    munmap(shmem->view, shmem->mirrored ? (size_t)shmem->view_size * 2 : shmem->view_size);
+#endif
+}
+
+/**
+ * Create a new Shared memory object with options.
+ *
+ * @param name The name of the shared memory object.
+ * @param shmem_size Size of the shared memory in bytes.
+ * @param options Placement options, may be NULL.
+ * @return A new nj_ipc_shmem object.
+ */
+nj_ipc_shmem
+nj_ipc_shmem_create_ex(const char *name, unsigned int shmem_size, const nj_ipc_shmem_options *options) {
+    nj_ipc_shmem object;
+    nj_ipc_error numa_status;
+    object.status = ERR;
+    object.mirrored = options && options->mirrored;
+
+    if (nj_ipc_str_invalid(name)) {
+        object.status = INVALID_NAME;
+        return object;
+    }
+
+    if (!shmem_size || nj_ipc_shmem_mirror_invalid(options, shmem_size)) {
+        object.status = SHMEM_INVALID_SIZE;
+        return object;
+    }
+
+#ifdef NJ_IPC_WIN
+    int bind = options && options->numa_policy == NJ_IPC_NUMA_BIND;
+
+    if ((numa_status = nj_ipc_numa_apply(NULL, 0, options)) != SUCCESS) {
+        object.status = numa_status;
+        return object;
+    }
+
+    if (bind) {
+        object.handle = CreateFileMappingNumaA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, shmem_size, name,
+                                               (DWORD)options->numa_node);
+    } else {
+        object.handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, shmem_size, name);
+    }
+
+    if (!object.handle) {
+        object.status = SHMEM_CREATE_FAIL;
+        return object;
+    }
+
+    if (GetLastError() == ERROR_ALREADY_EXISTS) {
+        object.status = SHMEM_ALREADY_EXISTS_FAIL;
+        return object;
+    }
+
+    if (object.mirrored) {
+        object.view = nj_ipc_shmem_map_mirrored(object.handle, shmem_size, 0, options);
+    } else {
+        object.view = bind ? MapViewOfFileExNuma(object.handle, FILE_MAP_ALL_ACCESS, 0, 0, shmem_size, NULL, (DWORD)options->numa_node)
+                           : MapViewOfFile(object.handle, FILE_MAP_ALL_ACCESS, 0, 0, shmem_size);
+    }
+
+    if (!object.view) {
+        CloseHandle(object.handle);
+        object.status = SHMEM_MAPPING_FAIL;
+        return object;
+    }
+
+    object.name = nj_ipc_str_copy(name);
+    object.view_size = shmem_size;
+    object.status = SUCCESS;
+
+    return object;
+#endif
+#ifdef NJ_IPC_POSIX
+    object.handle = fd_to_handle(shm_open(name, O_CREAT | O_RDWR | O_EXCL, 0600));
+
+    if (handle_to_fd(object.handle) == -1) {
+        if (errno == EEXIST) {
+            object.status = SHMEM_ALREADY_EXISTS_FAIL;
+        } else {
+            object.status = SHMEM_CREATE_FAIL;
+        }
+        return object;
+    }
+
+    if (ftruncate(handle_to_fd(object.handle), shmem_size) == -1) {
+        close(handle_to_fd(object.handle));
+        shm_unlink(name);
+        object.status = SHMEM_INVALID_SIZE;
+        return object;
+    }
+
+    void *mapped_mem = object.mirrored ? nj_ipc_shmem_map_mirrored(object.handle, shmem_size, 0, options)
+                                       : mmap(NULL, shmem_size, PROT_READ | PROT_WRITE, MAP_SHARED, handle_to_fd(object.handle), 0);
+
+    if (mapped_mem == MAP_FAILED || !mapped_mem) {
+        close(handle_to_fd(object.handle));
+        shm_unlink(name);
+        object.status = SHMEM_MAPPING_FAIL;
+        return object;
+    }
+
+    object.view = mapped_mem;
+    object.view_size = shmem_size;
+
+    if ((numa_status = nj_ipc_numa_apply(mapped_mem, shmem_size, options)) != SUCCESS) {
+        nj_ipc_shmem_unmap(&object);
+        close(handle_to_fd(object.handle));
+        shm_unlink(name);
+        object.status = numa_status;
+        return object;
+    }
+
+    object.name = nj_ipc_str_copy(name);
+    object.status = SUCCESS;
+
+    return object;
+#endif
+    return object;
+}
+
+/**
+ * Create a new Shared memory object.
+ *
+ * @param name The name of the shared memory object.
+ * @param shmem_size Size of the shared memory in bytes.
+ * @return A new nj_ipc_shmem object.
+ */
+nj_ipc_shmem
+nj_ipc_shmem_create(const char *name, unsigned int shmem_size) {
+    return nj_ipc_shmem_create_ex(name, shmem_size, NULL);
+}
+
+/**
+ * Opens an existing Shared memory object with options.
+ *
+ * @param name The name of the shared memory object to be open.
+ * @param shmem_size Size of the shared memory in bytes.
+ * @param options Placement options, may be NULL.
+ * @return A new nj_ipc_shmem object.
+ */
+nj_ipc_shmem
+nj_ipc_shmem_open_ex(const char *name, unsigned int shmem_size, const nj_ipc_shmem_options *options) {
+    nj_ipc_shmem object;
+    nj_ipc_error numa_status;
+    object.status = ERR;
+    object.mirrored = options && options->mirrored;
+
+    if (nj_ipc_str_invalid(name)) {
+        object.status = INVALID_NAME;
+        return object;
+    }
+
+    if (!shmem_size || nj_ipc_shmem_mirror_invalid(options, shmem_size)) {
+        object.status = SHMEM_INVALID_SIZE;
+        return object;
+    }
+
+#ifdef NJ_IPC_WIN
+    int bind = options && options->numa_policy == NJ_IPC_NUMA_BIND;
+
+    if ((numa_status = nj_ipc_numa_apply(NULL, 0, options)) != SUCCESS) {
+        object.status = numa_status;
+        return object;
+    }
+
+    DWORD access = options && options->read_only ? FILE_MAP_READ : FILE_MAP_ALL_ACCESS;
+    object.handle = OpenFileMappingA(access, FALSE, name);
+
+    if (!object.handle) {
+        object.status = SHMEM_OPEN_FAIL;
+        return object;
+    }
+
+    if (GetLastError() == ERROR_ALREADY_EXISTS) {
+        object.status = SHMEM_ALREADY_EXISTS_FAIL;
+        return object;
+    }
+
+    if (object.mirrored) {
+        object.view = nj_ipc_shmem_map_mirrored(object.handle, shmem_size, access == FILE_MAP_READ, options);
+    } else {
+        object.view = bind ? MapViewOfFileExNuma(object.handle, access, 0, 0, shmem_size, NULL, (DWORD)options->numa_node)
+                           : MapViewOfFile(object.handle, access, 0, 0, shmem_size);
+    }
+
+    if (!object.view) {
+        CloseHandle(object.handle);
+        object.status = SHMEM_MAPPING_FAIL;
+        return object;
+    }
+
+    object.name = nj_ipc_str_copy(name);
+    object.view_size = shmem_size;
+    object.status = SUCCESS;
+
+    return object;
+#endif
+#ifdef NJ_IPC_POSIX
+    int read_only = options && options->read_only;
+    object.handle = fd_to_handle(shm_open(name, read_only ? O_RDONLY : O_RDWR, 0));
+
+    if (handle_to_fd(object.handle) == -1) {
+        object.status = SHMEM_OPEN_FAIL;
+        return object;
+    }
+
+    void *mapped_mem = object.mirrored ? nj_ipc_shmem_map_mirrored(object.handle, shmem_size, read_only, options)
+                                       : mmap(NULL, shmem_size, read_only ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED,
+                                              handle_to_fd(object.handle), 0);
+
+    if (mapped_mem == MAP_FAILED || !mapped_mem) {
+        close(handle_to_fd(object.handle));
+        object.status = SHMEM_MAPPING_FAIL;
+        return object;
+    }
+
+    object.view = mapped_mem;
+    object.view_size = shmem_size;
+
+    if ((numa_status = nj_ipc_numa_apply(mapped_mem, shmem_size, options)) != SUCCESS) {
+        nj_ipc_shmem_unmap(&object);
+        close(handle_to_fd(object.handle));
+        object.status = numa_status;
+        return object;
+    }
+
+    object.name = nj_ipc_str_copy(name);
+    object.status = SUCCESS;
+
+    return object;
+#endif
+    return object;
+}
+
+/**
+ * Opens an existing Shared memory object.
+ *
+ * @param name The name of the shared memory object to be open.
+ * @param shmem_size Size of the shared memory in bytes.
+ * @return A new nj_ipc_shmem object.
+ */
+nj_ipc_shmem
+nj_ipc_shmem_open(const char *name, unsigned int shmem_size) {
+    return nj_ipc_shmem_open_ex(name, shmem_size, NULL);
+}
+
+/**
+ * Frees a shared memory object
+ *
+ * @param sync The shared memory object to be freed.
+ * @return Nothing.
+ */
+void
+nj_ipc_shmem_free(nj_ipc_shmem *shmem) {
+    if (!shmem) {
+        return;
+    }
+#ifdef NJ_IPC_WIN
+    if (shmem->handle) CloseHandle(shmem->handle);
+    nj_ipc_shmem_unmap(shmem);
+#endif
+#ifdef NJ_IPC_POSIX
+    nj_ipc_shmem_unmap(shmem);
+
+    if (shmem->handle) {
+        close((int)(intptr_t)shmem->handle);
+        if (shmem->name) shm_unlink(shmem->name); /* should client unlink it? hm... */
+    }
+#endif
+    free(shmem->name);
+}
+
+/**
+ * Unmaps a shared memory object without removing its name, so other processes can still open it.
+ *
+ * @param shmem The shared memory object to be closed.
+ * @return Nothing.
+ */
+void
+nj_ipc_shmem_close(nj_ipc_shmem *shmem) {
+    if (!shmem) {
+        return;
+    }
+#ifdef NJ_IPC_WIN
+    nj_ipc_shmem_unmap(shmem);
+    if (shmem->handle) CloseHandle(shmem->handle);
+#endif
+#ifdef NJ_IPC_POSIX
+    nj_ipc_shmem_unmap(shmem);
+    if (shmem->handle) close(handle_to_fd(shmem->handle));
+#endif
+    free(shmem->name);
+    shmem->view = NULL;
+    shmem->handle = NULL;
+    shmem->name = NULL;
+}
+
+typedef struct nj_ipc_iovec {
+    const void *data;
+    size_t size;
+} nj_ipc_iovec;
+
+/* Traffic Tap API */
+#define NJ_IPC_TAP_MAGIC 0x3170615463706a6eull /* "njpcTap1" */
+
+typedef enum {
+    NJ_IPC_TAP_CLIENT_TO_SERVER = 1,
+    NJ_IPC_TAP_SERVER_TO_CLIENT = 2,
+} nj_ipc_tap_direction;
+
+typedef struct nj_ipc_tap_header {
+    uint64_t magic;
+    uint64_t capacity;
+    volatile uint64_t used;
+    uint64_t reserved;
+} nj_ipc_tap_header;
+
+typedef struct nj_ipc_tap_record {
+    uint64_t timestamp;
+    volatile uint32_t direction; /* Stored last, zero until the record is complete */
+    uint32_t size;
+} nj_ipc_tap_record;
+
+#define nj_ipc_tap_record_data(record) ((void*)((nj_ipc_tap_record*)(record) + 1))
+#define nj_ipc_tap_record_span(size) ((sizeof(nj_ipc_tap_record) + (size) + 7) & ~(size_t)7)
+
+typedef struct nj_ipc_tap {
+    void *handle;
+    void *mapping;
+    nj_ipc_tap_header *view;
+    size_t view_size;
+    nj_ipc_error status;
+    char *path;
+} nj_ipc_tap;
+
+/**
+ * Maps a tap log file, shared by nj_ipc_tap_create and nj_ipc_tap_open.
+ *
+ * @param path Path of the log file.
+ * @param capacity Size of the log file in bytes, 0 to use the current file size.
+ * @return A new nj_ipc_tap object.
+ */
+nj_ipc_tap
+nj_ipc_tap_map(const char *path, size_t capacity) {
+    nj_ipc_tap tap;
+    tap.status = ERR;
+    tap.handle = NULL;
+    tap.mapping = NULL;
+    tap.view = NULL;
+    tap.path = NULL;
+
+#ifdef NJ_IPC_WIN
+    LARGE_INTEGER file_size;
+
+    tap.handle = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                             capacity ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (tap.handle == INVALID_HANDLE_VALUE) {
+        tap.handle = NULL;
+        tap.status = capacity ? TAP_CREATE_FAIL : TAP_OPEN_FAIL;
+        return tap;
+    }
+
+    if (!capacity) {
+        if (!GetFileSizeEx(tap.handle, &file_size) || (uint64_t)file_size.QuadPart < sizeof(nj_ipc_tap_header)) {
+            CloseHandle(tap.handle);
+            tap.status = TAP_OPEN_FAIL;
+            return tap;
+        }
+        capacity = (size_t)file_size.QuadPart;
+    }
+
+    tap.mapping = CreateFileMappingA(tap.handle, NULL, PAGE_READWRITE,
+                                     (DWORD)((uint64_t)capacity >> 32), (DWORD)capacity, NULL);
+
+    if (!tap.mapping) {
+        CloseHandle(tap.handle);
+        tap.status = TAP_MAPPING_FAIL;
+        return tap;
+    }
+
+    tap.view = (nj_ipc_tap_header*)MapViewOfFile(tap.mapping, FILE_MAP_ALL_ACCESS, 0, 0, capacity);
+
+    if (!tap.view) {
+        CloseHandle(tap.mapping);
+        CloseHandle(tap.handle);
+        tap.status = TAP_MAPPING_FAIL;
+        return tap;
+    }
+#endif
+#ifdef NJ_IPC_POSIX
+    struct stat file_stat;
+    int fd = open(path, capacity ? (O_CREAT | O_RDWR | O_TRUNC) : O_RDWR, 0644);
+
+    if (fd == -1) {
+        tap.status = capacity ? TAP_CREATE_FAIL : TAP_OPEN_FAIL;
+        return tap;
+    }
+
+    if (capacity) {
+        if (ftruncate(fd, (off_t)capacity) == -1) {
+            close(fd);
+            tap.status = TAP_CREATE_FAIL;
+            return tap;
+        }
+    } else {
+        if (fstat(fd, &file_stat) == -1 || (uint64_t)file_stat.st_size < sizeof(nj_ipc_tap_header)) {
+            close(fd);
+            tap.status = TAP_OPEN_FAIL;
+            return tap;
+        }
+        capacity = (size_t)file_stat.st_size;
+    }
+
+    void *mapped_mem = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (mapped_mem == MAP_FAILED) {
+        close(fd);
+        tap.status = TAP_MAPPING_FAIL;
+        return tap;
+    }
+
+    tap.handle = fd_to_handle(fd);
+    tap.view = (nj_ipc_tap_header*)mapped_mem;
+#endif
+    tap.view_size = capacity;
+    tap.path = nj_ipc_str_copy(path);
+    tap.status = SUCCESS;
+    return tap;
+}
+
+/**
+ * Create a new append-only traffic log, truncating any existing file.
+ *
+ * @param path Path of the log file.
+ * @param capacity Size of the log file in bytes, records past it are dropped.
+ * @return A new nj_ipc_tap object.
+ */
+nj_ipc_tap
+nj_ipc_tap_create(const char *path, size_t capacity) {
+    nj_ipc_tap tap;
+
+    if (nj_ipc_str_invalid(path)) {
+        tap.status = INVALID_NAME;
+        return tap;
+    }
+
+    if (capacity < sizeof(nj_ipc_tap_header)) {
+        tap.status = TAP_CREATE_FAIL;
+        return tap;
+    }
+
+    tap = nj_ipc_tap_map(path, capacity);
+
+    if (tap.status != SUCCESS) {
+        return tap;
+    }
+
+    tap.view->capacity = capacity;
+    tap.view->used = sizeof(nj_ipc_tap_header);
+    tap.view->reserved = 0;
+    nj_ipc_atomic_store64(&tap.view->magic, NJ_IPC_TAP_MAGIC);
+    return tap;
+}
+
+/**
+ * Opens an existing traffic log, to append to it from another process or to read it back.
+ *
+ * @param path Path of the log file.
+ * @return The open nj_ipc_tap object.
+ */
+nj_ipc_tap
+nj_ipc_tap_open(const char *path) {
+    nj_ipc_tap tap;
+
+    if (nj_ipc_str_invalid(path)) {
+        tap.status = INVALID_NAME;
+        return tap;
+    }
+
+    tap = nj_ipc_tap_map(path, 0);
+
+    if (tap.status == SUCCESS && (tap.view->magic != NJ_IPC_TAP_MAGIC || tap.view->capacity != tap.view_size)) {
+        tap.status = TAP_OPEN_FAIL;
+    }
+    return tap;
+}
+
+/**
+ * Appends one message to the traffic log.
+ *
+ * Space is reserved atomically, so the server and the client may tap into the same log.
+ *
+ * @param tap The traffic log.
+ * @param direction Which way the message travelled.
+ * @param parts The message, as written into the channel.
+ * @param part_count Number of entries in parts.
+ * @return The append status.
+ */
+nj_ipc_error
+nj_ipc_tap_append(nj_ipc_tap *tap, nj_ipc_tap_direction direction, const nj_ipc_iovec *parts, size_t part_count) {
+    size_t size = 0, i;
+    uint64_t offset;
+    nj_ipc_tap_record *record;
+    char *data;
+
+    if (!tap || !tap->view) {
+        return TAP_INVALID_OBJECT;
+    }
+
+    for (i = 0; i < part_count; i++) {
+        size += parts[i].size;
+    }
+
+    offset = nj_ipc_atomic_add64(&tap->view->used, nj_ipc_tap_record_span(size));
+
+    if (offset + nj_ipc_tap_record_span(size) > tap->view->capacity) {
+        return TAP_FULL;
+    }
+
+    record = (nj_ipc_tap_record*)((char*)tap->view + offset);
+    record->timestamp = nj_ipc_clock_ns();
+    record->size = (uint32_t)size;
+
+    data = (char*)nj_ipc_tap_record_data(record);
+    for (i = 0; i < part_count; i++) {
+        memcpy(data, parts[i].data, parts[i].size);
+        data += parts[i].size;
+    }
+
+    nj_ipc_atomic_store32(&record->direction, direction);
+    return SUCCESS;
+}
+
+/**
+ * Iterates over the records of a traffic log.
+ *
+ * @param tap The traffic log.
+ * @param cursor Iteration state, must be 0 before the first call.
+ * @param record Receives the next complete record.
+ * @return SUCCESS, or TAP_END when there are no more complete records.
+ */
+nj_ipc_error
+nj_ipc_tap_next(nj_ipc_tap *tap, size_t *cursor, nj_ipc_tap_record **record) {
+    uint64_t used;
+    nj_ipc_tap_record *next;
+
+    if (!tap || !tap->view || !cursor || !record) {
+        return TAP_INVALID_OBJECT;
+    }
+
+    if (*cursor < sizeof(nj_ipc_tap_header)) {
+        *cursor = sizeof(nj_ipc_tap_header);
+    }
+
+    used = nj_ipc_atomic_load64(&tap->view->used);
+    if (used > tap->view->capacity) {
+        used = tap->view->capacity;
+    }
+
+    if (*cursor + sizeof(nj_ipc_tap_record) > used) {
+        return TAP_END;
+    }
+
+    next = (nj_ipc_tap_record*)((char*)tap->view + *cursor);
+
+    if (!nj_ipc_atomic_load32(&next->direction) || *cursor + nj_ipc_tap_record_span(next->size) > used) {
+        return TAP_END;
+    }
+
+    *record = next;
+    *cursor += nj_ipc_tap_record_span(next->size);
+    return SUCCESS;
+}
+
+/**
+ * Frees a traffic log, the file itself is kept.
+ *
+ * @param tap The traffic log to be freed.
+ * @return Nothing.
+ */
+void
+nj_ipc_tap_free(nj_ipc_tap *tap) {
+    if (!tap || !tap->view) {
+        return;
+    }
+#ifdef NJ_IPC_WIN
+    UnmapViewOfFile(tap->view);
+    CloseHandle(tap->mapping);
+    CloseHandle(tap->handle);
+#endif
+#ifdef NJ_IPC_POSIX
+    munmap(tap->view, tap->view_size);
+    close(handle_to_fd(tap->handle));
+#endif
+    tap->view = NULL;
+    free(tap->path);
+}
+
+/* High-Level IPC API */
+typedef enum {
+    NJ_IPC_CHANNEL_SERVER,
+    NJ_IPC_CHANNEL_CLIENT,
+} nj_ipc_channel_role;
+
+typedef struct nj_ipc_channel {
+    nj_ipc_sync server_event;
+    nj_ipc_sync client_event;
+    nj_ipc_shmem shmem;
+    nj_ipc_error status;
+    char *name;
+    nj_ipc_channel_role role;
+    nj_ipc_tap *tap;
+    unsigned int lane_count;
+    nj_ipc_sync *lane_events;
+    unsigned int capacity;
+    nj_ipc_shmem generation; /* Side segment for reply cache invalidation, mapped on first use */
+} nj_ipc_channel;
+
+#define nj_ipc_channel_generation_name(buffer, name) sprintf(buffer, "%s_gen_njipc", name)
+
+/**
+ * Create a new IPC channel with shared memory options.
+ *
+ * @param name The name of the IPC channel.
+ * @param shmem_size Size of the shared memory in bytes.
+ * @param options Placement options for the shared memory, may be NULL.
+ * @return A new nj_ipc_channel object.
+ */
+nj_ipc_channel
+nj_ipc_channel_create_ex(const char *name, unsigned int shmem_size, const nj_ipc_shmem_options *options) {
+    char server_event_name[256], client_event_name[256];
+    nj_ipc_channel ch;
+    ch.status = ERR;
+    ch.role = NJ_IPC_CHANNEL_SERVER;
+    ch.tap = NULL;
+    ch.lane_count = 0;
+    ch.lane_events = NULL;
+    ch.capacity = shmem_size;
+    memset(&(ch.generation), 0, sizeof(ch.generation));
+
+    if (nj_ipc_str_invalid(name)) {
+        ch.status = INVALID_NAME;
+        return ch;
+    }
+
+    sprintf(server_event_name, "%s_server_njipc", name);
+    sprintf(client_event_name, "%s_client_njipc", name);
+
+    ch.server_event = nj_ipc_sync_create(server_event_name);
+
+    if (ch.server_event.status != SUCCESS) {
+        ch.status = ch.server_event.status;
+        return ch;
+    }
+
+    ch.client_event = nj_ipc_sync_create(client_event_name);
+
+    if (ch.client_event.status != SUCCESS) {
+        nj_ipc_sync_free(&(ch.server_event));
+        ch.status = ch.client_event.status;
+        return ch;
+    }
+
+    ch.shmem = nj_ipc_shmem_create_ex(name, shmem_size, options);
+
+    if (ch.shmem.status != SUCCESS) {
+        nj_ipc_sync_free(&(ch.server_event));
+        nj_ipc_sync_free(&(ch.client_event));
+        ch.status = ch.shmem.status;
+        return ch;
+    }
+
+    ch.name = nj_ipc_str_copy(name);
+    ch.status = SUCCESS;
+
+    return ch;
+}
+
+/**
+ * Create a new IPC channel.
+ *
+ * @param name The name of the IPC channel.
+ * @param shmem_size Size of the shared memory in bytes.
+ * @return A new nj_ipc_channel object.
+ */
+nj_ipc_channel
+nj_ipc_channel_create(const char *name, unsigned int shmem_size) {
+    return nj_ipc_channel_create_ex(name, shmem_size, NULL);
+}
+
+/**
+ * Open an existing IPC channel with shared memory options.
+ *
+ * @param name The name of the IPC channel.
+ * @param shmem_size Size of the shared memory in bytes.
+ * @param options Placement options for the shared memory, may be NULL.
+ * @return An opened nj_ipc_channel object.
+ */
+nj_ipc_channel
+nj_ipc_channel_open_ex(const char *name, unsigned int shmem_size, const nj_ipc_shmem_options *options) {
+    char server_event_name[256], client_event_name[256];
+    nj_ipc_channel ch;
+    ch.status = ERR;
+    ch.role = NJ_IPC_CHANNEL_CLIENT;
+    ch.tap = NULL;
+    ch.lane_count = 0;
+    ch.lane_events = NULL;
+    ch.capacity = shmem_size;
+    memset(&(ch.generation), 0, sizeof(ch.generation));
+
+    if (nj_ipc_str_invalid(name)) {
+        ch.status = INVALID_NAME;
+        return ch;
+    }
+
+    sprintf(server_event_name, "%s_server_njipc", name);
+    sprintf(client_event_name, "%s_client_njipc", name);
+
+    ch.server_event = nj_ipc_sync_open(server_event_name);
+
+    if (ch.server_event.status != SUCCESS) {
+        ch.status = ch.server_event.status;
+        return ch;
+    }
+
+    ch.client_event = nj_ipc_sync_open(client_event_name);
+
+    if (ch.client_event.status != SUCCESS) {
+        nj_ipc_sync_close(&(ch.server_event));
+        ch.status = ch.client_event.status;
+        return ch;
+    }
+
+    ch.shmem = nj_ipc_shmem_open_ex(name, shmem_size, options);
+
+    if (ch.shmem.status != SUCCESS) {
+        nj_ipc_sync_close(&(ch.server_event));
+        nj_ipc_sync_close(&(ch.client_event));
+        ch.status = ch.shmem.status;
+        return ch;
+    }
+
+    ch.name = nj_ipc_str_copy(name);
+    ch.status = SUCCESS;
+
+    return ch;
+}
+
+/**
+ * Attach a traffic tap to the IPC channel.
+ *
+ * Every message written through this channel object is appended to the log,
+ * with a timestamp and its direction. Pass NULL to detach.
+ *
+ * @param channel Pointer to the nj_ipc_channel object.
+ * @param tap The traffic log, must outlive the attachment.
+ * @return Nothing.
+ */
+void
+nj_ipc_channel_set_tap(nj_ipc_channel *channel, nj_ipc_tap *tap) {
+    if (channel) {
+        channel->tap = tap;
+    }
+}
+
+#define nj_ipc_channel_tap_direction(channel) \
+    ((channel)->role == NJ_IPC_CHANNEL_SERVER ? NJ_IPC_TAP_SERVER_TO_CLIENT : NJ_IPC_TAP_CLIENT_TO_SERVER)
+
+/**
+ * Open an existing IPC channel.
+ *
+ * @param name The name of the IPC channel.
+ * @param shmem_size Size of the shared memory in bytes.
+ * @return An opened nj_ipc_channel object.
+ */
+nj_ipc_channel
+nj_ipc_channel_open(const char *name, unsigned int shmem_size) {
+    return nj_ipc_channel_open_ex(name, shmem_size, NULL);
+}
+
+/**
+ * Write data into the shared memory of the IPC channel.
+ *
+ * @param channel Pointer to the nj_ipc_channel object.
+ * @param data The data to be written.
+ * @param data_size The size of the data beign written.
+ * @return The write status.
+ */
+nj_ipc_error
+nj_ipc_channel_write(nj_ipc_channel *channel, void *data, size_t data_size) {
+    if (!channel || !channel->shmem.view) {
+        return CHANNEL_WRITE_INVALID_SHMEM;
+    }
+
+    if (data_size > channel->capacity) {
+        return CHANNEL_WRITE_TOO_BIG;
+    }
+
+    memcpy(channel->shmem.view, data, data_size);
+
+    if (channel->tap) {
+        nj_ipc_iovec part = { data, data_size };
+        nj_ipc_tap_append(channel->tap, nj_ipc_channel_tap_direction(channel), &part, 1);
+    }
+    return SUCCESS;
+}
+
+/**
+ * Write several buffers back-to-back into the shared memory of the IPC channel.
+ *
+ * Each part is copied straight into the segment, so a header, body and trailer
+ * can be sent without first assembling them in a temporary buffer.
+ *
+ * @param channel Pointer to the nj_ipc_channel object.
+ * @param parts Array of (pointer, length) parts to be written in order.
+ * @param part_count Number of entries in parts.
+ * @return The write status.
+ */
+nj_ipc_error
+nj_ipc_channel_writev(nj_ipc_channel *channel, const nj_ipc_iovec *parts, size_t part_count) {
+    size_t total_size = 0, offset = 0, i;
+
+    if (!channel || !channel->shmem.view) {
+        return CHANNEL_WRITE_INVALID_SHMEM;
+    }
+
+    if (part_count && !parts) {
+        return ERR;
+    }
+
+    for (i = 0; i < part_count; i++) {
+        if (parts[i].size > channel->capacity - total_size) {
+            return CHANNEL_WRITE_TOO_BIG;
+        }
+        total_size += parts[i].size;
+    }
+
+    for (i = 0; i < part_count; i++) {
+        memcpy((char*)channel->shmem.view + offset, parts[i].data, parts[i].size);
+        offset += parts[i].size;
+    }
+
+    if (channel->tap) {
+        nj_ipc_tap_append(channel->tap, nj_ipc_channel_tap_direction(channel), parts, part_count);
+    }
+    return SUCCESS;
+}
+
+/**
+ * Reads data into from the shared memory of the IPC channel.
+ *
+ * @param channel Pointer to the nj_ipc_channel object.
+ * @param buffer The buffer to read into.
+ * @param read_size The size of the data beign read.
+ * @return The read status.
+ */
+nj_ipc_error
+nj_ipc_channel_read(nj_ipc_channel *channel, void *buffer, size_t read_size) {
+    if (!channel || !channel->shmem.view) {
+        return CHANNEL_READ_INVALID_SHMEM;
+    }
+
+    if (read_size > channel->capacity) {
+        return CHANNEL_READ_TOO_BIG;
+    }
+
+    memcpy(buffer, channel->shmem.view, read_size);
+    return SUCCESS;
+}
+
+/**
+ * Maps the invalidation generation of a named IPC channel, creating its side segment if neither side did yet.
+ *
+ * Only channels used with a reply cache need it; the channel segment itself is left as it is.
+ *
+ * @param channel Pointer to the nj_ipc_channel object.
+ * @return The attach status.
+ */
+nj_ipc_error
+nj_ipc_channel_generation_attach(nj_ipc_channel *channel) {
+    char generation_name[256];
+#ifdef NJ_IPC_POSIX
+    struct stat info;
+    unsigned int tries = 0;
+#endif
+
+    if (!channel || !channel->name) {
+        return CHANNEL_WRITE_INVALID_SHMEM;
+    }
+
+    if (channel->generation.view) {
+        return SUCCESS;
+    }
+
+    nj_ipc_channel_generation_name(generation_name, channel->name);
+    channel->generation = nj_ipc_shmem_create(generation_name, NJ_IPC_CACHE_LINE);
+
+    if (channel->generation.status == SHMEM_ALREADY_EXISTS_FAIL) {
+        channel->generation = nj_ipc_shmem_open(generation_name, NJ_IPC_CACHE_LINE);
+    }
+
+#ifdef NJ_IPC_POSIX
+    /* The other side may not have sized the segment yet, touching it before would fault */
+    while (channel->generation.status == SUCCESS
+           && (fstat(handle_to_fd(channel->generation.handle), &info) == -1 || info.st_size < NJ_IPC_CACHE_LINE)) {
+        if (++tries > 1000) {
+            nj_ipc_shmem_close(&(channel->generation));
+            channel->generation.status = SHMEM_INVALID_SIZE;
+            break;
+        }
+        nj_ipc_thread_yield();
+    }
+#endif
+    if (channel->generation.status != SUCCESS) {
+        channel->generation.view = NULL;
+        channel->generation.handle = NULL;
+    }
+    return channel->generation.status;
+}
+
+/**
+ * Marks every reply clients have cached from the IPC channel as stale.
+ *
+ * Called by the server when the state its replies derive from changes; a client
+ * comparing nj_ipc_channel_generation against the value it cached under sees the change.
+ *
+ * @param channel Pointer to the nj_ipc_channel object.
+ * @return The invalidation status.
+ */
+nj_ipc_error
+nj_ipc_channel_invalidate(nj_ipc_channel *channel) {
+    nj_ipc_error err = nj_ipc_channel_generation_attach(channel);
+
+    if (err != SUCCESS) {
+        return err;
+    }
+
+    nj_ipc_atomic_add64((volatile uint64_t*)channel->generation.view, 1);
+    return SUCCESS;
+}
+
+/**
+ * Reads the invalidation generation of the IPC channel.
+ *
+ * @param channel Pointer to the nj_ipc_channel object, attached with nj_ipc_channel_generation_attach.
+ * @return The number of nj_ipc_channel_invalidate calls so far, 0 while not attached.
+ */
+uint64_t
+nj_ipc_channel_generation(nj_ipc_channel *channel) {
+    if (!channel || !channel->generation.view) {
+        return 0;
+    }
+
+    return nj_ipc_atomic_load64((volatile uint64_t*)channel->generation.view);
+}
+
+/**
+ * Wait for a server event on the IPC channel.
+ *
+ * @param ch Pointer to the nj_ipc_channel object.
+ * @return The wait status.
+ */
+nj_ipc_error
+nj_ipc_channel_wait_server(nj_ipc_channel *ch) {
+    if (!ch || !ch->server_event.handle) {
+        return CHANNEL_WAIT_INVALID_EVENT;
+    }
+
+    return nj_ipc_sync_wait(&(ch->server_event));
+}
+
+/**
+ * Wait for a client event on the IPC channel.
+ *
+ * @param ch Pointer to the nj_ipc_channel object.
+ * @return The wait status.
+ */
+nj_ipc_error
+nj_ipc_channel_wait_client(nj_ipc_channel *ch) {
+    if (!ch || !ch->client_event.handle) {
+        return CHANNEL_WAIT_INVALID_EVENT;
+    }
+
+    return nj_ipc_sync_wait(&(ch->client_event));
+}
+
+/**
+ * Notify the server event on the IPC channel.
+ *
+ * @param ch Pointer to the nj_ipc_channel object.
+ * @return The notify status.
+ */
+nj_ipc_error
+nj_ipc_channel_notify_server(nj_ipc_channel *ch) {
+    if (!ch || !ch->server_event.handle) {
+        return CHANNEL_NOTIFY_INVALID_EVENT;
+    }
+
+    return nj_ipc_sync_notify(&(ch->server_event));
+}
+
+/**
+ * Notify the client event on the IPC channel.
+ *
+ * @param ch Pointer to the nj_ipc_channel object.
+ * @return The notify status.
+ */
+nj_ipc_error
+nj_ipc_channel_notify_client(nj_ipc_channel *ch) {
+    if (!ch || !ch->client_event.handle) {
+        return CHANNEL_NOTIFY_INVALID_EVENT;
+    }
+
+    return nj_ipc_sync_notify(&(ch->client_event));
+}
+
+/**
+ * Frees an IPC channel
+ *
+ * @param channel Pointer to the nj_ipc_channel object to be freed.
+ * @return Nothing.
+ */
+void
+nj_ipc_channel_free(nj_ipc_channel *ch) {
+    if (!ch) {
+        return;
+    }
+    if (ch->server_event.handle) nj_ipc_sync_free(&(ch->server_event));
+    if (ch->client_event.handle) nj_ipc_sync_free(&(ch->client_event));
+    if (ch->shmem.handle) nj_ipc_shmem_free(&(ch->shmem));
+    if (ch->generation.handle) {
+        nj_ipc_shmem_free(&(ch->generation));
+    } else if (ch->name) {
+        /* The other side may have created it, Windows drops it with the last handle */
+#ifdef NJ_IPC_POSIX
+        char generation_name[256];
+        nj_ipc_channel_generation_name(generation_name, ch->name);
+        shm_unlink(generation_name);
+#endif
+    }
+    if (ch->name) free(ch->name);
+    if (ch->lane_events) {
+        unsigned int i;
+        for (i = 0; i < ch->lane_count; i++) {
+            nj_ipc_sync_free(&(ch->lane_events[i]));
+        }
+        free(ch->lane_events);
+        ch->lane_events = NULL;
+    }
+}
+
+/**
+ * Closes an opened IPC channel without removing the names the server created.
+ *
+ * @param ch Pointer to the nj_ipc_channel object to be closed.
+ * @return Nothing.
+ */
+void
+nj_ipc_channel_close(nj_ipc_channel *ch) {
+    if (!ch) {
+        return;
+    }
+    nj_ipc_sync_close(&(ch->server_event));
+    nj_ipc_sync_close(&(ch->client_event));
+    if (ch->shmem.handle) nj_ipc_shmem_close(&(ch->shmem));
+    if (ch->generation.handle) nj_ipc_shmem_close(&(ch->generation));
+    if (ch->name) free(ch->name);
+    ch->name = NULL;
+    if (ch->lane_events) {
+        unsigned int i;
+        for (i = 0; i < ch->lane_count; i++) {
+            nj_ipc_sync_close(&(ch->lane_events[i]));
+        }
+        free(ch->lane_events);
+        ch->lane_events = NULL;
+    }
+}
+
+/* Lane API */
+#define NJ_IPC_LANE_MAGIC 0x6e6c6a6e /* "njln" */
+
+typedef enum {
+    NJ_IPC_LANE_IDLE,
+    NJ_IPC_LANE_REQUEST,
+    NJ_IPC_LANE_SERVICING,
+    NJ_IPC_LANE_REPLY,
+    NJ_IPC_LANE_FAILED,  /* The request was given up on, see nj_ipc_lane_fail */
+} nj_ipc_lane_status;
+
+typedef struct nj_ipc_lane_header {
+    uint32_t magic;
+    uint32_t lane_count;
+    uint32_t lane_size;
+    volatile uint32_t cursor;
+    volatile uint32_t released; /* Bumped on every release, clients waiting for a lane sleep on it */
+    volatile uint32_t waiters;
+} nj_ipc_lane_header;
+
+/* One cache line per lane, so lanes served by different threads don't share lines */
+typedef struct nj_ipc_lane_state {
+    volatile uint32_t owner;    /* Process id of the client holding the lane, 0 when free */
+    volatile uint32_t size;     /* Bytes of payload in the slot */
+    volatile uint64_t status;   /* nj_ipc_lane_status, and the servicing server's process id in the high half */
+    volatile uint32_t attempts; /* Workers that died servicing the current request */
+    uint8_t padding[NJ_IPC_CACHE_LINE - 20];
+} nj_ipc_lane_state;
+
+/* A server claims a request and names itself in one update, so no one ever sees one without the other */
+#define nj_ipc_lane_word(status, server) (((uint64_t)(server) << 32) | (uint64_t)(status))
+#define nj_ipc_lane_status(ch, lane) ((uint32_t)nj_ipc_atomic_load64(&nj_ipc_lane_state(ch, lane)->status))
+
+#define nj_ipc_lane_stride(lane_size) nj_ipc_align_up(lane_size, NJ_IPC_CACHE_LINE)
+#define nj_ipc_lane_segment_size(lane_size, lane_count) \
+    (NJ_IPC_CACHE_LINE + (size_t)(lane_count) * (sizeof(nj_ipc_lane_state) + nj_ipc_lane_stride(lane_size)))
+#define nj_ipc_lane_header(ch) ((nj_ipc_lane_header*)(ch)->shmem.view)
+#define nj_ipc_lane_state(ch, lane) \
+    ((nj_ipc_lane_state*)((char*)(ch)->shmem.view + NJ_IPC_CACHE_LINE) + (lane))
+
+/**
+ * Pointer to the payload slot of a lane, for writing requests or replies in place.
+ *
+ * @param ch Pointer to a lane channel.
+ * @param lane The lane index.
+ * @return The slot, nj_ipc_lane_header(ch)->lane_size bytes long.
+ */
+void*
+nj_ipc_lane_view(nj_ipc_channel *ch, unsigned int lane) {
+    return (char*)nj_ipc_lane_state(ch, ch->lane_count) + (size_t)lane * nj_ipc_lane_stride(nj_ipc_lane_header(ch)->lane_size);
+}
+
+/**
+ * Creates or opens the per-lane reply events of a lane channel.
+ *
+ * @param ch Pointer to a channel whose shmem holds the lanes.
+ * @param lane_count Number of lanes.
+ * @param create Non-zero to create the events, zero to open them.
+ * @return The status.
+ */
+nj_ipc_error
+nj_ipc_lane_events_init(nj_ipc_channel *ch, unsigned int lane_count, int create) {
+    char lane_event_name[256];
+    unsigned int i;
+
+    ch->lane_events = (nj_ipc_sync*) calloc(lane_count, sizeof(nj_ipc_sync));
+
+    if (!ch->lane_events) {
+        ch->lane_count = 0;
+        return ERR;
+    }
+
+    for (i = 0; i < lane_count; i++) {
+        sprintf(lane_event_name, "%s_lane%u_njipc", ch->name, i);
+        ch->lane_events[i] = create ? nj_ipc_sync_create(lane_event_name) : nj_ipc_sync_open(lane_event_name);
+
+        if (ch->lane_events[i].status != SUCCESS) {
+            nj_ipc_error status = ch->lane_events[i].status;
+            ch->lane_count = i;
+            return status;
+        }
+    }
+
+    ch->lane_count = lane_count;
+    return SUCCESS;
+}
+
+/**
+ * Create a new IPC channel split into independent lanes.
+ *
+ * Each lane is a request/reply slot with its own reply event, so one client
+ * thread per lane can have a request in flight while the server, possibly with
+ * several threads, services all of them.
+ *
+ * @param name The name of the IPC channel.
+ * @param lane_size Size of each lane's payload slot in bytes.
+ * @param lane_count Number of lanes.
+ * @param options Placement options for the shared memory, may be NULL.
+ * @return A new nj_ipc_channel object.
+ */
+nj_ipc_channel
+nj_ipc_channel_create_lanes(const char *name, unsigned int lane_size, unsigned int lane_count,
+                            const nj_ipc_shmem_options *options) {
+    nj_ipc_channel ch;
+    nj_ipc_lane_header *header;
+    nj_ipc_error status;
+
+    if (!lane_size || !lane_count || nj_ipc_lane_segment_size(lane_size, lane_count) > 0xffffffffu) {
+        ch.status = SHMEM_INVALID_SIZE;
+        return ch;
+    }
+
+    ch = nj_ipc_channel_create_ex(name, (unsigned int)nj_ipc_lane_segment_size(lane_size, lane_count), options);
+
+    if (ch.status != SUCCESS) {
+        return ch;
+    }
+
+    header = nj_ipc_lane_header(&ch);
+    header->lane_count = lane_count;
+    header->lane_size = lane_size;
+    header->cursor = 0;
+    header->released = 0;
+    header->waiters = 0;
+    nj_ipc_atomic_store32(&header->magic, NJ_IPC_LANE_MAGIC);
+
+    if ((status = nj_ipc_lane_events_init(&ch, lane_count, 1)) != SUCCESS) {
+        nj_ipc_channel_free(&ch);
+        ch.status = status;
+    }
+    return ch;
+}
+
+/**
+ * Open an existing IPC channel split into lanes.
+ *
+ * @param name The name of the IPC channel.
+ * @param lane_size Size of each lane's payload slot in bytes, as given on creation.
+ * @param lane_count Number of lanes, as given on creation.
+ * @param options Placement options for the shared memory, may be NULL.
+ * @return An opened nj_ipc_channel object.
+ */
+nj_ipc_channel
+nj_ipc_channel_open_lanes(const char *name, unsigned int lane_size, unsigned int lane_count,
+                          const nj_ipc_shmem_options *options) {
+    nj_ipc_channel ch;
+    nj_ipc_lane_header *header;
+    nj_ipc_error status;
+
+    if (!lane_size || !lane_count || nj_ipc_lane_segment_size(lane_size, lane_count) > 0xffffffffu) {
+        ch.status = SHMEM_INVALID_SIZE;
+        return ch;
+    }
+
+    ch = nj_ipc_channel_open_ex(name, (unsigned int)nj_ipc_lane_segment_size(lane_size, lane_count), options);
+
+    if (ch.status != SUCCESS) {
+        return ch;
+    }
+
+    header = nj_ipc_lane_header(&ch);
+
+    if (nj_ipc_atomic_load32(&header->magic) != NJ_IPC_LANE_MAGIC
+        || header->lane_count != lane_count || header->lane_size != lane_size) {
+        nj_ipc_channel_close(&ch);
+        ch.status = LANE_INVALID_CHANNEL;
+        return ch;
+    }
+
+    /* The names belong to the server, a failed open must not unlink them */
+    if ((status = nj_ipc_lane_events_init(&ch, lane_count, 0)) != SUCCESS) {
+        nj_ipc_channel_close(&ch);
+        ch.status = status;
+    }
+    return ch;
+}
+
+/**
+ * Claims a free lane for the calling client thread.
+ *
+ * @param ch Pointer to a lane channel.
+ * @param hint Lane to try first, e.g. derived from the thread id to avoid contention.
+ * @param lane Receives the claimed lane.
+ * @return SUCCESS, or LANE_BUSY when every lane is taken.
+ */
+nj_ipc_error
+nj_ipc_lane_acquire(nj_ipc_channel *ch, unsigned int hint, unsigned int *lane) {
+    unsigned int i, index;
+
+    if (!ch || !ch->lane_count || !lane) {
+        return LANE_INVALID_CHANNEL;
+    }
+
+    for (i = 0; i < ch->lane_count; i++) {
+        index = (hint + i) % ch->lane_count;
+        if (!nj_ipc_lane_state(ch, index)->owner && nj_ipc_atomic_cas32(&nj_ipc_lane_state(ch, index)->owner, 0, nj_ipc_process_id())) {
+            *lane = index;
+            return SUCCESS;
+        }
+    }
+    return LANE_BUSY;
+}
+
+#define NJ_IPC_LANE_ACQUIRE_SPINS 64
+
+/**
+ * Claims a free lane, sleeping until a lane is released when every lane is taken.
+ *
+ * @param ch Pointer to a lane channel.
+ * @param hint Lane to try first, e.g. derived from the thread id to avoid contention.
+ * @param lane Receives the claimed lane.
+ * @return The status.
+ */
+nj_ipc_error
+nj_ipc_lane_acquire_wait(nj_ipc_channel *ch, unsigned int hint, unsigned int *lane) {
+    nj_ipc_lane_header *header;
+    nj_ipc_error err;
+    uint32_t released;
+    unsigned int spins;
+
+    if (!ch || !ch->lane_count || !lane) {
+        return LANE_INVALID_CHANNEL;
+    }
+
+    header = nj_ipc_lane_header(ch);
+
+    for (spins = 0;; spins++) {
+        /* Read before trying, so a release between the try and the sleep isn't missed */
+        released = nj_ipc_atomic_load32(&header->released);
+
+        if ((err = nj_ipc_lane_acquire(ch, hint, lane)) != LANE_BUSY) {
+            return err;
+        }
+
+        if (spins < NJ_IPC_LANE_ACQUIRE_SPINS) {
+            nj_ipc_thread_yield();
+            continue;
+        }
+
+        nj_ipc_atomic_add32(&header->waiters, 1);
+        nj_ipc_futex_wait(&header->released, released, 0);
+        nj_ipc_atomic_add32(&header->waiters, (uint32_t)-1);
+    }
+}
+
+/**
+ * Gives a lane back once the client thread is done with it.
+ *
+ * @param ch Pointer to a lane channel.
+ * @param lane The lane to release.
+ * @return The release status.
+ */
+nj_ipc_error
+nj_ipc_lane_release(nj_ipc_channel *ch, unsigned int lane) {
+    if (!ch || !ch->lane_count) {
+        return LANE_INVALID_CHANNEL;
+    }
+
+    if (lane >= ch->lane_count) {
+        return LANE_INVALID;
+    }
+
+    nj_ipc_atomic_store32(&nj_ipc_lane_state(ch, lane)->owner, 0);
+    nj_ipc_atomic_add32(&nj_ipc_lane_header(ch)->released, 1);
+
+    if (nj_ipc_atomic_load32(&nj_ipc_lane_header(ch)->waiters)) {
+        nj_ipc_futex_wake(&nj_ipc_lane_header(ch)->released, 1);
+    }
+    return SUCCESS;
+}
+
+/**
+ * Copies a payload into a lane, shared by nj_ipc_lane_send and nj_ipc_lane_reply.
+ *
+ * @param ch Pointer to a lane channel.
+ * @param lane The lane to write.
+ * @param data The payload, may be NULL when it was written in place with nj_ipc_lane_view.
+ * @param data_size The size of the payload.
+ * @return The write status.
+ */
+nj_ipc_error
+nj_ipc_lane_write(nj_ipc_channel *ch, unsigned int lane, const void *data, size_t data_size) {
+    if (!ch || !ch->lane_count) {
+        return LANE_INVALID_CHANNEL;
+    }
+
+    if (lane >= ch->lane_count) {
+        return LANE_INVALID;
+    }
+
+    if (data_size > nj_ipc_lane_header(ch)->lane_size) {
+        return LANE_TOO_BIG;
+    }
+
+    if (data) {
+        memcpy(nj_ipc_lane_view(ch, lane), data, data_size);
+    }
+    nj_ipc_lane_state(ch, lane)->size = (uint32_t)data_size;
+    return SUCCESS;
+}
+
+/**
+ * Sends a request on a lane held by the calling client thread.
+ *
+ * @param ch Pointer to a lane channel.
+ * @param lane The lane, claimed with nj_ipc_lane_acquire.
+ * @param data The request, may be NULL when it was written in place with nj_ipc_lane_view.
+ * @param data_size The size of the request.
+ * @return The send status.
+ */
+nj_ipc_error
+nj_ipc_lane_send(nj_ipc_channel *ch, unsigned int lane, const void *data, size_t data_size) {
+    nj_ipc_error err = nj_ipc_lane_write(ch, lane, data, data_size);
+
+    if (err != SUCCESS) {
+        return err;
+    }
+
+    nj_ipc_lane_state(ch, lane)->attempts = 0;
+    nj_ipc_atomic_store64(&nj_ipc_lane_state(ch, lane)->status, nj_ipc_lane_word(NJ_IPC_LANE_REQUEST, 0));
+    return nj_ipc_sync_notify(&(ch->client_event));
+}
+
+/**
+ * Waits for the reply to the request in flight on a lane.
+ *
+ * @param ch Pointer to a lane channel.
+ * @param lane The lane the request was sent on.
+ * @return The wait status, the reply can then be read with nj_ipc_lane_read. LANE_REQUEST_FAILED when the
+ *         server gave up on the request.
+ */
+nj_ipc_error
+nj_ipc_lane_wait_reply(nj_ipc_channel *ch, unsigned int lane) {
+    uint32_t status;
+    nj_ipc_error err;
+
+    if (!ch || !ch->lane_count) {
+        return LANE_INVALID_CHANNEL;
+    }
+
+    if (lane >= ch->lane_count) {
+        return LANE_INVALID;
+    }
+
+    while ((status = nj_ipc_lane_status(ch, lane)) != NJ_IPC_LANE_REPLY && status != NJ_IPC_LANE_FAILED) {
+        if ((err = nj_ipc_sync_wait(&(ch->lane_events[lane]))) != SUCCESS) {
+            return err;
+        }
+    }
+
+    nj_ipc_atomic_store64(&nj_ipc_lane_state(ch, lane)->status, nj_ipc_lane_word(NJ_IPC_LANE_IDLE, 0));
+    return status == NJ_IPC_LANE_REPLY ? SUCCESS : LANE_REQUEST_FAILED;
+}
+
+/**
+ * Waits until any lane has a pending request and claims it for the calling server thread.
+ *
+ * Several server threads or processes may call this concurrently, each request
+ * is handed to exactly one of them.
+ *
+ * @param ch Pointer to a lane channel.
+ * @param lane Receives the lane to service.
+ * @return The wait status.
+ */
+nj_ipc_error
+nj_ipc_lane_next(nj_ipc_channel *ch, unsigned int *lane) {
+    unsigned int i, index, start;
+    nj_ipc_error err;
+
+    if (!ch || !ch->lane_count || !lane) {
+        return LANE_INVALID_CHANNEL;
+    }
+
+    for (;;) {
+        start = nj_ipc_atomic_add32(&nj_ipc_lane_header(ch)->cursor, 1);
+
+        for (i = 0; i < ch->lane_count; i++) {
+            index = (start + i) % ch->lane_count;
+            if (nj_ipc_lane_status(ch, index) == NJ_IPC_LANE_REQUEST
+                && nj_ipc_atomic_cas64(&nj_ipc_lane_state(ch, index)->status, nj_ipc_lane_word(NJ_IPC_LANE_REQUEST, 0),
+                                       nj_ipc_lane_word(NJ_IPC_LANE_SERVICING, nj_ipc_process_id()))) {
+                *lane = index;
+                return SUCCESS;
+            }
+        }
+
+        if ((err = nj_ipc_sync_wait(&(ch->client_event))) != SUCCESS) {
+            return err;
+        }
+    }
+}
+
+/**
+ * Replies to the request being serviced on a lane.
+ *
+ * @param ch Pointer to a lane channel.
+ * @param lane The lane returned by nj_ipc_lane_next.
+ * @param data The reply, may be NULL when it was written in place with nj_ipc_lane_view.
+ * @param data_size The size of the reply.
+ * @return The reply status.
+ */
+nj_ipc_error
+nj_ipc_lane_reply(nj_ipc_channel *ch, unsigned int lane, const void *data, size_t data_size) {
+    nj_ipc_error err = nj_ipc_lane_write(ch, lane, data, data_size);
+
+    if (err != SUCCESS) {
+        return err;
+    }
+
+    nj_ipc_atomic_store64(&nj_ipc_lane_state(ch, lane)->status, nj_ipc_lane_word(NJ_IPC_LANE_REPLY, 0));
+    return nj_ipc_sync_notify(&(ch->lane_events[lane]));
+}
+
+/**
+ * Gives up on the request being serviced on a lane, its client's wait returns LANE_REQUEST_FAILED.
+ *
+ * @param ch Pointer to a lane channel.
+ * @param lane The lane returned by nj_ipc_lane_next.
+ * @return The notification status.
+ */
+nj_ipc_error
+nj_ipc_lane_fail(nj_ipc_channel *ch, unsigned int lane) {
+    if (!ch || !ch->lane_count) {
+        return LANE_INVALID_CHANNEL;
+    }
+
+    if (lane >= ch->lane_count) {
+        return LANE_INVALID;
+    }
+
+    nj_ipc_atomic_store64(&nj_ipc_lane_state(ch, lane)->status, nj_ipc_lane_word(NJ_IPC_LANE_FAILED, 0));
+    return nj_ipc_sync_notify(&(ch->lane_events[lane]));
+}
+
+/**
+ * Reads the request or reply currently held by a lane.
+ *
+ * @param ch Pointer to a lane channel.
+ * @param lane The lane to read.
+ * @param buffer The buffer to read into.
+ * @param read_size The size of the data being read.
+ * @return The read status.
+ */
+nj_ipc_error
+nj_ipc_lane_read(nj_ipc_channel *ch, unsigned int lane, void *buffer, size_t read_size) {
+    if (!ch || !ch->lane_count) {
+        return LANE_INVALID_CHANNEL;
+    }
+
+    if (lane >= ch->lane_count) {
+        return LANE_INVALID;
+    }
+
+    if (read_size > nj_ipc_lane_header(ch)->lane_size) {
+        return LANE_TOO_BIG;
+    }
+
+    memcpy(buffer, nj_ipc_lane_view(ch, lane), read_size);
+    return SUCCESS;
+}
+
+/* Stream API */
+#define NJ_IPC_STREAM_SLOTS 2
+
+/* Each side's counter and waiting flag live on their own cache line, chunk slots follow */
+typedef struct nj_ipc_stream_header {
+    volatile uint64_t produced;
+    volatile uint32_t writer_waiting;
+    uint8_t producer_padding[NJ_IPC_CACHE_LINE - 12];
+    volatile uint64_t consumed;
+    volatile uint32_t reader_waiting;
+    uint8_t consumer_padding[NJ_IPC_CACHE_LINE - 12];
+} nj_ipc_stream_header;
+
+typedef struct nj_ipc_stream_chunk {
+    uint64_t transfer_size;
+    uint64_t offset;
+    uint64_t size;
+    uint8_t padding[NJ_IPC_CACHE_LINE - 24];
+} nj_ipc_stream_chunk;
+
+typedef struct nj_ipc_stream {
+    nj_ipc_channel *channel;
+    nj_ipc_sync *own_event;
+    nj_ipc_sync *peer_event;
+    unsigned int slot_count;
+    size_t slot_stride;
+    size_t chunk_size;
+    uint64_t remaining; /* Bytes of the current incoming transfer not handed out yet */
+    int holding;        /* Whether the reader still holds the last chunk handed out */
+    nj_ipc_error status;
+} nj_ipc_stream;
+
+#define nj_ipc_stream_header(stream) ((nj_ipc_stream_header*)(stream)->channel->shmem.view)
+#define nj_ipc_stream_chunk(stream, sequence) \
+    ((nj_ipc_stream_chunk*)((char*)(stream)->channel->shmem.view + sizeof(nj_ipc_stream_header) \
+                            + (size_t)((sequence) % (stream)->slot_count) * (stream)->slot_stride))
+/**
+ * Whether the side waiting can go on.
+ *
+ * @param stream Pointer to the nj_ipc_stream object.
+ * @param for_space Non-zero to check for a free slot, zero to check for a chunk.
+ * @return Non-zero when ready.
+ */
+int
+nj_ipc_stream_ready(nj_ipc_stream *stream, int for_space) {
+    nj_ipc_stream_header *header = nj_ipc_stream_header(stream);
+    uint64_t in_flight = nj_ipc_atomic_load64(&header->produced) - nj_ipc_atomic_load64(&header->consumed);
+    return for_space ? in_flight < stream->slot_count : in_flight != 0;
+}
+
+/**
+ * Sleeps on the peer's event until the other side makes the stream ready.
+ *
+ * The waiting flag makes the other side notify only when someone sleeps, and
+ * each notification is consumed exactly once, so no stray wakeups are left on
+ * the channel events once the stream is done.
+ *
+ * @param stream Pointer to the nj_ipc_stream object.
+ * @param waiting This side's waiting flag.
+ * @param for_space Non-zero to wait for a free slot, zero to wait for a chunk.
+ * @return The wait status.
+ */
+nj_ipc_error
+nj_ipc_stream_wait(nj_ipc_stream *stream, volatile uint32_t *waiting, int for_space) {
+    nj_ipc_error err;
+
+    while (!nj_ipc_stream_ready(stream, for_space)) {
+        nj_ipc_atomic_store32(waiting, 1);
+
+        if (nj_ipc_stream_ready(stream, for_space)) {
+            /* The other side may have cleared the flag already, then its notification is on its way */
+            if (!nj_ipc_atomic_cas32(waiting, 1, 0)) {
+                return nj_ipc_sync_wait(stream->peer_event);
+            }
+            return SUCCESS;
+        }
+
+        if ((err = nj_ipc_sync_wait(stream->peer_event)) != SUCCESS) {
+            return err;
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * Wakes the other side if it sleeps waiting for us.
+ *
+ * @param stream Pointer to the nj_ipc_stream object.
+ * @param waiting The other side's waiting flag.
+ * @return Nothing.
+ */
+void
+nj_ipc_stream_wake(nj_ipc_stream *stream, volatile uint32_t *waiting) {
+    if (nj_ipc_atomic_load32(waiting) && nj_ipc_atomic_cas32(waiting, 1, 0)) {
+        nj_ipc_sync_notify(stream->own_event);
+    }
+}
+
+/**
+ * Turns the shared memory of a channel into a multi-buffered stream.
+ *
+ * The segment is split into slot_count chunk slots, so the writer fills the
+ * next chunk while the reader drains the previous one. Both ends must use the
+ * same slot_count on a fresh channel, and the channel must not be used for
+ * anything else meanwhile. Data flows one way at a time, from the end that
+ * calls nj_ipc_stream_write.
  *
  * @param ch Pointer to the nj_ipc_channel object.
+ * @param slot_count Number of chunk slots, 2 for double buffering.
+ * @return A new nj_ipc_stream object.
+ */
+nj_ipc_stream
+nj_ipc_stream_init(nj_ipc_channel *ch, unsigned int slot_count) {
+    nj_ipc_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    stream.status = ERR;
+
+    if (!ch || !ch->shmem.view || ch->lane_count) {
+        stream.status = STREAM_INVALID_OBJECT;
+        return stream;
+    }
+
+    if (!slot_count || ch->capacity < sizeof(nj_ipc_stream_header)) {
+        stream.status = STREAM_INVALID_SIZE;
+        return stream;
+    }
+
+    stream.slot_stride = (ch->capacity - sizeof(nj_ipc_stream_header)) / slot_count / NJ_IPC_CACHE_LINE * NJ_IPC_CACHE_LINE;
+
+    if (stream.slot_stride <= sizeof(nj_ipc_stream_chunk)) {
+        stream.status = STREAM_INVALID_SIZE;
+        return stream;
+    }
+
+    stream.channel = ch;
+    stream.slot_count = slot_count;
+    stream.chunk_size = stream.slot_stride - sizeof(nj_ipc_stream_chunk);
+    stream.own_event = ch->role == NJ_IPC_CHANNEL_CLIENT ? &(ch->client_event) : &(ch->server_event);
+    stream.peer_event = ch->role == NJ_IPC_CHANNEL_CLIENT ? &(ch->server_event) : &(ch->client_event);
+    stream.status = SUCCESS;
+    return stream;
+}
+
+/**
+ * Sends a payload of any size through the stream, one chunk at a time.
+ *
+ * Blocks while every slot is still waiting to be drained by the reader.
+ *
+ * @param stream Pointer to the nj_ipc_stream object.
+ * @param data The payload.
+ * @param data_size The size of the payload.
+ * @return The write status.
+ */
+nj_ipc_error
+nj_ipc_stream_write(nj_ipc_stream *stream, const void *data, size_t data_size) {
+    nj_ipc_stream_header *header;
+    nj_ipc_stream_chunk *chunk;
+    uint64_t produced;
+    size_t offset = 0;
+    nj_ipc_error err;
+
+    if (!stream || !stream->channel) {
+        return STREAM_INVALID_OBJECT;
+    }
+
+    header = nj_ipc_stream_header(stream);
+    produced = nj_ipc_atomic_load64(&header->produced);
+
+    do {
+        if ((err = nj_ipc_stream_wait(stream, &header->writer_waiting, 1)) != SUCCESS) {
+            return err;
+        }
+
+        chunk = nj_ipc_stream_chunk(stream, produced);
+        chunk->transfer_size = data_size;
+        chunk->offset = offset;
+        chunk->size = data_size - offset < stream->chunk_size ? data_size - offset : stream->chunk_size;
+        memcpy(chunk + 1, (const char*)data + offset, (size_t)chunk->size);
+        offset += (size_t)chunk->size;
+
+        nj_ipc_atomic_store64(&header->produced, ++produced);
+        nj_ipc_stream_wake(stream, &header->reader_waiting);
+    } while (offset < data_size);
+
+    return SUCCESS;
+}
+
+/**
+ * Gives the slot of the chunk last handed out back to the writer.
+ *
+ * @param stream Pointer to the nj_ipc_stream object.
+ * @return Nothing.
+ */
+void
+nj_ipc_stream_release(nj_ipc_stream *stream) {
+    if (stream && stream->holding) {
+        nj_ipc_atomic_add64(&nj_ipc_stream_header(stream)->consumed, 1);
+        nj_ipc_stream_wake(stream, &nj_ipc_stream_header(stream)->writer_waiting);
+        stream->holding = 0;
+    }
+}
+
+/**
+ * Waits for the next chunk and reports the total size of its transfer, without consuming it.
+ *
+ * @param stream Pointer to the nj_ipc_stream object.
+ * @param transfer_size Receives the total size of the transfer.
+ * @return The wait status.
+ */
+nj_ipc_error
+nj_ipc_stream_begin(nj_ipc_stream *stream, size_t *transfer_size) {
+    nj_ipc_stream_header *header;
+    nj_ipc_stream_chunk *chunk;
+    nj_ipc_error err;
+
+    if (!stream || !stream->channel || !transfer_size) {
+        return STREAM_INVALID_OBJECT;
+    }
+
+    nj_ipc_stream_release(stream);
+    header = nj_ipc_stream_header(stream);
+
+    if ((err = nj_ipc_stream_wait(stream, &header->reader_waiting, 0)) != SUCCESS) {
+        return err;
+    }
+
+    chunk = nj_ipc_stream_chunk(stream, nj_ipc_atomic_load64(&header->consumed));
+    *transfer_size = (size_t)chunk->transfer_size;
+
+    if (!chunk->offset) {
+        stream->remaining = *transfer_size;
+    }
+    return SUCCESS;
+}
+
+/**
+ * Hands out the next chunk of the current transfer, in place in shared memory.
+ *
+ * The chunk stays valid until the next call on the stream, which gives its slot
+ * back to the writer.
+ *
+ * @param stream Pointer to the nj_ipc_stream object.
+ * @param chunk Receives a pointer to the chunk data.
+ * @param chunk_size Receives the size of the chunk.
+ * @return SUCCESS, or STREAM_END once the whole transfer was handed out.
+ */
+nj_ipc_error
+nj_ipc_stream_next(nj_ipc_stream *stream, const void **chunk, size_t *chunk_size) {
+    nj_ipc_stream_chunk *slot;
+    size_t transfer_size;
+    nj_ipc_error err;
+
+    if (!stream || !stream->channel || !chunk || !chunk_size) {
+        return STREAM_INVALID_OBJECT;
+    }
+
+    /* The last chunk was handed out, zero-sized transfers carry one empty chunk */
+    if (stream->holding && !stream->remaining) {
+        nj_ipc_stream_release(stream);
+        return STREAM_END;
+    }
+
+    if ((err = nj_ipc_stream_begin(stream, &transfer_size)) != SUCCESS) {
+        return err;
+    }
+
+    slot = nj_ipc_stream_chunk(stream, nj_ipc_atomic_load64(&nj_ipc_stream_header(stream)->consumed));
+    *chunk = slot + 1;
+    *chunk_size = (size_t)slot->size;
+    stream->remaining -= slot->size;
+    stream->holding = 1;
+    return SUCCESS;
+}
+
+/**
+ * Receives a whole transfer into a contiguous buffer.
+ *
+ * @param stream Pointer to the nj_ipc_stream object.
+ * @param buffer The buffer to read into.
+ * @param capacity The size of the buffer.
+ * @param transfer_size Receives the size of the transfer.
+ * @return The read status, STREAM_TOO_BIG leaves the transfer pending so it can be retried.
+ */
+nj_ipc_error
+nj_ipc_stream_read(nj_ipc_stream *stream, void *buffer, size_t capacity, size_t *transfer_size) {
+    const void *chunk;
+    size_t chunk_size, offset = 0;
+    nj_ipc_error err;
+
+    if ((err = nj_ipc_stream_begin(stream, transfer_size)) != SUCCESS) {
+        return err;
+    }
+
+    if (*transfer_size > capacity) {
+        return STREAM_TOO_BIG;
+    }
+
+    while ((err = nj_ipc_stream_next(stream, &chunk, &chunk_size)) == SUCCESS) {
+        memcpy((char*)buffer + offset, chunk, chunk_size);
+        offset += chunk_size;
+    }
+
+    return err == STREAM_END ? SUCCESS : err;
+}
+
+/* Key-Value API */
+#define NJ_IPC_KV_MAGIC 0x766b6a6e /* "njkv" */
+#define NJ_IPC_KV_STRIPES 256
+
+#define NJ_IPC_KV_EMPTY 0
+#define NJ_IPC_KV_DELETED 1
+
+typedef struct nj_ipc_kv_header {
+    uint32_t magic;
+    uint32_t key_size;
+    uint32_t value_size;
+    uint32_t capacity;
+    uint32_t bucket_size;
+    volatile uint32_t count;
+    uint8_t padding[NJ_IPC_CACHE_LINE - 24];
+    volatile uint32_t stripes[NJ_IPC_KV_STRIPES]; /* Process ids of the writers, picked by the key's home bucket */
+} nj_ipc_kv_header;
+
+/* A bucket spans whole cache lines: sequence, hash tag, key bytes then value bytes */
+typedef struct nj_ipc_kv_bucket {
+    volatile uint64_t sequence; /* Odd while a writer modifies the bucket, the writer's process id in the high half */
+    volatile uint32_t tag;      /* NJ_IPC_KV_EMPTY, NJ_IPC_KV_DELETED or the key's hash */
+    uint32_t padding;
+} nj_ipc_kv_bucket;
+
+typedef struct nj_ipc_kv {
+    nj_ipc_shmem shmem;
+    nj_ipc_kv_header *header;
+    nj_ipc_error status;
+} nj_ipc_kv;
+
+#define nj_ipc_kv_bucket_size(key_size, value_size) \
+    nj_ipc_align_up(sizeof(nj_ipc_kv_bucket) + (size_t)(key_size) + (value_size), NJ_IPC_CACHE_LINE)
+#define nj_ipc_kv_segment_size(key_size, value_size, capacity) \
+    (sizeof(nj_ipc_kv_header) + (size_t)(capacity) * nj_ipc_kv_bucket_size(key_size, value_size))
+#define nj_ipc_kv_bucket(kv, index) \
+    ((nj_ipc_kv_bucket*)((char*)(kv)->header + sizeof(nj_ipc_kv_header) + (size_t)(index) * (kv)->header->bucket_size))
+#define nj_ipc_kv_key(bucket) ((char*)(bucket) + sizeof(nj_ipc_kv_bucket))
+#define nj_ipc_kv_value(kv, bucket) (nj_ipc_kv_key(bucket) + (kv)->header->key_size)
+
+/**
+ * Hashes a key, the result is never NJ_IPC_KV_EMPTY nor NJ_IPC_KV_DELETED.
+ *
+ * @param key The key bytes.
+ * @param key_size The size of the key.
+ * @return The hash tag.
+ */
+uint32_t
+nj_ipc_kv_hash(const void *key, size_t key_size) {
+    const unsigned char *bytes = (const unsigned char*)key;
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < key_size; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+
+    /* Finalizer, spreads the low bits used to pick the bucket */
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    return hash > NJ_IPC_KV_DELETED ? hash : hash + 2;
+}
+
+/**
+ * Create a new key-value store in shared memory.
+ *
+ * Keys and values have a fixed size. Reads take no lock, writers only lock the
+ * stripe of the key's home bucket and the bucket they modify. Both record the
+ * writer's process id: when a writer dies mid-write, the next reader or writer
+ * to wait on its bucket drops the key it was writing, since its value may be
+ * half-written, and nj_ipc_kv_count may stay one too high.
+ *
+ * @param name The name of the store.
+ * @param key_size The size of every key in bytes.
+ * @param value_size The size of every value in bytes.
+ * @param capacity Number of buckets, rounded up to a power of two.
+ * @return A new nj_ipc_kv object.
+ */
+nj_ipc_kv
+nj_ipc_kv_create(const char *name, unsigned int key_size, unsigned int value_size, unsigned int capacity) {
+    nj_ipc_kv kv;
+    uint32_t buckets = nj_ipc_pow2_ceil(capacity);
+    kv.status = ERR;
+    kv.header = NULL;
+
+    if (!key_size || !buckets || nj_ipc_kv_segment_size(key_size, value_size, buckets) > 0xffffffffu) {
+        kv.status = SHMEM_INVALID_SIZE;
+        return kv;
+    }
+
+    kv.shmem = nj_ipc_shmem_create(name, (unsigned int)nj_ipc_kv_segment_size(key_size, value_size, buckets));
+
+    if (kv.shmem.status != SUCCESS) {
+        kv.status = kv.shmem.status;
+        return kv;
+    }
+
+    kv.header = (nj_ipc_kv_header*)kv.shmem.view;
+    kv.header->key_size = key_size;
+    kv.header->value_size = value_size;
+    kv.header->capacity = buckets;
+    kv.header->bucket_size = (uint32_t)nj_ipc_kv_bucket_size(key_size, value_size);
+    nj_ipc_atomic_store32(&kv.header->magic, NJ_IPC_KV_MAGIC);
+    kv.status = SUCCESS;
+    return kv;
+}
+
+/**
+ * Opens an existing key-value store.
+ *
+ * @param name The name of the store.
+ * @param key_size The size of every key in bytes, as given on creation.
+ * @param value_size The size of every value in bytes, as given on creation.
+ * @param capacity Number of buckets, as given on creation.
+ * @return The open nj_ipc_kv object.
+ */
+nj_ipc_kv
+nj_ipc_kv_open(const char *name, unsigned int key_size, unsigned int value_size, unsigned int capacity) {
+    nj_ipc_kv kv;
+    uint32_t buckets = nj_ipc_pow2_ceil(capacity);
+    kv.status = ERR;
+    kv.header = NULL;
+
+    if (!key_size || !buckets || nj_ipc_kv_segment_size(key_size, value_size, buckets) > 0xffffffffu) {
+        kv.status = SHMEM_INVALID_SIZE;
+        return kv;
+    }
+
+    kv.shmem = nj_ipc_shmem_open(name, (unsigned int)nj_ipc_kv_segment_size(key_size, value_size, buckets));
+
+    if (kv.shmem.status != SUCCESS) {
+        kv.status = kv.shmem.status;
+        return kv;
+    }
+
+    kv.header = (nj_ipc_kv_header*)kv.shmem.view;
+
+    if (nj_ipc_atomic_load32(&kv.header->magic) != NJ_IPC_KV_MAGIC || kv.header->key_size != key_size
+        || kv.header->value_size != value_size || kv.header->capacity != buckets) {
+        nj_ipc_shmem_close(&kv.shmem); /* The segment belongs to its creator, don't unlink it */
+        kv.header = NULL;
+        kv.status = KV_INVALID_LAYOUT;
+        return kv;
+    }
+
+    kv.status = SUCCESS;
+    return kv;
+}
+
+#define nj_ipc_kv_bucket_unlock(bucket) \
+    nj_ipc_atomic_store64(&(bucket)->sequence, (uint32_t)nj_ipc_atomic_load64(&(bucket)->sequence) + 1)
+
+/**
+ * Unlocks a bucket whose writer died while modifying it, dropping its key.
+ *
+ * @param kv Pointer to the nj_ipc_kv object.
+ * @param bucket The bucket.
+ * @param sequence The locked sequence seen by the caller.
+ * @return Non-zero when the bucket was recovered.
+ */
+int
+nj_ipc_kv_bucket_recover(nj_ipc_kv *kv, nj_ipc_kv_bucket *bucket, uint64_t sequence) {
+    uint32_t writer = (uint32_t)(sequence >> 32);
+
+    if (!(sequence & 1) || !writer || nj_ipc_process_alive(writer)
+        || !nj_ipc_atomic_cas64(&bucket->sequence, sequence,
+                                (uint64_t)nj_ipc_process_id() << 32 | (uint32_t)sequence)) {
+        return 0;
+    }
+
+    /* Writers count a key before publishing its tag, so dropping a live tag never undercounts */
+    if (nj_ipc_atomic_load32(&bucket->tag) > NJ_IPC_KV_DELETED) {
+        nj_ipc_atomic_store32(&bucket->tag, NJ_IPC_KV_DELETED);
+        nj_ipc_atomic_add32(&kv->header->count, (uint32_t)-1);
+    }
+    nj_ipc_kv_bucket_unlock(bucket);
+    return 1;
+}
+
+/**
+ * Marks a bucket as being written, readers retry until nj_ipc_kv_bucket_unlock.
+ *
+ * @param kv Pointer to the nj_ipc_kv object.
+ * @param bucket The bucket.
+ * @return Nothing.
+ */
+void
+nj_ipc_kv_bucket_lock(nj_ipc_kv *kv, nj_ipc_kv_bucket *bucket) {
+    uint64_t writer = (uint64_t)nj_ipc_process_id() << 32, sequence, checked = 0;
+
+    for (;;) {
+        sequence = nj_ipc_atomic_load64(&bucket->sequence);
+        if (!(sequence & 1) && nj_ipc_atomic_cas64(&bucket->sequence, sequence, writer | (uint32_t)(sequence + 1))) {
+            return;
+        }
+        if (!checked) {
+            checked = nj_ipc_clock_ns();
+        } else if (nj_ipc_lock_check_due(&checked)) {
+            nj_ipc_kv_bucket_recover(kv, bucket, sequence);
+        }
+        nj_ipc_thread_yield();
+    }
+}
+
+/**
+ * Looks a key up, without taking any lock.
+ *
+ * @param kv Pointer to the nj_ipc_kv object.
+ * @param key The key, key_size bytes long.
+ * @param value Receives the value, value_size bytes long, may be NULL to test for presence.
+ * @return SUCCESS, or KV_NOT_FOUND.
+ */
+nj_ipc_error
+nj_ipc_kv_get(nj_ipc_kv *kv, const void *key, void *value) {
+    uint32_t tag, mask, index, probe, bucket_tag;
+    uint64_t sequence, checked = 0;
+    nj_ipc_kv_bucket *bucket;
+    int matches;
+
+    if (!kv || !kv->header || !key) {
+        return KV_INVALID_OBJECT;
+    }
+
+    tag = nj_ipc_kv_hash(key, kv->header->key_size);
+    mask = kv->header->capacity - 1;
+
+    for (probe = 0; probe <= mask; probe++) {
+        index = (tag + probe) & mask;
+        bucket = nj_ipc_kv_bucket(kv, index);
+
+        for (;;) {
+            sequence = nj_ipc_atomic_load64(&bucket->sequence);
+            if (sequence & 1) {
+                /* Give up on a bucket whose writer died, it would stay odd forever */
+                if (!checked) {
+                    checked = nj_ipc_clock_ns();
+                } else if (nj_ipc_lock_check_due(&checked)) {
+                    nj_ipc_kv_bucket_recover(kv, bucket, sequence);
+                }
+                nj_ipc_thread_yield();
+                continue;
+            }
+
+            bucket_tag = nj_ipc_atomic_load32(&bucket->tag);
+            matches = bucket_tag == tag && memcmp(nj_ipc_kv_key(bucket), key, kv->header->key_size) == 0;
+
+            if (matches && value) {
+                memcpy(value, nj_ipc_kv_value(kv, bucket), kv->header->value_size);
+            }
+
+            nj_ipc_atomic_fence();
+            if (nj_ipc_atomic_load64(&bucket->sequence) == sequence) {
+                break;
+            }
+        }
+
+        if (matches) {
+            return SUCCESS;
+        }
+
+        if (bucket_tag == NJ_IPC_KV_EMPTY) {
+            return KV_NOT_FOUND;
+        }
+    }
+    return KV_NOT_FOUND;
+}
+
+/**
+ * Stores a new key into a bucket, if the bucket is still free once locked.
+ *
+ * @param kv Pointer to the nj_ipc_kv object.
+ * @param bucket The candidate bucket.
+ * @param tag The key's hash tag.
+ * @param key The key.
+ * @param value The value.
+ * @return Non-zero when the key was stored.
+ */
+int
+nj_ipc_kv_claim(nj_ipc_kv *kv, nj_ipc_kv_bucket *bucket, uint32_t tag, const void *key, const void *value) {
+    if (nj_ipc_atomic_load32(&bucket->tag) > NJ_IPC_KV_DELETED) {
+        return 0;
+    }
+
+    nj_ipc_kv_bucket_lock(kv, bucket);
+
+    if (bucket->tag > NJ_IPC_KV_DELETED) {
+        nj_ipc_kv_bucket_unlock(bucket);
+        return 0;
+    }
+
+    memcpy(nj_ipc_kv_key(bucket), key, kv->header->key_size);
+    memcpy(nj_ipc_kv_value(kv, bucket), value, kv->header->value_size);
+    nj_ipc_atomic_add32(&kv->header->count, 1);
+    nj_ipc_atomic_store32(&bucket->tag, tag);
+    nj_ipc_kv_bucket_unlock(bucket);
+    return 1;
+}
+
+/**
+ * Inserts a key or replaces its value.
+ *
+ * @param kv Pointer to the nj_ipc_kv object.
+ * @param key The key, key_size bytes long.
+ * @param value The value, value_size bytes long.
+ * @return SUCCESS, or KV_FULL when no bucket is left.
+ */
+nj_ipc_error
+nj_ipc_kv_put(nj_ipc_kv *kv, const void *key, const void *value) {
+    uint32_t tag, mask, index, probe, bucket_tag;
+    nj_ipc_kv_bucket *bucket, *target = NULL;
+    volatile uint32_t *stripe;
+    nj_ipc_error err = KV_FULL;
+
+    if (!kv || !kv->header || !key || !value) {
+        return KV_INVALID_OBJECT;
+    }
+
+    tag = nj_ipc_kv_hash(key, kv->header->key_size);
+    mask = kv->header->capacity - 1;
+
+    /* Writers of the same key share a home bucket and so a stripe, which rules out duplicates */
+    stripe = &kv->header->stripes[(tag & mask) % NJ_IPC_KV_STRIPES];
+    nj_ipc_spin_lock_owned(stripe);
+
+    for (probe = 0; probe <= mask; probe++) {
+        index = (tag + probe) & mask;
+        bucket = nj_ipc_kv_bucket(kv, index);
+        bucket_tag = nj_ipc_atomic_load32(&bucket->tag);
+
+        if (bucket_tag == tag && memcmp(nj_ipc_kv_key(bucket), key, kv->header->key_size) == 0) {
+            nj_ipc_kv_bucket_lock(kv, bucket);
+
+            /* Unless recovering a dead writer dropped the key meanwhile */
+            if (bucket->tag == tag) {
+                memcpy(nj_ipc_kv_value(kv, bucket), value, kv->header->value_size);
+                nj_ipc_kv_bucket_unlock(bucket);
+                err = SUCCESS;
+                break;
+            }
+            nj_ipc_kv_bucket_unlock(bucket);
+            bucket_tag = NJ_IPC_KV_DELETED;
+        }
+
+        if (bucket_tag == NJ_IPC_KV_DELETED && !target) {
+            target = bucket;
+        }
+
+        if (bucket_tag == NJ_IPC_KV_EMPTY) {
+            break;
+        }
+    }
+
+    /* Claim the first free bucket, writers of other stripes may race for it */
+    if (err != SUCCESS && target && nj_ipc_kv_claim(kv, target, tag, key, value)) {
+        err = SUCCESS;
+    }
+
+    for (; err != SUCCESS && probe <= mask; probe++) {
+        if (nj_ipc_kv_claim(kv, nj_ipc_kv_bucket(kv, (tag + probe) & mask), tag, key, value)) {
+            err = SUCCESS;
+        }
+    }
+
+    nj_ipc_atomic_store32(stripe, 0);
+    return err;
+}
+
+/**
+ * Removes a key.
+ *
+ * @param kv Pointer to the nj_ipc_kv object.
+ * @param key The key, key_size bytes long.
+ * @return SUCCESS, or KV_NOT_FOUND.
+ */
+nj_ipc_error
+nj_ipc_kv_remove(nj_ipc_kv *kv, const void *key) {
+    uint32_t tag, mask, index, probe, bucket_tag;
+    nj_ipc_kv_bucket *bucket;
+    volatile uint32_t *stripe;
+    nj_ipc_error err = KV_NOT_FOUND;
+
+    if (!kv || !kv->header || !key) {
+        return KV_INVALID_OBJECT;
+    }
+
+    tag = nj_ipc_kv_hash(key, kv->header->key_size);
+    mask = kv->header->capacity - 1;
+    stripe = &kv->header->stripes[(tag & mask) % NJ_IPC_KV_STRIPES];
+    nj_ipc_spin_lock_owned(stripe);
+
+    for (probe = 0; probe <= mask; probe++) {
+        index = (tag + probe) & mask;
+        bucket = nj_ipc_kv_bucket(kv, index);
+        bucket_tag = nj_ipc_atomic_load32(&bucket->tag);
+
+        if (bucket_tag == NJ_IPC_KV_EMPTY) {
+            break;
+        }
+
+        if (bucket_tag == tag && memcmp(nj_ipc_kv_key(bucket), key, kv->header->key_size) == 0) {
+            nj_ipc_kv_bucket_lock(kv, bucket);
+
+            /* A dead writer's key is dropped when its bucket is recovered */
+            if (bucket->tag == tag) {
+                nj_ipc_atomic_store32(&bucket->tag, NJ_IPC_KV_DELETED);
+                nj_ipc_atomic_add32(&kv->header->count, (uint32_t)-1);
+                err = SUCCESS;
+            }
+            nj_ipc_kv_bucket_unlock(bucket);
+            break;
+        }
+    }
+
+    nj_ipc_atomic_store32(stripe, 0);
+    return err;
+}
+
+/**
+ * Number of keys in the store.
+ *
+ * @param kv Pointer to the nj_ipc_kv object.
+ * @return The key count.
+ */
+unsigned int
+nj_ipc_kv_count(nj_ipc_kv *kv) {
+    return kv && kv->header ? nj_ipc_atomic_load32(&kv->header->count) : 0;
+}
+
+/**
+ * Frees a key-value store.
+ *
+ * @param kv Pointer to the nj_ipc_kv object to be freed.
+ * @return Nothing.
+ */
+void
+nj_ipc_kv_free(nj_ipc_kv *kv) {
+    if (!kv || !kv->header) {
+        return;
+    }
+    nj_ipc_shmem_free(&kv->shmem);
+    kv->header = NULL;
+}
+
+/* Queue API */
+#define NJ_IPC_QUEUE_MAGIC 0x716a6e6e /* "nnjq" */
+
+/* Ring of slots with per-slot sequence numbers, each position counter on its own cache line */
+typedef struct nj_ipc_queue_ring {
+    uint32_t magic;
+    uint32_t item_size;
+    uint32_t capacity;
+    uint32_t slot_size;
+    uint8_t padding[NJ_IPC_CACHE_LINE - 16];
+    volatile uint64_t enqueue_pos;
+    uint8_t enqueue_padding[NJ_IPC_CACHE_LINE - 8];
+    volatile uint64_t dequeue_pos;
+    uint8_t dequeue_padding[NJ_IPC_CACHE_LINE - 8];
+    volatile uint32_t consumer_sleepers;
+    volatile uint32_t producer_sleepers;
+    uint8_t sleepers_padding[NJ_IPC_CACHE_LINE - 8];
+} nj_ipc_queue_ring;
+
+typedef struct nj_ipc_queue_slot {
+    volatile uint64_t sequence;
+} nj_ipc_queue_slot;
+
+typedef struct nj_ipc_queue {
+    nj_ipc_shmem shmem;
+    nj_ipc_sync items_event;
+    nj_ipc_sync space_event;
+    nj_ipc_queue_ring *ring;
+    nj_ipc_error status;
+} nj_ipc_queue;
+
+#define nj_ipc_queue_slot_size(item_size) nj_ipc_align_up(sizeof(nj_ipc_queue_slot) + (item_size), NJ_IPC_CACHE_LINE)
+#define nj_ipc_queue_ring_size(item_size, capacity) \
+    (sizeof(nj_ipc_queue_ring) + (size_t)(capacity) * nj_ipc_queue_slot_size(item_size))
+#define nj_ipc_queue_slot(ring, position) \
+    ((nj_ipc_queue_slot*)((char*)(ring) + sizeof(nj_ipc_queue_ring) + (size_t)((position) & ((ring)->capacity - 1)) * (ring)->slot_size))
+#define nj_ipc_queue_item(slot) ((char*)(slot) + sizeof(nj_ipc_queue_slot))
+
+/**
+ * Lays a ring out in memory that is shared but not yet used.
+ *
+ * @param ring Start of the memory, nj_ipc_queue_ring_size bytes long.
+ * @param item_size The size of every item in bytes.
+ * @param capacity Number of slots, a power of two.
+ * @return Nothing.
+ */
+void
+nj_ipc_queue_ring_init(nj_ipc_queue_ring *ring, unsigned int item_size, unsigned int capacity) {
+    uint32_t i;
+
+    ring->item_size = item_size;
+    ring->capacity = capacity;
+    ring->slot_size = (uint32_t)nj_ipc_queue_slot_size(item_size);
+    ring->enqueue_pos = 0;
+    ring->dequeue_pos = 0;
+    ring->consumer_sleepers = 0;
+    ring->producer_sleepers = 0;
+
+    for (i = 0; i < capacity; i++) {
+        nj_ipc_queue_slot(ring, i)->sequence = i;
+    }
+    nj_ipc_atomic_store32(&ring->magic, NJ_IPC_QUEUE_MAGIC);
+}
+
+/**
+ * Claims the next free slot of a ring for writing.
+ *
+ * Hand the slot to consumers with nj_ipc_queue_ring_publish once the item is in place.
+ *
+ * @param ring The ring.
+ * @param position Receives the position of the slot.
+ * @return The slot, or NULL when the ring is full.
+ */
+nj_ipc_queue_slot*
+nj_ipc_queue_ring_claim(nj_ipc_queue_ring *ring, uint64_t *position) {
+    uint64_t current = nj_ipc_atomic_load64(&ring->enqueue_pos);
+    nj_ipc_queue_slot *slot;
+    int64_t difference;
+
+    for (;;) {
+        slot = nj_ipc_queue_slot(ring, current);
+        difference = (int64_t)(nj_ipc_atomic_load64(&slot->sequence) - current);
+
+        if (difference == 0) {
+            if (nj_ipc_atomic_cas64(&ring->enqueue_pos, current, current + 1)) {
+                *position = current;
+                return slot;
+            }
+            current = nj_ipc_atomic_load64(&ring->enqueue_pos);
+        } else if (difference < 0) {
+            return NULL;
+        } else {
+            current = nj_ipc_atomic_load64(&ring->enqueue_pos);
+        }
+    }
+}
+
+#define nj_ipc_queue_ring_publish(slot, position) nj_ipc_atomic_store64(&(slot)->sequence, (position) + 1)
+
+/**
+ * Claims up to max_items consecutive filled slots of a ring with one update.
+ *
+ * Each slot goes back to producers with nj_ipc_queue_ring_release once its item is copied out.
+ *
+ * @param ring The ring.
+ * @param max_items Maximum number of slots to take.
+ * @param position Receives the position of the first slot.
+ * @return The number of slots taken, 0 when the ring is empty.
+ */
+size_t
+nj_ipc_queue_ring_claim_filled(nj_ipc_queue_ring *ring, size_t max_items, uint64_t *position) {
+    uint64_t current = nj_ipc_atomic_load64(&ring->dequeue_pos);
+    int64_t difference;
+    size_t count;
+
+    for (;;) {
+        difference = (int64_t)(nj_ipc_atomic_load64(&nj_ipc_queue_slot(ring, current)->sequence) - (current + 1));
+
+        if (difference < 0) {
+            return 0;
+        }
+
+        if (difference == 0) {
+            for (count = 1; count < max_items; count++) {
+                if (nj_ipc_atomic_load64(&nj_ipc_queue_slot(ring, current + count)->sequence) != current + count + 1) {
+                    break;
+                }
+            }
+            if (nj_ipc_atomic_cas64(&ring->dequeue_pos, current, current + count)) {
+                *position = current;
+                return count;
+            }
+        }
+        current = nj_ipc_atomic_load64(&ring->dequeue_pos);
+    }
+}
+
+#define nj_ipc_queue_ring_release(ring, position) \
+    nj_ipc_atomic_store64(&nj_ipc_queue_slot(ring, position)->sequence, (position) + (ring)->capacity)
+
+/**
+ * Claims the next free slot of a ring and copies an item into it.
+ *
+ * @param ring The ring.
+ * @param item The item, item_size bytes long.
+ * @return SUCCESS, or QUEUE_FULL.
+ */
+nj_ipc_error
+nj_ipc_queue_ring_push(nj_ipc_queue_ring *ring, const void *item) {
+    uint64_t position;
+    nj_ipc_queue_slot *slot = nj_ipc_queue_ring_claim(ring, &position);
+
+    if (!slot) {
+        return QUEUE_FULL;
+    }
+
+    memcpy(nj_ipc_queue_item(slot), item, ring->item_size);
+    nj_ipc_queue_ring_publish(slot, position);
+    return SUCCESS;
+}
+
+/**
+ * Claims up to max_items consecutive filled slots of a ring with one update and copies them out.
+ *
+ * @param ring The ring.
+ * @param items Receives the items, back-to-back.
+ * @param max_items Maximum number of items to take.
+ * @param popped Receives the number of items taken.
+ * @return SUCCESS, or QUEUE_EMPTY.
+ */
+nj_ipc_error
+nj_ipc_queue_ring_pop(nj_ipc_queue_ring *ring, void *items, size_t max_items, size_t *popped) {
+    uint64_t position;
+    size_t i;
+
+    if (!(*popped = nj_ipc_queue_ring_claim_filled(ring, max_items, &position))) {
+        return QUEUE_EMPTY;
+    }
+
+    for (i = 0; i < *popped; i++) {
+        memcpy((char*)items + i * ring->item_size, nj_ipc_queue_item(nj_ipc_queue_slot(ring, position + i)), ring->item_size);
+        nj_ipc_queue_ring_release(ring, position + i);
+    }
+    return SUCCESS;
+}
+
+/**
+ * Create a new work queue.
+ *
+ * @param name The name of the queue.
+ * @param item_size The size of every item in bytes.
+ * @param capacity Number of items the queue holds, rounded up to a power of two.
+ * @return A new nj_ipc_queue object.
+ */
+nj_ipc_queue
+nj_ipc_queue_create(const char *name, unsigned int item_size, unsigned int capacity) {
+    char items_event_name[256], space_event_name[256];
+    nj_ipc_queue queue;
+    uint32_t slots = nj_ipc_pow2_ceil(capacity);
+    queue.status = ERR;
+    queue.ring = NULL;
+
+    if (nj_ipc_str_invalid(name)) {
+        queue.status = INVALID_NAME;
+        return queue;
+    }
+
+    if (!item_size || !slots || nj_ipc_queue_ring_size(item_size, slots) > 0xffffffffu) {
+        queue.status = SHMEM_INVALID_SIZE;
+        return queue;
+    }
+
+    sprintf(items_event_name, "%s_items_njipc", name);
+    sprintf(space_event_name, "%s_space_njipc", name);
+
+    queue.items_event = nj_ipc_sync_create(items_event_name);
+
+    if (queue.items_event.status != SUCCESS) {
+        queue.status = queue.items_event.status;
+        return queue;
+    }
+
+    queue.space_event = nj_ipc_sync_create(space_event_name);
+
+    if (queue.space_event.status != SUCCESS) {
+        nj_ipc_sync_free(&(queue.items_event));
+        queue.status = queue.space_event.status;
+        return queue;
+    }
+
+    queue.shmem = nj_ipc_shmem_create(name, (unsigned int)nj_ipc_queue_ring_size(item_size, slots));
+
+    if (queue.shmem.status != SUCCESS) {
+        nj_ipc_sync_free(&(queue.items_event));
+        nj_ipc_sync_free(&(queue.space_event));
+        queue.status = queue.shmem.status;
+        return queue;
+    }
+
+    queue.ring = (nj_ipc_queue_ring*)queue.shmem.view;
+    nj_ipc_queue_ring_init(queue.ring, item_size, slots);
+    queue.status = SUCCESS;
+    return queue;
+}
+
+/**
+ * Opens an existing work queue.
+ *
+ * @param name The name of the queue.
+ * @param item_size The size of every item in bytes, as given on creation.
+ * @param capacity Number of items, as given on creation.
+ * @return The open nj_ipc_queue object.
+ */
+nj_ipc_queue
+nj_ipc_queue_open(const char *name, unsigned int item_size, unsigned int capacity) {
+    char items_event_name[256], space_event_name[256];
+    nj_ipc_queue queue;
+    uint32_t slots = nj_ipc_pow2_ceil(capacity);
+    queue.status = ERR;
+    queue.ring = NULL;
+
+    if (nj_ipc_str_invalid(name)) {
+        queue.status = INVALID_NAME;
+        return queue;
+    }
+
+    if (!item_size || !slots || nj_ipc_queue_ring_size(item_size, slots) > 0xffffffffu) {
+        queue.status = SHMEM_INVALID_SIZE;
+        return queue;
+    }
+
+    sprintf(items_event_name, "%s_items_njipc", name);
+    sprintf(space_event_name, "%s_space_njipc", name);
+
+    /* The names belong to the creator, a failed open only closes what it opened */
+    queue.items_event = nj_ipc_sync_open(items_event_name);
+
+    if (queue.items_event.status != SUCCESS) {
+        queue.status = queue.items_event.status;
+        return queue;
+    }
+
+    queue.space_event = nj_ipc_sync_open(space_event_name);
+
+    if (queue.space_event.status != SUCCESS) {
+        nj_ipc_sync_close(&(queue.items_event));
+        queue.status = queue.space_event.status;
+        return queue;
+    }
+
+    queue.shmem = nj_ipc_shmem_open(name, (unsigned int)nj_ipc_queue_ring_size(item_size, slots));
+
+    if (queue.shmem.status != SUCCESS) {
+        nj_ipc_sync_close(&(queue.items_event));
+        nj_ipc_sync_close(&(queue.space_event));
+        queue.status = queue.shmem.status;
+        return queue;
+    }
+
+    queue.ring = (nj_ipc_queue_ring*)queue.shmem.view;
+
+    if (nj_ipc_atomic_load32(&queue.ring->magic) != NJ_IPC_QUEUE_MAGIC
+        || queue.ring->item_size != item_size || queue.ring->capacity != slots) {
+        nj_ipc_sync_close(&(queue.items_event));
+        nj_ipc_sync_close(&(queue.space_event));
+        nj_ipc_shmem_close(&(queue.shmem));
+        queue.ring = NULL;
+        queue.status = QUEUE_INVALID_LAYOUT;
+        return queue;
+    }
+
+    queue.status = SUCCESS;
+    return queue;
+}
+
+/**
+ * Pushes an item without blocking.
+ *
+ * @param queue Pointer to the nj_ipc_queue object.
+ * @param item The item, item_size bytes long.
+ * @return SUCCESS, or QUEUE_FULL.
+ */
+nj_ipc_error
+nj_ipc_queue_try_push(nj_ipc_queue *queue, const void *item) {
+    nj_ipc_error err;
+
+    if (!queue || !queue->ring || !item) {
+        return QUEUE_INVALID_OBJECT;
+    }
+
+    if ((err = nj_ipc_queue_ring_push(queue->ring, item)) == SUCCESS) {
+        nj_ipc_sleepers_wake(&queue->ring->consumer_sleepers, &(queue->items_event));
+    }
+    return err;
+}
+
+/**
+ * Pushes an item, sleeping while the queue is full.
+ *
+ * @param queue Pointer to the nj_ipc_queue object.
+ * @param item The item, item_size bytes long.
+ * @return The push status.
+ */
+nj_ipc_error
+nj_ipc_queue_push(nj_ipc_queue *queue, const void *item) {
+    nj_ipc_error err;
+
+    for (;;) {
+        if ((err = nj_ipc_queue_try_push(queue, item)) != QUEUE_FULL) {
+            return err;
+        }
+
+        nj_ipc_atomic_add32(&queue->ring->producer_sleepers, 1);
+
+        if ((err = nj_ipc_queue_try_push(queue, item)) != QUEUE_FULL) {
+            nj_ipc_sleepers_cancel(&queue->ring->producer_sleepers, &(queue->space_event));
+            return err;
+        }
+
+        if ((err = nj_ipc_sync_wait(&(queue->space_event))) != SUCCESS) {
+            return err;
+        }
+    }
+}
+
+/**
+ * Pops up to max_items items without blocking.
+ *
+ * @param queue Pointer to the nj_ipc_queue object.
+ * @param items Receives the items, back-to-back.
+ * @param max_items Maximum number of items to take.
+ * @param popped Receives the number of items taken.
+ * @return SUCCESS, or QUEUE_EMPTY.
+ */
+nj_ipc_error
+nj_ipc_queue_try_pop_batch(nj_ipc_queue *queue, void *items, size_t max_items, size_t *popped) {
+    nj_ipc_error err;
+    size_t i;
+
+    if (!queue || !queue->ring || !items || !max_items || !popped) {
+        return QUEUE_INVALID_OBJECT;
+    }
+
+    if ((err = nj_ipc_queue_ring_pop(queue->ring, items, max_items, popped)) == SUCCESS) {
+        for (i = 0; i < *popped; i++) {
+            nj_ipc_sleepers_wake(&queue->ring->producer_sleepers, &(queue->space_event));
+        }
+    }
+    return err;
+}
+
+/**
+ * Pops up to max_items items, sleeping until at least one is available.
+ *
+ * Sleeping consumers are only woken when an item is pushed.
+ *
+ * @param queue Pointer to the nj_ipc_queue object.
+ * @param items Receives the items, back-to-back.
+ * @param max_items Maximum number of items to take.
+ * @param popped Receives the number of items taken.
+ * @return The pop status.
+ */
+nj_ipc_error
+nj_ipc_queue_pop_batch(nj_ipc_queue *queue, void *items, size_t max_items, size_t *popped) {
+    nj_ipc_error err;
+
+    for (;;) {
+        if ((err = nj_ipc_queue_try_pop_batch(queue, items, max_items, popped)) != QUEUE_EMPTY) {
+            return err;
+        }
+
+        nj_ipc_atomic_add32(&queue->ring->consumer_sleepers, 1);
+
+        if ((err = nj_ipc_queue_try_pop_batch(queue, items, max_items, popped)) != QUEUE_EMPTY) {
+            nj_ipc_sleepers_cancel(&queue->ring->consumer_sleepers, &(queue->items_event));
+            return err;
+        }
+
+        if ((err = nj_ipc_sync_wait(&(queue->items_event))) != SUCCESS) {
+            return err;
+        }
+    }
+}
+
+/**
+ * Pops one item without blocking.
+ *
+ * @param queue Pointer to the nj_ipc_queue object.
+ * @param item Receives the item, item_size bytes long.
+ * @return SUCCESS, or QUEUE_EMPTY.
+ */
+nj_ipc_error
+nj_ipc_queue_try_pop(nj_ipc_queue *queue, void *item) {
+    size_t popped;
+    return nj_ipc_queue_try_pop_batch(queue, item, 1, &popped);
+}
+
+/**
+ * Pops one item, sleeping until one is available.
+ *
+ * @param queue Pointer to the nj_ipc_queue object.
+ * @param item Receives the item, item_size bytes long.
+ * @return The pop status.
+ */
+nj_ipc_error
+nj_ipc_queue_pop(nj_ipc_queue *queue, void *item) {
+    size_t popped;
+    return nj_ipc_queue_pop_batch(queue, item, 1, &popped);
+}
+
+/**
+ * Frees a work queue.
+ *
+ * @param queue Pointer to the nj_ipc_queue object to be freed.
+ * @return Nothing.
+ */
+void
+nj_ipc_queue_free(nj_ipc_queue *queue) {
+    if (!queue || !queue->ring) {
+        return;
+    }
+    nj_ipc_sync_free(&(queue->items_event));
+    nj_ipc_sync_free(&(queue->space_event));
+    nj_ipc_shmem_free(&(queue->shmem));
+    queue->ring = NULL;
+}
+
+/* Prefork API */
+#define NJ_IPC_PREFORK_MAX_ATTEMPTS 3 /* Workers a request may take down before it is failed back to its client */
+
+/* Services one claimed lane: read the request and reply, see nj_ipc_lane_read and nj_ipc_lane_reply */
+typedef nj_ipc_error (*nj_ipc_prefork_handler)(nj_ipc_channel *ch, unsigned int lane, void *ctx);
+
+#ifdef NJ_IPC_POSIX
+/**
+ * Hands the requests a dead worker was servicing back to the other workers.
+ *
+ * A request that has taken down NJ_IPC_PREFORK_MAX_ATTEMPTS workers is failed
+ * back to its client instead, so it can't crash every replacement in turn.
+ *
+ * @param ch Pointer to the lane channel.
+ * @param worker Process id of the dead worker, already reaped.
+ * @return Nothing.
+ */
+void
+nj_ipc_prefork_recover(nj_ipc_channel *ch, pid_t worker) {
+    nj_ipc_lane_state *state;
+    unsigned int i;
+
+    for (i = 0; i < ch->lane_count; i++) {
+        state = nj_ipc_lane_state(ch, i);
+
+        /* Only the dead worker could have moved the lane on, so nothing races the master here */
+        if (nj_ipc_atomic_load64(&state->status) != nj_ipc_lane_word(NJ_IPC_LANE_SERVICING, (uint32_t)worker)) {
+            continue;
+        }
+
+        if (++state->attempts >= NJ_IPC_PREFORK_MAX_ATTEMPTS) {
+            nj_ipc_lane_fail(ch, i);
+        } else {
+            nj_ipc_atomic_store64(&state->status, nj_ipc_lane_word(NJ_IPC_LANE_REQUEST, 0));
+            nj_ipc_sync_notify(&(ch->client_event));
+        }
+    }
+}
+
+/**
+ * Fails every request still waiting or in service once the workers are gone, so no client waits forever.
+ *
+ * @param ch Pointer to the lane channel.
+ * @return Nothing.
+ */
+void
+nj_ipc_prefork_fail_pending(nj_ipc_channel *ch) {
+    uint32_t status;
+    unsigned int i;
+
+    for (i = 0; i < ch->lane_count; i++) {
+        status = nj_ipc_lane_status(ch, i);
+
+        if (status == NJ_IPC_LANE_REQUEST || status == NJ_IPC_LANE_SERVICING) {
+            nj_ipc_lane_fail(ch, i);
+        }
+    }
+}
+
+/**
+ * Forks one worker that claims and services requests until it dies.
+ *
+ * @param ch Pointer to the lane channel.
+ * @param handler Called for every claimed lane.
+ * @param ctx Passed to the handler.
+ * @return Process id of the worker, or -1.
+ */
+pid_t
+nj_ipc_prefork_spawn(nj_ipc_channel *ch, nj_ipc_prefork_handler handler, void *ctx) {
+    unsigned int lane;
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        signal(SIGTERM, SIG_DFL);
+        for (;;) {
+            if (nj_ipc_lane_next(ch, &lane) != SUCCESS) {
+                _exit(1); /* Never free, the channel belongs to the master */
+            }
+
+            if (handler(ch, lane, ctx) != SUCCESS) {
+                nj_ipc_lane_fail(ch, lane);
+            }
+        }
+    }
+    return pid;
+}
+#endif
+
+/**
+ * Serves a lane channel from several forked worker processes.
+ *
+ * The calling process becomes the master: it forks the workers, replaces any
+ * worker that dies and hands the request it was servicing to another worker.
+ * Returns once *stop becomes non-zero, after terminating the workers and failing the requests they left behind.
+ * Requests that crash their worker are handed out again, up to
+ * NJ_IPC_PREFORK_MAX_ATTEMPTS times; requests the handler returns an error for
+ * are failed back to the client at once.
+ *
+ * @param ch Pointer to a lane channel created by this process.
+ * @param workers Number of worker processes.
+ * @param handler Called in a worker for every claimed lane.
+ * @param ctx Passed to the handler.
+ * @param stop Polled by the master, typically set from a signal handler; NULL runs forever.
+ * @return SUCCESS, or PREFORK_UNSUPPORTED on Windows.
+ */
+nj_ipc_error
+nj_ipc_prefork_run(nj_ipc_channel *ch, unsigned int workers, nj_ipc_prefork_handler handler, void *ctx,
+                   volatile sig_atomic_t *stop) {
+#ifdef NJ_IPC_WIN
+    (void)ch; (void)workers; (void)handler; (void)ctx; (void)stop;
+    return PREFORK_UNSUPPORTED;
+#endif
+#ifdef NJ_IPC_POSIX
+    nj_ipc_error err = SUCCESS;
+    pid_t *pids;
+    unsigned int i;
+
+    if (!ch || !ch->lane_count || ch->role != NJ_IPC_CHANNEL_SERVER || !handler || !workers) {
+        return LANE_INVALID_CHANNEL;
+    }
+
+    if (!(pids = (pid_t*)calloc(workers, sizeof(pid_t)))) {
+        return ERR;
+    }
+
+    for (i = 0; i < workers && err == SUCCESS; i++) {
+        if ((pids[i] = nj_ipc_prefork_spawn(ch, handler, ctx)) < 0) {
+            err = PREFORK_SPAWN_FAIL;
+        }
+    }
+
+    while (err == SUCCESS && !(stop && *stop)) {
+        for (i = 0; i < workers; i++) {
+            if (waitpid(pids[i], NULL, WNOHANG) != pids[i]) {
+                continue;
+            }
+            nj_ipc_prefork_recover(ch, pids[i]);
+
+            if ((pids[i] = nj_ipc_prefork_spawn(ch, handler, ctx)) < 0) {
+                err = PREFORK_SPAWN_FAIL;
+                break;
+            }
+        }
+        nj_ipc_clock_sleep(10000000ull);
+    }
+
+    for (i = 0; i < workers; i++) {
+        if (pids[i] > 0) {
+            kill(pids[i], SIGTERM);
+            waitpid(pids[i], NULL, 0);
+        }
+    }
+    nj_ipc_prefork_fail_pending(ch);
+
+    free(pids);
+    return err;
+#endif
+}
+
+/* Arena API */
+#define NJ_IPC_ARENA_MAGIC 0x616a6e6e /* "nnja" */
+#define NJ_IPC_ARENA_NAME_MAX 56
+
+typedef enum {
+    NJ_IPC_ARENA_ENTRY_EMPTY,
+    NJ_IPC_ARENA_ENTRY_USED,
+    NJ_IPC_ARENA_ENTRY_REMOVED,
+} nj_ipc_arena_entry_state;
+
+typedef struct nj_ipc_arena_header {
+    uint32_t magic;
+    uint32_t channel_size;
+    uint32_t capacity;
+    volatile uint32_t lock;  /* Process id of the holder while the directory changes */
+    volatile uint32_t count;
+    uint8_t padding[NJ_IPC_CACHE_LINE - 20];
+} nj_ipc_arena_header;
+
+/* Directory entries are packed together, so lookups don't touch the channels */
+typedef struct nj_ipc_arena_entry {
+    char name[NJ_IPC_ARENA_NAME_MAX];
+    volatile uint32_t state; /* nj_ipc_arena_entry_state */
+    uint32_t hash;
+} nj_ipc_arena_entry;
+
+/* Wake words of one channel, followed by its slot */
+typedef struct nj_ipc_arena_control {
+    nj_ipc_futex_sem client; /* Posted by the client, the server waits on it */
+    nj_ipc_futex_sem server; /* Posted by the server, the client waits on it */
+    uint8_t padding[NJ_IPC_CACHE_LINE - 2 * sizeof(nj_ipc_futex_sem)];
+} nj_ipc_arena_control;
+
+typedef struct nj_ipc_arena {
+    nj_ipc_shmem shmem;
+    nj_ipc_arena_header *header;
+    nj_ipc_error status;
+} nj_ipc_arena;
+
+/* A channel inside an arena, plain pointers into the segment with nothing to free */
+typedef struct nj_ipc_arena_channel {
+    nj_ipc_arena_control *control;
+    void *view;
+    size_t view_size;
+    nj_ipc_error status;
+} nj_ipc_arena_channel;
+
+#define nj_ipc_arena_block_size(channel_size) \
+    (sizeof(nj_ipc_arena_control) + nj_ipc_align_up(channel_size, NJ_IPC_CACHE_LINE))
+#define nj_ipc_arena_segment_size(channel_size, capacity) \
+    (sizeof(nj_ipc_arena_header) + (size_t)(capacity) * (sizeof(nj_ipc_arena_entry) + nj_ipc_arena_block_size(channel_size)))
+#define nj_ipc_arena_entry(header, index) \
+    ((nj_ipc_arena_entry*)((char*)(header) + sizeof(nj_ipc_arena_header)) + (index))
+#define nj_ipc_arena_control(header, index) \
+    ((nj_ipc_arena_control*)((char*)nj_ipc_arena_entry(header, (header)->capacity) \
+        + (size_t)(index) * nj_ipc_arena_block_size((header)->channel_size)))
+
+/**
+ * Create a new channel arena.
+ *
+ * Channels live in a single segment, pages of channels never used are never touched.
+ * The directory lock records its holder, a process that dies while changing
+ * the directory leaves the lock to the next one that needs it.
+ *
+ * @param name The name of the arena.
+ * @param channel_size The slot size of every channel in bytes.
+ * @param capacity Maximum number of channels.
+ * @return A new nj_ipc_arena object.
+ */
+nj_ipc_arena
+nj_ipc_arena_create(const char *name, unsigned int channel_size, unsigned int capacity) {
+    nj_ipc_arena arena;
+    arena.status = ERR;
+    arena.header = NULL;
+
+    if (!channel_size || !capacity || nj_ipc_arena_segment_size(channel_size, capacity) > 0xffffffffu) {
+        arena.status = SHMEM_INVALID_SIZE;
+        return arena;
+    }
+
+    arena.shmem = nj_ipc_shmem_create(name, (unsigned int)nj_ipc_arena_segment_size(channel_size, capacity));
+
+    if (arena.shmem.status != SUCCESS) {
+        arena.status = arena.shmem.status;
+        return arena;
+    }
+
+    /* A fresh segment is zeroed, so every entry is empty and every wake word 0 */
+    arena.header = (nj_ipc_arena_header*)arena.shmem.view;
+    arena.header->channel_size = channel_size;
+    arena.header->capacity = capacity;
+    nj_ipc_atomic_store32(&arena.header->magic, NJ_IPC_ARENA_MAGIC);
+
+    arena.status = SUCCESS;
+    return arena;
+}
+
+/**
+ * Opens an existing channel arena.
+ *
+ * @param name The name of the arena.
+ * @param channel_size The slot size of every channel, as given on creation.
+ * @param capacity Maximum number of channels, as given on creation.
+ * @return The open nj_ipc_arena object.
+ */
+nj_ipc_arena
+nj_ipc_arena_open(const char *name, unsigned int channel_size, unsigned int capacity) {
+    nj_ipc_arena arena;
+    arena.status = ERR;
+    arena.header = NULL;
+
+    if (!channel_size || !capacity || nj_ipc_arena_segment_size(channel_size, capacity) > 0xffffffffu) {
+        arena.status = SHMEM_INVALID_SIZE;
+        return arena;
+    }
+
+    arena.shmem = nj_ipc_shmem_open(name, (unsigned int)nj_ipc_arena_segment_size(channel_size, capacity));
+
+    if (arena.shmem.status != SUCCESS) {
+        arena.status = arena.shmem.status;
+        return arena;
+    }
+
+    arena.header = (nj_ipc_arena_header*)arena.shmem.view;
+
+    if (nj_ipc_atomic_load32(&arena.header->magic) != NJ_IPC_ARENA_MAGIC
+        || arena.header->channel_size != channel_size || arena.header->capacity != capacity) {
+        nj_ipc_shmem_close(&(arena.shmem)); /* The segment belongs to its creator, don't unlink it */
+        arena.header = NULL;
+        arena.status = ARENA_INVALID_LAYOUT;
+        return arena;
+    }
+
+    arena.status = SUCCESS;
+    return arena;
+}
+
+/**
+ * Finds the directory entry of a channel, the directory lock must be held.
+ *
+ * @param header The arena header.
+ * @param name The channel name.
+ * @param hash nj_ipc_kv_hash of the name.
+ * @param free_index Receives the first reusable entry on the probe path, or capacity.
+ * @return The index of the entry, or capacity when the channel doesn't exist.
+ */
+uint32_t
+nj_ipc_arena_find(nj_ipc_arena_header *header, const char *name, uint32_t hash, uint32_t *free_index) {
+    uint32_t i, index, state;
+
+    *free_index = header->capacity;
+
+    for (i = 0; i < header->capacity; i++) {
+        index = (hash + i) % header->capacity;
+        state = nj_ipc_arena_entry(header, index)->state;
+
+        if (state == NJ_IPC_ARENA_ENTRY_EMPTY) {
+            if (*free_index == header->capacity) *free_index = index;
+            break;
+        }
+
+        if (state == NJ_IPC_ARENA_ENTRY_REMOVED) {
+            if (*free_index == header->capacity) *free_index = index;
+        } else if (nj_ipc_arena_entry(header, index)->hash == hash
+                   && strcmp(nj_ipc_arena_entry(header, index)->name, name) == 0) {
+            return index;
+        }
+    }
+    return header->capacity;
+}
+
+/**
+ * Builds the channel handle for a directory entry.
+ *
+ * @param header The arena header.
+ * @param index The entry index.
+ * @return The nj_ipc_arena_channel object.
+ */
+nj_ipc_arena_channel
+nj_ipc_arena_channel_at(nj_ipc_arena_header *header, uint32_t index) {
+    nj_ipc_arena_channel ch;
+    ch.control = nj_ipc_arena_control(header, index);
+    ch.view = (char*)ch.control + sizeof(nj_ipc_arena_control);
+    ch.view_size = header->channel_size;
+    ch.status = SUCCESS;
+    return ch;
+}
+
+/**
+ * Create a channel inside an arena.
+ *
+ * @param arena Pointer to the nj_ipc_arena object.
+ * @param name The name of the channel, shorter than NJ_IPC_ARENA_NAME_MAX.
+ * @return A new nj_ipc_arena_channel object.
+ */
+nj_ipc_arena_channel
+nj_ipc_arena_channel_create(nj_ipc_arena *arena, const char *name) {
+    nj_ipc_arena_channel ch;
+    nj_ipc_arena_entry *entry;
+    uint32_t hash, index, free_index;
+    ch.status = ERR;
+    ch.control = NULL;
+    ch.view = NULL;
+
+    if (!arena || !arena->header) {
+        ch.status = ARENA_INVALID_OBJECT;
+        return ch;
+    }
+
+    if (nj_ipc_str_invalid(name) || strlen(name) >= NJ_IPC_ARENA_NAME_MAX) {
+        ch.status = INVALID_NAME;
+        return ch;
+    }
+
+    hash = nj_ipc_kv_hash(name, strlen(name));
+    nj_ipc_spin_lock_owned(&arena->header->lock);
+
+    index = nj_ipc_arena_find(arena->header, name, hash, &free_index);
+
+    if (index != arena->header->capacity) {
+        ch.status = ARENA_CHANNEL_EXISTS;
+    } else if (free_index == arena->header->capacity) {
+        ch.status = ARENA_FULL;
+    } else {
+        ch = nj_ipc_arena_channel_at(arena->header, free_index);
+        memset(ch.control, 0, sizeof(nj_ipc_arena_control));
+
+        entry = nj_ipc_arena_entry(arena->header, free_index);
+        strcpy(entry->name, name);
+        entry->hash = hash;
+        nj_ipc_atomic_store32(&entry->state, NJ_IPC_ARENA_ENTRY_USED);
+        nj_ipc_atomic_add32(&arena->header->count, 1);
+    }
+
+    nj_ipc_atomic_store32(&arena->header->lock, 0);
+    return ch;
+}
+
+/**
+ * Opens a channel inside an arena.
+ *
+ * @param arena Pointer to the nj_ipc_arena object.
+ * @param name The name of the channel.
+ * @return The open nj_ipc_arena_channel object.
+ */
+nj_ipc_arena_channel
+nj_ipc_arena_channel_open(nj_ipc_arena *arena, const char *name) {
+    nj_ipc_arena_channel ch;
+    uint32_t hash, index, free_index;
+    ch.status = ERR;
+    ch.control = NULL;
+    ch.view = NULL;
+
+    if (!arena || !arena->header) {
+        ch.status = ARENA_INVALID_OBJECT;
+        return ch;
+    }
+
+    if (nj_ipc_str_invalid(name) || strlen(name) >= NJ_IPC_ARENA_NAME_MAX) {
+        ch.status = INVALID_NAME;
+        return ch;
+    }
+
+    hash = nj_ipc_kv_hash(name, strlen(name));
+    nj_ipc_spin_lock_owned(&arena->header->lock);
+
+    index = nj_ipc_arena_find(arena->header, name, hash, &free_index);
+
+    if (index == arena->header->capacity) {
+        ch.status = ARENA_CHANNEL_NOT_FOUND;
+    } else {
+        ch = nj_ipc_arena_channel_at(arena->header, index);
+    }
+
+    nj_ipc_atomic_store32(&arena->header->lock, 0);
+    return ch;
+}
+
+/**
+ * Removes a channel from an arena, handles to it must no longer be used.
+ *
+ * @param arena Pointer to the nj_ipc_arena object.
+ * @param name The name of the channel.
+ * @return SUCCESS, or ARENA_CHANNEL_NOT_FOUND.
+ */
+nj_ipc_error
+nj_ipc_arena_channel_remove(nj_ipc_arena *arena, const char *name) {
+    uint32_t hash, index, free_index;
+    nj_ipc_error err = SUCCESS;
+
+    if (!arena || !arena->header) {
+        return ARENA_INVALID_OBJECT;
+    }
+
+    if (nj_ipc_str_invalid(name)) {
+        return INVALID_NAME;
+    }
+
+    hash = nj_ipc_kv_hash(name, strlen(name));
+    nj_ipc_spin_lock_owned(&arena->header->lock);
+
+    index = nj_ipc_arena_find(arena->header, name, hash, &free_index);
+
+    if (index == arena->header->capacity) {
+        err = ARENA_CHANNEL_NOT_FOUND;
+    } else {
+        nj_ipc_atomic_store32(&nj_ipc_arena_entry(arena->header, index)->state, NJ_IPC_ARENA_ENTRY_REMOVED);
+        nj_ipc_atomic_add32(&arena->header->count, (uint32_t)-1);
+    }
+
+    nj_ipc_atomic_store32(&arena->header->lock, 0);
+    return err;
+}
+
+/**
+ * Write data into the slot of an arena channel.
+ *
+ * @param ch Pointer to the nj_ipc_arena_channel object.
+ * @param data Pointer to the data to be written.
+ * @param data_size The size of the data.
+ * @return The write status.
+ */
+nj_ipc_error
+nj_ipc_arena_channel_write(nj_ipc_arena_channel *ch, const void *data, size_t data_size) {
+    if (!ch || !ch->view) {
+        return CHANNEL_WRITE_INVALID_SHMEM;
+    }
+
+    if (data_size > ch->view_size) {
+        return CHANNEL_WRITE_TOO_BIG;
+    }
+
+    memcpy(ch->view, data, data_size);
+    return SUCCESS;
+}
+
+/**
+ * Read data from the slot of an arena channel.
+ *
+ * @param ch Pointer to the nj_ipc_arena_channel object.
+ * @param buffer Pointer to the buffer where data will be read into.
+ * @param read_size The size of the data being read.
+ * @return The read status.
+ */
+nj_ipc_error
+nj_ipc_arena_channel_read(nj_ipc_arena_channel *ch, void *buffer, size_t read_size) {
+    if (!ch || !ch->view) {
+        return CHANNEL_READ_INVALID_SHMEM;
+    }
+
+    if (read_size > ch->view_size) {
+        return CHANNEL_READ_TOO_BIG;
+    }
+
+    memcpy(buffer, ch->view, read_size);
+    return SUCCESS;
+}
+
+/**
+ * Notify the client wake word of an arena channel, the server wakes up.
+ *
+ * @param ch Pointer to the nj_ipc_arena_channel object.
+ * @return The notify status.
+ */
+nj_ipc_error
+nj_ipc_arena_channel_notify_client(nj_ipc_arena_channel *ch) {
+    if (!ch || !ch->control) {
+        return CHANNEL_NOTIFY_INVALID_EVENT;
+    }
+
+    nj_ipc_futex_sem_post(&ch->control->client);
+    return SUCCESS;
+}
+
+/**
+ * Notify the server wake word of an arena channel, the client wakes up.
+ *
+ * @param ch Pointer to the nj_ipc_arena_channel object.
  * @return The notify status.
  */
 nj_ipc_error
-nj_ipc_channel_notify_client(nj_ipc_channel *ch) {
-    if (!ch || !ch->client_event.handle) {
-        return CHANNEL_NOTIFY_INVALID_EVENT;
+nj_ipc_arena_channel_notify_server(nj_ipc_arena_channel *ch) {
+    if (!ch || !ch->control) {
+        return CHANNEL_NOTIFY_INVALID_EVENT;
+    }
+
+    nj_ipc_futex_sem_post(&ch->control->server);
+    return SUCCESS;
+}
+
+/**
+ * Wait for a client notification on an arena channel.
+ *
+ * @param ch Pointer to the nj_ipc_arena_channel object.
+ * @return The wait status.
+ */
+nj_ipc_error
+nj_ipc_arena_channel_wait_client(nj_ipc_arena_channel *ch) {
+    if (!ch || !ch->control) {
+        return CHANNEL_WAIT_INVALID_EVENT;
+    }
+
+    nj_ipc_futex_sem_wait(&ch->control->client);
+    return SUCCESS;
+}
+
+/**
+ * Wait for a server notification on an arena channel.
+ *
+ * @param ch Pointer to the nj_ipc_arena_channel object.
+ * @return The wait status.
+ */
+nj_ipc_error
+nj_ipc_arena_channel_wait_server(nj_ipc_arena_channel *ch) {
+    if (!ch || !ch->control) {
+        return CHANNEL_WAIT_INVALID_EVENT;
+    }
+
+    nj_ipc_futex_sem_wait(&ch->control->server);
+    return SUCCESS;
+}
+
+/**
+ * Frees a channel arena, channels inside it are gone with it.
+ *
+ * @param arena Pointer to the nj_ipc_arena object to be freed.
+ * @return Nothing.
+ */
+void
+nj_ipc_arena_free(nj_ipc_arena *arena) {
+    if (!arena || !arena->header) {
+        return;
+    }
+    nj_ipc_shmem_free(&(arena->shmem));
+    arena->header = NULL;
+}
+
+/* Publish API */
+#define NJ_IPC_PUBLISH_MAGIC 0x706a6e6e /* "nnjp" */
+#define NJ_IPC_PUBLISH_SLOTS 8
+#define NJ_IPC_PUBLISH_READERS 64
+
+typedef enum {
+    NJ_IPC_PUBLISH_FREE,
+    NJ_IPC_PUBLISH_WRITING,
+    NJ_IPC_PUBLISH_LIVE,
+    NJ_IPC_PUBLISH_RETIRED, /* Replaced, unlinked once the last reader releases it */
+} nj_ipc_publish_state;
+
+typedef struct nj_ipc_publish_slot {
+    volatile uint64_t version;
+    volatile uint64_t size;
+    volatile uint32_t state; /* nj_ipc_publish_state */
+    uint8_t padding[NJ_IPC_CACHE_LINE - 20];
+} nj_ipc_publish_slot;
+
+typedef struct nj_ipc_publish_header {
+    uint32_t magic;
+    uint32_t slot_count;
+    volatile uint64_t current;      /* version << 8 | slot of the live version, 0 before the first commit */
+    volatile uint64_t next_version;
+    nj_ipc_mutex lock;              /* Held by the publisher while claiming and swapping slots */
+    uint8_t padding[NJ_IPC_CACHE_LINE - 32];
+    nj_ipc_publish_slot slots[NJ_IPC_PUBLISH_SLOTS];
+    volatile uint64_t readers[NJ_IPC_PUBLISH_READERS]; /* pid << 32 | slot + 1 per held snapshot, 0 when unused */
+} nj_ipc_publish_header;
+
+typedef struct nj_ipc_publication {
+    nj_ipc_shmem control;
+    nj_ipc_publish_header *header;
+    nj_ipc_shmem versions[NJ_IPC_PUBLISH_SLOTS]; /* Publisher side mappings still open */
+    int publisher;
+    nj_ipc_error status;
+} nj_ipc_publication;
+
+/* One version of the dataset: writable while being published, read-only once acquired */
+typedef struct nj_ipc_publish_snapshot {
+    nj_ipc_shmem shmem;
+    void *data;
+    size_t size;
+    uint64_t version;
+    unsigned int slot;
+    unsigned int reader; /* Entry in the header's reader table */
+} nj_ipc_publish_snapshot;
+
+#define nj_ipc_publish_segment_name(buffer, pub, version) \
+    sprintf(buffer, "%s_v%llu", (pub)->control.name, (unsigned long long)(version))
+#define nj_ipc_publish_reader_word(pid, slot) ((uint64_t)(pid) << 32 | ((slot) + 1))
+
+/**
+ * Create a new publication, the calling process becomes its publisher.
+ *
+ * @param name The name of the publication.
+ * @return A new nj_ipc_publication object.
+ */
+nj_ipc_publication
+nj_ipc_publish_create(const char *name) {
+    nj_ipc_publication pub;
+    memset(&pub, 0, sizeof(pub));
+    pub.status = ERR;
+
+    pub.control = nj_ipc_shmem_create(name, sizeof(nj_ipc_publish_header));
+
+    if (pub.control.status != SUCCESS) {
+        pub.status = pub.control.status;
+        return pub;
+    }
+
+    pub.header = (nj_ipc_publish_header*)pub.control.view;
+    pub.header->slot_count = NJ_IPC_PUBLISH_SLOTS;
+    nj_ipc_atomic_store32(&pub.header->magic, NJ_IPC_PUBLISH_MAGIC);
+    pub.publisher = 1;
+    pub.status = SUCCESS;
+    return pub;
+}
+
+/**
+ * Opens an existing publication for reading.
+ *
+ * @param name The name of the publication.
+ * @return The open nj_ipc_publication object.
+ */
+nj_ipc_publication
+nj_ipc_publish_open(const char *name) {
+    nj_ipc_publication pub;
+    memset(&pub, 0, sizeof(pub));
+    pub.status = ERR;
+
+    pub.control = nj_ipc_shmem_open(name, sizeof(nj_ipc_publish_header));
+
+    if (pub.control.status != SUCCESS) {
+        pub.status = pub.control.status;
+        return pub;
+    }
+
+    pub.header = (nj_ipc_publish_header*)pub.control.view;
+
+    if (nj_ipc_atomic_load32(&pub.header->magic) != NJ_IPC_PUBLISH_MAGIC
+        || pub.header->slot_count != NJ_IPC_PUBLISH_SLOTS) {
+        nj_ipc_shmem_close(&(pub.control));
+        pub.header = NULL;
+        pub.status = PUBLISH_INVALID_LAYOUT;
+        return pub;
+    }
+
+    pub.status = SUCCESS;
+    return pub;
+}
+
+/**
+ * Checks whether any reader still holds a slot, dropping entries left by readers that died.
+ *
+ * Dead readers are found as described for nj_ipc_process_alive, a recycled pid keeps its entry until that process exits too.
+ *
+ * @param pub Pointer to the nj_ipc_publication object.
+ * @param slot The slot index.
+ * @return Non-zero while a live reader holds the slot.
+ */
+int
+nj_ipc_publish_referenced(nj_ipc_publication *pub, unsigned int slot) {
+    unsigned int i;
+    uint64_t word;
+    int referenced = 0;
+
+    for (i = 0; i < NJ_IPC_PUBLISH_READERS; i++) {
+        word = nj_ipc_atomic_load64(&pub->header->readers[i]);
+
+        if (!word || (word & 0xffffffff) != slot + 1) {
+            continue;
+        }
+        if (nj_ipc_process_alive((uint32_t)(word >> 32))) {
+            referenced = 1;
+        } else {
+            nj_ipc_atomic_cas64(&pub->header->readers[i], word, 0);
+        }
+    }
+    return referenced;
+}
+
+/**
+ * Unlinks a retired version once no reader references it.
+ *
+ * Any process may call this; the state change from RETIRED to FREE picks the one that unlinks.
+ *
+ * @param pub Pointer to the nj_ipc_publication object.
+ * @param slot The slot index.
+ * @return Nothing.
+ */
+void
+nj_ipc_publish_reclaim(nj_ipc_publication *pub, unsigned int slot) {
+    nj_ipc_publish_slot *entry = &pub->header->slots[slot];
+    uint64_t version = nj_ipc_atomic_load64(&entry->version);
+    char segment_name[256];
+
+    if (nj_ipc_atomic_load32(&entry->state) != NJ_IPC_PUBLISH_RETIRED || nj_ipc_publish_referenced(pub, slot)) {
+        return;
+    }
+
+    if (nj_ipc_atomic_cas32(&entry->state, NJ_IPC_PUBLISH_RETIRED, NJ_IPC_PUBLISH_FREE)) {
+        nj_ipc_publish_segment_name(segment_name, pub, version);
+#ifdef NJ_IPC_POSIX
+        shm_unlink(segment_name);
+#endif
+        /* Windows drops the segment with its last handle */
+        if (pub->versions[slot].handle) {
+            nj_ipc_shmem_close(&(pub->versions[slot]));
+        }
+    }
+}
+
+/**
+ * Starts publishing a new version in a fresh segment.
+ *
+ * Fill snapshot->data, then make it visible with nj_ipc_publish_commit or drop it with nj_ipc_publish_abort.
+ *
+ * @param pub Pointer to the publisher's nj_ipc_publication object.
+ * @param size Size of the version in bytes.
+ * @param snapshot Receives the writable version.
+ * @return SUCCESS, PUBLISH_BUSY while every slot is still referenced, or the segment creation status.
+ */
+nj_ipc_error
+nj_ipc_publish_begin(nj_ipc_publication *pub, unsigned int size, nj_ipc_publish_snapshot *snapshot) {
+    char segment_name[256];
+    nj_ipc_publish_slot *entry;
+    unsigned int i, slot = NJ_IPC_PUBLISH_SLOTS;
+    uint64_t version = 0;
+
+    if (!pub || !pub->header || !pub->publisher || !snapshot) {
+        return PUBLISH_INVALID_OBJECT;
+    }
+
+    nj_ipc_mutex_lock(&pub->header->lock);
+
+    for (i = 0; i < NJ_IPC_PUBLISH_SLOTS; i++) {
+        nj_ipc_publish_reclaim(pub, i);
+
+        if (nj_ipc_atomic_load32(&pub->header->slots[i].state) != NJ_IPC_PUBLISH_FREE) {
+            continue;
+        }
+        /* A reader reclaimed the slot, the publisher still holds its Windows handle */
+        if (pub->versions[i].handle) {
+            nj_ipc_shmem_close(&(pub->versions[i]));
+        }
+        if (slot == NJ_IPC_PUBLISH_SLOTS) {
+            slot = i;
+        }
+    }
+
+    if (slot != NJ_IPC_PUBLISH_SLOTS) {
+        entry = &pub->header->slots[slot];
+        version = nj_ipc_atomic_add64(&pub->header->next_version, 1) + 1;
+        nj_ipc_atomic_store64(&entry->version, version);
+        nj_ipc_atomic_store64(&entry->size, size);
+        nj_ipc_atomic_store32(&entry->state, NJ_IPC_PUBLISH_WRITING);
+    }
+
+    nj_ipc_mutex_unlock(&pub->header->lock);
+
+    if (slot == NJ_IPC_PUBLISH_SLOTS) {
+        return PUBLISH_BUSY;
+    }
+
+    nj_ipc_publish_segment_name(segment_name, pub, version);
+    snapshot->shmem = nj_ipc_shmem_create(segment_name, size);
+
+    if (snapshot->shmem.status != SUCCESS) {
+        nj_ipc_atomic_store32(&pub->header->slots[slot].state, NJ_IPC_PUBLISH_FREE);
+        return snapshot->shmem.status;
+    }
+
+    snapshot->data = snapshot->shmem.view;
+    snapshot->size = size;
+    snapshot->version = version;
+    snapshot->slot = slot;
+    return SUCCESS;
+}
+
+/**
+ * Makes a version started with nj_ipc_publish_begin the live one.
+ *
+ * The previous version is retired, readers holding it keep it until they release it.
+ *
+ * @param pub Pointer to the publisher's nj_ipc_publication object.
+ * @param snapshot The version to make live, no longer writable afterwards.
+ * @return The commit status.
+ */
+nj_ipc_error
+nj_ipc_publish_commit(nj_ipc_publication *pub, nj_ipc_publish_snapshot *snapshot) {
+    uint64_t previous;
+
+    if (!pub || !pub->header || !pub->publisher || !snapshot || !snapshot->data) {
+        return PUBLISH_INVALID_OBJECT;
+    }
+
+    nj_ipc_mutex_lock(&pub->header->lock);
+
+    nj_ipc_atomic_store32(&pub->header->slots[snapshot->slot].state, NJ_IPC_PUBLISH_LIVE);
+    previous = nj_ipc_atomic_load64(&pub->header->current);
+    nj_ipc_atomic_store64(&pub->header->current, snapshot->version << 8 | snapshot->slot);
+
+    if (previous) {
+        nj_ipc_atomic_store32(&pub->header->slots[previous & 0xff].state, NJ_IPC_PUBLISH_RETIRED);
+    }
+
+    nj_ipc_mutex_unlock(&pub->header->lock);
+
+    /* Windows needs a handle open until readers have the segment, POSIX keeps it by name */
+#ifdef NJ_IPC_WIN
+    UnmapViewOfFile(snapshot->shmem.view);
+    snapshot->shmem.view = NULL;
+    if (pub->versions[snapshot->slot].handle) {
+        nj_ipc_shmem_close(&(pub->versions[snapshot->slot]));
+    }
+    pub->versions[snapshot->slot] = snapshot->shmem;
+#endif
+#ifdef NJ_IPC_POSIX
+    nj_ipc_shmem_close(&(snapshot->shmem));
+#endif
+    snapshot->data = NULL;
+
+    if (previous) {
+        nj_ipc_publish_reclaim(pub, (unsigned int)(previous & 0xff));
+    }
+    return SUCCESS;
+}
+
+/**
+ * Drops a version started with nj_ipc_publish_begin without making it visible, freeing its slot.
+ *
+ * @param pub Pointer to the publisher's nj_ipc_publication object.
+ * @param snapshot The uncommitted version.
+ * @return The abort status.
+ */
+nj_ipc_error
+nj_ipc_publish_abort(nj_ipc_publication *pub, nj_ipc_publish_snapshot *snapshot) {
+    char segment_name[256];
+
+    if (!pub || !pub->header || !pub->publisher || !snapshot || !snapshot->data) {
+        return PUBLISH_INVALID_OBJECT;
+    }
+
+    /* Readers only map the live version, nobody else holds this one */
+    nj_ipc_publish_segment_name(segment_name, pub, snapshot->version);
+    nj_ipc_shmem_close(&(snapshot->shmem));
+#ifdef NJ_IPC_POSIX
+    shm_unlink(segment_name);
+#endif
+    snapshot->data = NULL;
+
+    nj_ipc_atomic_store32(&pub->header->slots[snapshot->slot].state, NJ_IPC_PUBLISH_FREE);
+    return SUCCESS;
+}
+
+/**
+ * Maps the live version read-only and holds it until nj_ipc_publish_release.
+ *
+ * Each held snapshot takes an entry in the reader table under the caller's pid, so
+ * the version a crashed reader held is reclaimed once the process is gone.
+ *
+ * @param pub Pointer to the nj_ipc_publication object.
+ * @param snapshot Receives the version.
+ * @return SUCCESS, PUBLISH_NONE before the first commit, PUBLISH_BUSY while NJ_IPC_PUBLISH_READERS snapshots are held, or the mapping status.
+ */
+nj_ipc_error
+nj_ipc_publish_acquire(nj_ipc_publication *pub, nj_ipc_publish_snapshot *snapshot) {
+    nj_ipc_shmem_options options;
+    char segment_name[256];
+    volatile uint64_t *reader;
+    uint32_t pid = nj_ipc_process_id();
+    uint64_t current;
+    unsigned int i;
+
+    if (!pub || !pub->header || !snapshot) {
+        return PUBLISH_INVALID_OBJECT;
+    }
+
+    if (!nj_ipc_atomic_load64(&pub->header->current)) {
+        return PUBLISH_NONE;
+    }
+
+    for (i = 0; i < NJ_IPC_PUBLISH_READERS; i++) {
+        if (!nj_ipc_atomic_load64(&pub->header->readers[i])
+            && nj_ipc_atomic_cas64(&pub->header->readers[i], 0, nj_ipc_publish_reader_word(pid, NJ_IPC_PUBLISH_SLOTS))) {
+            break;
+        }
+    }
+    if (i == NJ_IPC_PUBLISH_READERS) {
+        return PUBLISH_BUSY;
+    }
+    reader = &pub->header->readers[i];
+
+    for (;;) {
+        current = nj_ipc_atomic_load64(&pub->header->current);
+
+        /* Pin the slot, then make sure it is still the live one */
+        nj_ipc_atomic_store64(reader, nj_ipc_publish_reader_word(pid, current & 0xff));
+
+        if (nj_ipc_atomic_load64(&pub->header->current) == current) {
+            break;
+        }
+
+        nj_ipc_atomic_store64(reader, nj_ipc_publish_reader_word(pid, NJ_IPC_PUBLISH_SLOTS));
+        nj_ipc_publish_reclaim(pub, (unsigned int)(current & 0xff));
+    }
+
+    snapshot->version = current >> 8;
+    snapshot->slot = (unsigned int)(current & 0xff);
+    snapshot->reader = i;
+    snapshot->size = (size_t)nj_ipc_atomic_load64(&pub->header->slots[snapshot->slot].size);
+
+    memset(&options, 0, sizeof(options));
+    options.read_only = 1;
+    nj_ipc_publish_segment_name(segment_name, pub, snapshot->version);
+    snapshot->shmem = nj_ipc_shmem_open_ex(segment_name, (unsigned int)snapshot->size, &options);
+
+    if (snapshot->shmem.status != SUCCESS) {
+        nj_ipc_atomic_store64(reader, 0);
+        nj_ipc_publish_reclaim(pub, snapshot->slot);
+        snapshot->data = NULL;
+        return snapshot->shmem.status;
+    }
+
+    snapshot->data = snapshot->shmem.view;
+    return SUCCESS;
+}
+
+/**
+ * Checks whether a newer version than the snapshot is live, a single load.
+ *
+ * @param pub Pointer to the nj_ipc_publication object.
+ * @param snapshot A snapshot from nj_ipc_publish_acquire.
+ * @return Non-zero when the reader should release and acquire again.
+ */
+int
+nj_ipc_publish_changed(nj_ipc_publication *pub, const nj_ipc_publish_snapshot *snapshot) {
+    return (nj_ipc_atomic_load64(&pub->header->current) >> 8) != snapshot->version;
+}
+
+/**
+ * Unmaps a version acquired with nj_ipc_publish_acquire, unlinking it if it was the last reference to a retired version.
+ *
+ * @param pub Pointer to the nj_ipc_publication object.
+ * @param snapshot The snapshot to release.
+ * @return Nothing.
+ */
+void
+nj_ipc_publish_release(nj_ipc_publication *pub, nj_ipc_publish_snapshot *snapshot) {
+    if (!pub || !pub->header || !snapshot || !snapshot->data) {
+        return;
+    }
+
+    nj_ipc_shmem_close(&(snapshot->shmem));
+    snapshot->data = NULL;
+
+    nj_ipc_atomic_store64(&pub->header->readers[snapshot->reader], 0);
+    nj_ipc_publish_reclaim(pub, snapshot->slot);
+}
+
+/**
+ * Frees a publication. The publisher removes every version, readers still mapping one keep their copy.
+ *
+ * @param pub Pointer to the nj_ipc_publication object to be freed.
+ * @return Nothing.
+ */
+void
+nj_ipc_publish_free(nj_ipc_publication *pub) {
+    char segment_name[256];
+    unsigned int i;
+
+    if (!pub || !pub->header) {
+        return;
+    }
+
+    if (!pub->publisher) {
+        nj_ipc_shmem_close(&(pub->control));
+        pub->header = NULL;
+        return;
+    }
+
+    for (i = 0; i < NJ_IPC_PUBLISH_SLOTS; i++) {
+        if (pub->header->slots[i].state != NJ_IPC_PUBLISH_FREE) {
+            nj_ipc_publish_segment_name(segment_name, pub, pub->header->slots[i].version);
+#ifdef NJ_IPC_POSIX
+            shm_unlink(segment_name);
+#endif
+        }
+        if (pub->versions[i].handle) {
+            nj_ipc_shmem_close(&(pub->versions[i]));
+        }
+    }
+
+    nj_ipc_shmem_free(&(pub->control));
+    pub->header = NULL;
+}
+
+/* Handle Cache API
+ *
+ * Process-wide list of opened channels and segments keyed by name. Acquiring a
+ * name the process already opened bumps a reference count instead of opening
+ * the kernel objects again. Released entries stay open until nj_ipc_cache_flush.
+ */
+typedef enum {
+    NJ_IPC_CACHE_CHANNEL,
+    NJ_IPC_CACHE_SHMEM,
+} nj_ipc_cache_kind;
+
+typedef struct nj_ipc_cache_node {
+    nj_ipc_cache_kind kind;
+    char *name;
+    unsigned int size;
+    unsigned int refs;
+    union {
+        nj_ipc_channel channel;
+        nj_ipc_shmem shmem;
+    } object;
+    struct nj_ipc_cache_node* next;
+} nj_ipc_cache_node;
+
+nj_ipc_cache_node* cache_lst_head = NULL;
+volatile uint32_t cache_lst_lock = 0;
+
+/**
+ * Finds or opens a cache entry, the cache lock must be held.
+ *
+ * @param kind What the entry holds.
+ * @param name The name of the channel or segment.
+ * @param size Its size in bytes.
+ * @param status Receives the status.
+ * @return The entry with its reference taken, or NULL.
+ */
+nj_ipc_cache_node*
+nj_ipc_cache_get(nj_ipc_cache_kind kind, const char *name, unsigned int size, nj_ipc_error *status) {
+    nj_ipc_cache_node* current;
+    nj_ipc_error err;
+
+    if (nj_ipc_str_invalid(name)) {
+        *status = INVALID_NAME;
+        return NULL;
+    }
+
+    for (current = cache_lst_head; current != NULL; current = current->next) {
+        if (current->kind == kind && strcmp(current->name, name) == 0) {
+            if (current->size != size) {
+                *status = CACHE_SIZE_MISMATCH;
+                return NULL;
+            }
+            current->refs++;
+            *status = SUCCESS;
+            return current;
+        }
+    }
+
+    current = (nj_ipc_cache_node*) malloc(sizeof(*current));
+    if (!current) {
+        *status = ERR;
+        return NULL;
+    }
+
+    if (kind == NJ_IPC_CACHE_CHANNEL) {
+        current->object.channel = nj_ipc_channel_open(name, size);
+        err = current->object.channel.status;
+    } else {
+        current->object.shmem = nj_ipc_shmem_open(name, size);
+        err = current->object.shmem.status;
+    }
+
+    if (err != SUCCESS) {
+        free(current);
+        *status = err;
+        return NULL;
+    }
+
+    current->name = nj_ipc_str_copy(name);
+    if (!current->name) {
+        if (kind == NJ_IPC_CACHE_CHANNEL) {
+            nj_ipc_channel_close(&current->object.channel);
+        } else {
+            nj_ipc_shmem_close(&current->object.shmem);
+        }
+        free(current);
+        *status = ERR;
+        return NULL;
+    }
+
+    current->kind = kind;
+    current->size = size;
+    current->refs = 1;
+    current->next = cache_lst_head;
+    cache_lst_head = current;
+
+    *status = SUCCESS;
+    return current;
+}
+
+/**
+ * Drops a reference to the entry holding an object, the cache lock must be held.
+ *
+ * @param object The channel or segment inside the entry.
+ * @return Nothing.
+ */
+void
+nj_ipc_cache_put(const void *object) {
+    nj_ipc_cache_node* current;
+
+    for (current = cache_lst_head; current != NULL; current = current->next) {
+        if ((const void*)&current->object == object) {
+            if (current->refs) current->refs--;
+            return;
+        }
+    }
+}
+
+/**
+ * Opens a channel as a client, reusing the one this process already opened under the name.
+ *
+ * The channel is shared with every other user in the process, which must not overlap their round trips on it;
+ * release it with nj_ipc_channel_release.
+ *
+ * @param name The name of the channel.
+ * @param size The size of the channel in bytes.
+ * @param status Receives the status, may be NULL.
+ * @return The cached channel, or NULL.
+ */
+nj_ipc_channel*
+nj_ipc_channel_acquire(const char *name, unsigned int size, nj_ipc_error *status) {
+    nj_ipc_cache_node* node;
+    nj_ipc_error err;
+
+    nj_ipc_spin_lock(&cache_lst_lock);
+    node = nj_ipc_cache_get(NJ_IPC_CACHE_CHANNEL, name, size, &err);
+    nj_ipc_atomic_store32(&cache_lst_lock, 0);
+
+    if (status) *status = err;
+    return node ? &node->object.channel : NULL;
+}
+
+/**
+ * Releases a channel returned by nj_ipc_channel_acquire, it stays open for the next acquire.
+ *
+ * @param ch The cached channel.
+ * @return Nothing.
+ */
+void
+nj_ipc_channel_release(nj_ipc_channel *ch) {
+    nj_ipc_spin_lock(&cache_lst_lock);
+    nj_ipc_cache_put(ch);
+    nj_ipc_atomic_store32(&cache_lst_lock, 0);
+}
+
+/**
+ * Opens a shared memory segment, reusing the mapping this process already has under the name.
+ *
+ * @param name The name of the segment.
+ * @param size The size of the segment in bytes.
+ * @param status Receives the status, may be NULL.
+ * @return The cached segment, or NULL.
+ */
+nj_ipc_shmem*
+nj_ipc_shmem_acquire(const char *name, unsigned int size, nj_ipc_error *status) {
+    nj_ipc_cache_node* node;
+    nj_ipc_error err;
+
+    nj_ipc_spin_lock(&cache_lst_lock);
+    node = nj_ipc_cache_get(NJ_IPC_CACHE_SHMEM, name, size, &err);
+    nj_ipc_atomic_store32(&cache_lst_lock, 0);
+
+    if (status) *status = err;
+    return node ? &node->object.shmem : NULL;
+}
+
+/**
+ * Releases a segment returned by nj_ipc_shmem_acquire, it stays mapped for the next acquire.
+ *
+ * @param shmem The cached segment.
+ * @return Nothing.
+ */
+void
+nj_ipc_shmem_release(nj_ipc_shmem *shmem) {
+    nj_ipc_spin_lock(&cache_lst_lock);
+    nj_ipc_cache_put(shmem);
+    nj_ipc_atomic_store32(&cache_lst_lock, 0);
+}
+
+/**
+ * Closes every cached channel and segment no longer referenced, leaving their names in place.
+ *
+ * @return Number of entries still referenced.
+ */
+unsigned int
+nj_ipc_cache_flush() {
+    nj_ipc_cache_node** link;
+    nj_ipc_cache_node* current;
+    unsigned int remaining = 0;
+
+    nj_ipc_spin_lock(&cache_lst_lock);
+
+    link = &cache_lst_head;
+    while ((current = *link) != NULL) {
+        if (current->refs) {
+            remaining++;
+            link = &current->next;
+            continue;
+        }
+
+        if (current->kind == NJ_IPC_CACHE_CHANNEL) {
+            nj_ipc_channel_close(&current->object.channel);
+        } else {
+            nj_ipc_shmem_close(&current->object.shmem);
+        }
+        *link = current->next;
+        free(current->name);
+        free(current);
+    }
+
+    nj_ipc_atomic_store32(&cache_lst_lock, 0);
+    return remaining;
+}
+
+/* Anonymous Channel API
+ *
+ * The segment is a memfd and the events are eventfds in semaphore mode, so
+ * nothing has a name: the peer gets the descriptors over a UNIX socket or by
+ * fork, and everything disappears with the last descriptor.
+ */
+#ifdef NJ_IPC_LINUX
+#ifndef MFD_CLOEXEC
+    #define MFD_CLOEXEC 0x0001U
+#endif
+#define NJ_IPC_ANON_FDS 3
+
+/**
+ * Create an anonymous synchronization object.
+ *
+ * @return A new nj_ipc_sync object without a name.
+ */
+nj_ipc_sync
+nj_ipc_sync_create_anon() {
+    nj_ipc_sync object;
+    int fd = eventfd(0, EFD_SEMAPHORE | EFD_CLOEXEC);
+
+    object.name = NULL;
+    object.handle = fd_to_handle(fd);
+    object.status = fd == -1 ? SYNC_CREATE_FAIL : SUCCESS;
+    return object;
+}
+
+/**
+ * Maps a memfd as a shared memory object, taking ownership of the descriptor.
+ *
+ * @param fd The memfd.
+ * @param shmem_size Size of the shared memory in bytes.
+ * @return The nj_ipc_shmem object without a name.
+ */
+nj_ipc_shmem
+nj_ipc_shmem_adopt(int fd, unsigned int shmem_size) {
+    nj_ipc_shmem object;
+    void *mapped_mem = mmap(NULL, shmem_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    object.name = NULL;
+    object.handle = fd_to_handle(fd);
+    object.view = NULL;
+    object.view_size = shmem_size;
+    object.mirrored = 0;
+
+    if (mapped_mem == MAP_FAILED) {
+        object.status = SHMEM_MAPPING_FAIL;
+        return object;
+    }
+
+    object.view = mapped_mem;
+    object.status = SUCCESS;
+    return object;
+}
+
+/**
+ * Create an anonymous shared memory object.
+ *
+ * @param shmem_size Size of the shared memory in bytes.
+ * @return A new nj_ipc_shmem object without a name.
+ */
+nj_ipc_shmem
+nj_ipc_shmem_create_anon(unsigned int shmem_size) {
+    nj_ipc_shmem object;
+    int fd;
+    object.status = ERR;
+    object.handle = NULL;
+    object.view = NULL;
+    object.name = NULL;
+
+    if (!shmem_size) {
+        object.status = SHMEM_INVALID_SIZE;
+        return object;
+    }
+
+    if ((fd = (int)syscall(SYS_memfd_create, "njipc", MFD_CLOEXEC)) == -1) {
+        object.status = SHMEM_CREATE_FAIL;
+        return object;
+    }
+
+    if (ftruncate(fd, shmem_size) == -1) {
+        close(fd);
+        object.status = SHMEM_INVALID_SIZE;
+        return object;
+    }
+
+    object = nj_ipc_shmem_adopt(fd, shmem_size);
+
+    if (object.status != SUCCESS) {
+        close(fd);
+        object.handle = NULL;
+    }
+    return object;
+}
+
+/**
+ * Assembles a channel from its three descriptors, taking ownership of them once it succeeds.
+ *
+ * @param fds The segment, server event and client event descriptors, in that order.
+ * @param role The side the calling process plays.
+ * @return The nj_ipc_channel object.
+ */
+nj_ipc_channel
+nj_ipc_channel_adopt(const int fds[NJ_IPC_ANON_FDS], nj_ipc_channel_role role) {
+    nj_ipc_channel ch;
+    struct stat info;
+    memset(&ch, 0, sizeof(ch));
+    ch.role = role;
+    ch.status = ERR;
+
+    if (fstat(fds[0], &info) == -1 || info.st_size <= 0 || info.st_size > 0xffffffffu) {
+        ch.status = SHMEM_INVALID_SIZE;
+        return ch;
+    }
+
+    ch.shmem = nj_ipc_shmem_adopt(fds[0], (unsigned int)info.st_size);
+
+    if (ch.shmem.status != SUCCESS) {
+        ch.status = ch.shmem.status;
+        ch.shmem.handle = NULL;
+        return ch;
+    }
+
+    ch.capacity = ch.shmem.view_size;
+    ch.server_event.handle = fd_to_handle(fds[1]);
+    ch.server_event.status = SUCCESS;
+    ch.client_event.handle = fd_to_handle(fds[2]);
+    ch.client_event.status = SUCCESS;
+    ch.status = SUCCESS;
+    return ch;
+}
+
+/**
+ * Create a new anonymous IPC channel.
+ *
+ * A child forked afterwards can use its copy of the channel as is; other
+ * processes receive it with nj_ipc_channel_recv_fds.
+ *
+ * @param size The size of the channel in bytes.
+ * @return A new nj_ipc_channel object without a name.
+ */
+nj_ipc_channel
+nj_ipc_channel_create_anon(unsigned int size) {
+    nj_ipc_channel ch;
+    memset(&ch, 0, sizeof(ch));
+    ch.role = NJ_IPC_CHANNEL_SERVER;
+    ch.status = ERR;
+
+    ch.server_event = nj_ipc_sync_create_anon();
+    ch.client_event = nj_ipc_sync_create_anon();
+    ch.shmem = nj_ipc_shmem_create_anon(size);
+
+    if (ch.server_event.status != SUCCESS || ch.client_event.status != SUCCESS || ch.shmem.status != SUCCESS) {
+        ch.status = ch.shmem.status != SUCCESS ? ch.shmem.status : SYNC_CREATE_FAIL;
+        if (ch.server_event.status != SUCCESS) ch.server_event.handle = NULL;
+        if (ch.client_event.status != SUCCESS) ch.client_event.handle = NULL;
+        nj_ipc_channel_free(&ch);
+        return ch;
+    }
+
+    ch.capacity = size;
+    ch.status = SUCCESS;
+    return ch;
+}
+
+/**
+ * Hands an anonymous channel to the process on the other end of a UNIX socket.
+ *
+ * @param ch Pointer to an anonymous nj_ipc_channel object.
+ * @param socket A connected UNIX domain socket.
+ * @return The send status.
+ */
+nj_ipc_error
+nj_ipc_channel_send_fds(nj_ipc_channel *ch, int socket) {
+    char control[CMSG_SPACE(sizeof(int) * NJ_IPC_ANON_FDS)];
+    int fds[NJ_IPC_ANON_FDS];
+    char marker = 'n';
+    struct iovec part;
+    struct msghdr message;
+    struct cmsghdr *header;
+
+    if (!ch || !ch->shmem.view || ch->name) {
+        return CHANNEL_WRITE_INVALID_SHMEM;
+    }
+
+    fds[0] = handle_to_fd(ch->shmem.handle);
+    fds[1] = handle_to_fd(ch->server_event.handle);
+    fds[2] = handle_to_fd(ch->client_event.handle);
+
+    memset(&message, 0, sizeof(message));
+    memset(control, 0, sizeof(control));
+    part.iov_base = &marker;
+    part.iov_len = 1;
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+    return sendmsg(socket, &message, 0) == 1 ? SUCCESS : FD_SEND_FAIL;
+}
+
+/**
+ * Receives an anonymous channel sent with nj_ipc_channel_send_fds, as its client.
+ *
+ * @param socket A connected UNIX domain socket.
+ * @return The nj_ipc_channel object.
+ */
+nj_ipc_channel
+nj_ipc_channel_recv_fds(int socket) {
+    char control[CMSG_SPACE(sizeof(int) * NJ_IPC_ANON_FDS)];
+    int fds[NJ_IPC_ANON_FDS], i;
+    char marker;
+    struct iovec part;
+    struct msghdr message;
+    struct cmsghdr *header;
+    nj_ipc_channel ch;
+    ssize_t received;
+
+    memset(&message, 0, sizeof(message));
+    part.iov_base = &marker;
+    part.iov_len = 1;
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    while ((received = recvmsg(socket, &message, MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR);
+    header = received == 1 ? CMSG_FIRSTHDR(&message) : NULL;
+
+    if (!header || (message.msg_flags & MSG_CTRUNC) || header->cmsg_level != SOL_SOCKET
+        || header->cmsg_type != SCM_RIGHTS || header->cmsg_len != CMSG_LEN(sizeof(fds))) {
+        /* Whatever descriptors did arrive are installed in this process, don't leak them */
+        for (; header; header = CMSG_NXTHDR(&message, header)) {
+            if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) {
+                continue;
+            }
+            for (i = 0; (size_t)i < (header->cmsg_len - CMSG_LEN(0)) / sizeof(int); i++) {
+                memcpy(&fds[0], CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+                close(fds[0]);
+            }
+        }
+        memset(&ch, 0, sizeof(ch));
+        ch.status = FD_RECV_FAIL;
+        return ch;
+    }
+
+    memcpy(fds, CMSG_DATA(header), sizeof(fds));
+    ch = nj_ipc_channel_adopt(fds, NJ_IPC_CHANNEL_CLIENT);
+
+    if (ch.status != SUCCESS) {
+        for (i = 0; i < NJ_IPC_ANON_FDS; i++) {
+            close(fds[i]);
+        }
+    }
+    return ch;
+}
+#endif
+
+/* Bulk API
+ *
+ * The sender puts a (pid, address, length) descriptor into the channel and
+ * blocks; the receiver pulls the payload out of the sender's memory with
+ * process_vm_readv and reports back. One copy, whatever the channel size.
+ * The receiver needs ptrace access to the sender: same user, and with Yama's
+ * ptrace_scope at 1 the receiver must be an ancestor of the sender.
+ */
+#ifdef NJ_IPC_LINUX
+#define NJ_IPC_BULK_MAGIC 0x6b6c626e /* "nblk" */
+
+typedef struct nj_ipc_bulk_descriptor {
+    volatile uint32_t magic;
+    volatile uint32_t status; /* nj_ipc_error reported back by the receiver */
+    uint64_t pid;
+    uint64_t address;
+    uint64_t size;
+} nj_ipc_bulk_descriptor;
+
+#define nj_ipc_bulk_own_event(ch) ((ch)->role == NJ_IPC_CHANNEL_CLIENT ? &((ch)->client_event) : &((ch)->server_event))
+#define nj_ipc_bulk_peer_event(ch) ((ch)->role == NJ_IPC_CHANNEL_CLIENT ? &((ch)->server_event) : &((ch)->client_event))
+
+/**
+ * Hands a payload to the peer and blocks until it has copied it.
+ *
+ * @param ch Pointer to a channel that isn't split into lanes.
+ * @param data The payload, left untouched.
+ * @param size Size of the payload in bytes.
+ * @return SUCCESS once the peer has the payload, or the error it reported.
+ */
+nj_ipc_error
+nj_ipc_bulk_send(nj_ipc_channel *ch, const void *data, size_t size) {
+    nj_ipc_bulk_descriptor *descriptor;
+    nj_ipc_error status;
+
+    if (!ch || !ch->shmem.view || ch->lane_count || (size && !data)) {
+        return BULK_INVALID_OBJECT;
+    }
+
+    if (ch->capacity < sizeof(nj_ipc_bulk_descriptor)) {
+        return CHANNEL_WRITE_TOO_BIG;
+    }
+
+    descriptor = (nj_ipc_bulk_descriptor*)ch->shmem.view;
+    descriptor->pid = (uint64_t)getpid();
+    descriptor->address = (uint64_t)(uintptr_t)data;
+    descriptor->size = size;
+    descriptor->status = ERR;
+    nj_ipc_atomic_store32(&descriptor->magic, NJ_IPC_BULK_MAGIC);
+
+    if ((status = nj_ipc_sync_notify(nj_ipc_bulk_own_event(ch))) != SUCCESS
+        || (status = nj_ipc_sync_wait(nj_ipc_bulk_peer_event(ch))) != SUCCESS) {
+        return status;
+    }
+
+    return (nj_ipc_error)nj_ipc_atomic_load32(&descriptor->status);
+}
+
+/**
+ * Waits for the peer to offer a payload.
+ *
+ * Follow up with nj_ipc_bulk_accept, the peer stays blocked until then.
+ *
+ * @param ch Pointer to a channel that isn't split into lanes.
+ * @param size Receives the size of the payload in bytes.
+ * @return The wait status.
+ */
+nj_ipc_error
+nj_ipc_bulk_wait(nj_ipc_channel *ch, size_t *size) {
+    nj_ipc_bulk_descriptor *descriptor;
+    nj_ipc_error status;
+
+    if (!ch || !ch->shmem.view || ch->lane_count || !size || ch->capacity < sizeof(nj_ipc_bulk_descriptor)) {
+        return BULK_INVALID_OBJECT;
+    }
+
+    if ((status = nj_ipc_sync_wait(nj_ipc_bulk_peer_event(ch))) != SUCCESS) {
+        return status;
+    }
+
+    descriptor = (nj_ipc_bulk_descriptor*)ch->shmem.view;
+
+    if (nj_ipc_atomic_load32(&descriptor->magic) != NJ_IPC_BULK_MAGIC) {
+        return BULK_INVALID_OBJECT;
+    }
+
+    *size = (size_t)descriptor->size;
+    return SUCCESS;
+}
+
+/**
+ * Copies the payload offered by the peer out of its memory and releases it.
+ *
+ * @param ch Pointer to the channel nj_ipc_bulk_wait returned SUCCESS on.
+ * @param buffer Receives the payload.
+ * @param buffer_size Size of buffer, a smaller one than the payload rejects it with BULK_TOO_BIG.
+ * @return The copy status, also reported to the peer.
+ */
+nj_ipc_error
+nj_ipc_bulk_accept(nj_ipc_channel *ch, void *buffer, size_t buffer_size) {
+    nj_ipc_bulk_descriptor *descriptor;
+    nj_ipc_error status = SUCCESS;
+    size_t copied = 0;
+
+    if (!ch || !ch->shmem.view || ch->lane_count || ch->capacity < sizeof(nj_ipc_bulk_descriptor)) {
+        return BULK_INVALID_OBJECT;
+    }
+
+    descriptor = (nj_ipc_bulk_descriptor*)ch->shmem.view;
+
+    if (nj_ipc_atomic_load32(&descriptor->magic) != NJ_IPC_BULK_MAGIC) {
+        return BULK_INVALID_OBJECT;
+    }
+
+    if (buffer_size < descriptor->size) {
+        status = BULK_TOO_BIG;
+    }
+
+    /* The kernel may copy less than asked for, e.g. when crossing a fault */
+    while (status == SUCCESS && copied < descriptor->size) {
+        struct iovec local = { (char*)buffer + copied, (size_t)descriptor->size - copied };
+        struct iovec remote = { (void*)(uintptr_t)(descriptor->address + copied), (size_t)descriptor->size - copied };
+        long result = syscall(SYS_process_vm_readv, (pid_t)descriptor->pid, &local, 1UL, &remote, 1UL, 0UL);
+
+        if (result > 0) {
+            copied += (size_t)result;
+        } else if (result == -1 && errno == EINTR) {
+            continue;
+        } else {
+            status = result == -1 && errno == EPERM ? BULK_ACCESS_DENIED : BULK_COPY_FAIL;
+        }
+    }
+
+    nj_ipc_atomic_store32(&descriptor->magic, 0);
+    nj_ipc_atomic_store32(&descriptor->status, status);
+    nj_ipc_sync_notify(nj_ipc_bulk_own_event(ch));
+    return status;
+}
+#endif
+
+/* Duplex API
+ *
+ * Each direction has its own message slot. A message is announced on the
+ * sender's event, the same one nj_ipc_channel_notify_* uses for that side, and
+ * senders waiting for the slot to drain sleep on its state word.
+ */
+#define NJ_IPC_DUPLEX_MAGIC 0x78646a6e /* "njdx" */
+
+typedef enum {
+    NJ_IPC_DUPLEX_EMPTY,
+    NJ_IPC_DUPLEX_WRITING,
+    NJ_IPC_DUPLEX_FULL,
+} nj_ipc_duplex_state;
+
+typedef struct nj_ipc_duplex_header {
+    uint32_t magic;
+    uint32_t region_size;
+} nj_ipc_duplex_header;
+
+typedef struct nj_ipc_duplex_region {
+    volatile uint32_t state;   /* nj_ipc_duplex_state */
+    volatile uint32_t size;    /* Bytes of the message in the slot */
+    volatile uint32_t waiters; /* Senders sleeping until the slot drains */
+    uint8_t padding[NJ_IPC_CACHE_LINE - 12];
+} nj_ipc_duplex_region;
+
+#define nj_ipc_duplex_stride(region_size) (sizeof(nj_ipc_duplex_region) + nj_ipc_align_up(region_size, NJ_IPC_CACHE_LINE))
+#define nj_ipc_duplex_segment_size(region_size) (NJ_IPC_CACHE_LINE + 2 * (size_t)nj_ipc_duplex_stride(region_size))
+#define nj_ipc_duplex_header(ch) ((nj_ipc_duplex_header*)(ch)->shmem.view)
+/* Direction 0 carries client-to-server messages, 1 server-to-client */
+#define nj_ipc_duplex_region(ch, direction) ((nj_ipc_duplex_region*)((char*)(ch)->shmem.view + NJ_IPC_CACHE_LINE \
+    + (direction) * nj_ipc_duplex_stride(nj_ipc_duplex_header(ch)->region_size)))
+#define nj_ipc_duplex_outgoing(ch) ((ch)->role == NJ_IPC_CHANNEL_CLIENT ? 0 : 1)
+#define nj_ipc_duplex_valid_view(ch) \
+    ((ch)->shmem.view && nj_ipc_atomic_load32(&nj_ipc_duplex_header(ch)->magic) == NJ_IPC_DUPLEX_MAGIC)
+#define nj_ipc_duplex_valid(ch) ((ch) && nj_ipc_duplex_valid_view(ch))
+
+/**
+ * Create a new IPC channel with separate regions for both directions.
+ *
+ * @param name The name of the IPC channel.
+ * @param region_size Size of the largest message in either direction, in bytes.
+ * @param options Placement options for the shared memory, may be NULL.
+ * @return A new nj_ipc_channel object.
+ */
+nj_ipc_channel
+nj_ipc_channel_create_duplex(const char *name, unsigned int region_size, const nj_ipc_shmem_options *options) {
+    nj_ipc_channel ch;
+    nj_ipc_duplex_header *header;
+
+    if (!region_size || nj_ipc_duplex_segment_size(region_size) > 0xffffffffu) {
+        ch.status = SHMEM_INVALID_SIZE;
+        return ch;
+    }
+
+    ch = nj_ipc_channel_create_ex(name, (unsigned int)nj_ipc_duplex_segment_size(region_size), options);
+
+    if (ch.status != SUCCESS) {
+        return ch;
+    }
+
+    header = nj_ipc_duplex_header(&ch);
+    header->region_size = region_size;
+    nj_ipc_atomic_store32(&header->magic, NJ_IPC_DUPLEX_MAGIC);
+    return ch;
+}
+
+/**
+ * Open an existing IPC channel with separate regions for both directions.
+ *
+ * @param name The name of the IPC channel.
+ * @param region_size Size of the largest message in either direction, as given on creation.
+ * @param options Placement options for the shared memory, may be NULL.
+ * @return An opened nj_ipc_channel object.
+ */
+nj_ipc_channel
+nj_ipc_channel_open_duplex(const char *name, unsigned int region_size, const nj_ipc_shmem_options *options) {
+    nj_ipc_channel ch;
+
+    if (!region_size || nj_ipc_duplex_segment_size(region_size) > 0xffffffffu) {
+        ch.status = SHMEM_INVALID_SIZE;
+        return ch;
+    }
+
+    ch = nj_ipc_channel_open_ex(name, (unsigned int)nj_ipc_duplex_segment_size(region_size), options);
+
+    if (ch.status != SUCCESS) {
+        return ch;
+    }
+
+    if (!nj_ipc_duplex_valid_view(&ch) || nj_ipc_duplex_header(&ch)->region_size != region_size) {
+        nj_ipc_channel_close(&ch);
+        ch.status = DUPLEX_INVALID_CHANNEL;
+    }
+    return ch;
+}
+
+/**
+ * Sends a message to the other side, waiting while its previous one is still unread.
+ *
+ * @param ch Pointer to a duplex channel.
+ * @param data The message.
+ * @param data_size The size of the message.
+ * @return The send status.
+ */
+nj_ipc_error
+nj_ipc_duplex_send(nj_ipc_channel *ch, const void *data, size_t data_size) {
+    nj_ipc_duplex_region *region;
+    uint32_t state;
+
+    if (!nj_ipc_duplex_valid(ch) || (data_size && !data)) {
+        return DUPLEX_INVALID_CHANNEL;
+    }
+
+    if (data_size > nj_ipc_duplex_header(ch)->region_size) {
+        return CHANNEL_WRITE_TOO_BIG;
+    }
+
+    region = nj_ipc_duplex_region(ch, nj_ipc_duplex_outgoing(ch));
+
+    while ((state = nj_ipc_atomic_load32(&region->state)) != NJ_IPC_DUPLEX_EMPTY
+           || !nj_ipc_atomic_cas32(&region->state, NJ_IPC_DUPLEX_EMPTY, NJ_IPC_DUPLEX_WRITING)) {
+        if (state == NJ_IPC_DUPLEX_EMPTY) {
+            continue;
+        }
+        nj_ipc_atomic_add32(&region->waiters, 1);
+        nj_ipc_futex_wait(&region->state, state, 0);
+        nj_ipc_atomic_add32(&region->waiters, (uint32_t)-1);
+    }
+
+    memcpy(region + 1, data, data_size);
+    region->size = (uint32_t)data_size;
+    nj_ipc_atomic_store32(&region->state, NJ_IPC_DUPLEX_FULL);
+
+    if (ch->tap) {
+        nj_ipc_iovec part = { data, data_size };
+        nj_ipc_tap_append(ch->tap, nj_ipc_channel_tap_direction(ch), &part, 1);
+    }
+    return nj_ipc_sync_notify(ch->role == NJ_IPC_CHANNEL_CLIENT ? &(ch->client_event) : &(ch->server_event));
+}
+
+/**
+ * Waits for a message from the other side and frees its slot.
+ *
+ * @param ch Pointer to a duplex channel.
+ * @param buffer The buffer to read into.
+ * @param buffer_size Size of buffer, a smaller one than the message drops it with CHANNEL_READ_TOO_BIG.
+ * @param received Receives the size of the message, may be NULL.
+ * @return The receive status.
+ */
+nj_ipc_error
+nj_ipc_duplex_recv(nj_ipc_channel *ch, void *buffer, size_t buffer_size, size_t *received) {
+    nj_ipc_duplex_region *region;
+    nj_ipc_error status = SUCCESS;
+
+    if (!nj_ipc_duplex_valid(ch)) {
+        return DUPLEX_INVALID_CHANNEL;
+    }
+
+    if ((status = nj_ipc_sync_wait(ch->role == NJ_IPC_CHANNEL_CLIENT ? &(ch->server_event) : &(ch->client_event))) != SUCCESS) {
+        return status;
+    }
+
+    region = nj_ipc_duplex_region(ch, 1 - nj_ipc_duplex_outgoing(ch));
+
+    if (nj_ipc_atomic_load32(&region->state) != NJ_IPC_DUPLEX_FULL) {
+        return DUPLEX_INVALID_CHANNEL;
+    }
+
+    if (received) {
+        *received = region->size;
+    }
+
+    if (region->size > buffer_size) {
+        status = CHANNEL_READ_TOO_BIG;
+    } else {
+        memcpy(buffer, region + 1, region->size);
+    }
+
+    nj_ipc_atomic_store32(&region->state, NJ_IPC_DUPLEX_EMPTY);
+
+    if (nj_ipc_atomic_load32(&region->waiters)) {
+        nj_ipc_futex_wake(&region->state, 1);
+    }
+    return status;
+}
+
+/* Priority API
+ *
+ * Clients send into one of several classes, each a queue ring with its own
+ * slot size; class 0 is the most urgent. Every message is announced on the
+ * client event, and the server takes from the most urgent class that has
+ * credit left. A class spends one credit per message and credits are refilled
+ * to the class weights once no class with credit has messages, so under load
+ * class i gets weight[i] messages for every round and none starves.
+ */
+#define NJ_IPC_PRIORITY_MAGIC 0x72706a6e /* "njpr" */
+#define NJ_IPC_PRIORITY_MAX_CLASSES 8
+
+typedef struct nj_ipc_priority_config {
+    unsigned int slot_size; /* Largest message of the class in bytes */
+    unsigned int slots;     /* Messages the class holds, rounded up to a power of two */
+    unsigned int weight;    /* Messages taken from the class per round, at least 1 */
+} nj_ipc_priority_config;
+
+typedef struct nj_ipc_priority_class {
+    uint32_t slot_size;
+    uint32_t slots;
+    uint32_t weight;
+    uint32_t offset;           /* Of the class's ring from the start of the segment */
+    volatile uint32_t credit;
+    volatile uint32_t drained; /* Bumped whenever a message leaves, senders waiting for space sleep on it */
+    volatile uint32_t waiters;
+    uint8_t padding[NJ_IPC_CACHE_LINE - 28];
+} nj_ipc_priority_class;
+
+typedef struct nj_ipc_priority_header {
+    uint32_t magic;
+    uint32_t class_count;
+    uint8_t padding[NJ_IPC_CACHE_LINE - 8];
+    nj_ipc_priority_class classes[NJ_IPC_PRIORITY_MAX_CLASSES];
+} nj_ipc_priority_header;
+
+#define nj_ipc_priority_header(ch) ((nj_ipc_priority_header*)(ch)->shmem.view)
+#define nj_ipc_priority_ring(ch, index) \
+    ((nj_ipc_queue_ring*)((char*)(ch)->shmem.view + nj_ipc_priority_header(ch)->classes[index].offset))
+#define nj_ipc_priority_valid_view(ch) \
+    ((ch)->shmem.view && nj_ipc_atomic_load32(&nj_ipc_priority_header(ch)->magic) == NJ_IPC_PRIORITY_MAGIC)
+#define nj_ipc_priority_valid(ch) ((ch) && nj_ipc_priority_valid_view(ch))
+
+/**
+ * Computes the segment size for a set of priority classes.
+ *
+ * @param classes The classes, most urgent first.
+ * @param class_count Number of classes.
+ * @return The segment size in bytes, 0 when the classes are invalid or don't fit.
+ */
+size_t
+nj_ipc_priority_segment_size(const nj_ipc_priority_config *classes, unsigned int class_count) {
+    size_t size = sizeof(nj_ipc_priority_header);
+    unsigned int i;
+
+    if (!classes || !class_count || class_count > NJ_IPC_PRIORITY_MAX_CLASSES) {
+        return 0;
+    }
+
+    for (i = 0; i < class_count; i++) {
+        if (!classes[i].slot_size || classes[i].slot_size > 0x7fffffffu
+            || !nj_ipc_pow2_ceil(classes[i].slots) || !classes[i].weight) {
+            return 0;
+        }
+        size += nj_ipc_queue_ring_size(sizeof(uint32_t) + classes[i].slot_size, nj_ipc_pow2_ceil(classes[i].slots));
+    }
+    return size > 0xffffffffu ? 0 : size;
+}
+
+/**
+ * Create a new IPC channel with priority classes for client-to-server messages.
+ *
+ * @param name The name of the IPC channel.
+ * @param classes The classes, most urgent first.
+ * @param class_count Number of classes, at most NJ_IPC_PRIORITY_MAX_CLASSES.
+ * @param options Placement options for the shared memory, may be NULL.
+ * @return A new nj_ipc_channel object.
+ */
+nj_ipc_channel
+nj_ipc_channel_create_priority(const char *name, const nj_ipc_priority_config *classes, unsigned int class_count,
+                               const nj_ipc_shmem_options *options) {
+    size_t size = nj_ipc_priority_segment_size(classes, class_count), offset = sizeof(nj_ipc_priority_header);
+    nj_ipc_priority_header *header;
+    nj_ipc_channel ch;
+    unsigned int i;
+
+    if (!size) {
+        ch.status = PRIORITY_INVALID_CLASS;
+        return ch;
+    }
+
+    ch = nj_ipc_channel_create_ex(name, (unsigned int)size, options);
+
+    if (ch.status != SUCCESS) {
+        return ch;
+    }
+
+    header = nj_ipc_priority_header(&ch);
+    header->class_count = class_count;
+
+    for (i = 0; i < class_count; i++) {
+        uint32_t slots = nj_ipc_pow2_ceil(classes[i].slots);
+
+        header->classes[i].slot_size = classes[i].slot_size;
+        header->classes[i].slots = slots;
+        header->classes[i].weight = classes[i].weight;
+        header->classes[i].offset = (uint32_t)offset;
+        header->classes[i].credit = classes[i].weight;
+        nj_ipc_queue_ring_init(nj_ipc_priority_ring(&ch, i), sizeof(uint32_t) + classes[i].slot_size, slots);
+        offset += nj_ipc_queue_ring_size(sizeof(uint32_t) + classes[i].slot_size, slots);
+    }
+
+    nj_ipc_atomic_store32(&header->magic, NJ_IPC_PRIORITY_MAGIC);
+    return ch;
+}
+
+/**
+ * Open an existing IPC channel with priority classes.
+ *
+ * @param name The name of the IPC channel.
+ * @param classes The classes, as given on creation.
+ * @param class_count Number of classes, as given on creation.
+ * @param options Placement options for the shared memory, may be NULL.
+ * @return An opened nj_ipc_channel object.
+ */
+nj_ipc_channel
+nj_ipc_channel_open_priority(const char *name, const nj_ipc_priority_config *classes, unsigned int class_count,
+                             const nj_ipc_shmem_options *options) {
+    size_t size = nj_ipc_priority_segment_size(classes, class_count);
+    nj_ipc_priority_header *header;
+    nj_ipc_channel ch;
+    unsigned int i;
+
+    if (!size) {
+        ch.status = PRIORITY_INVALID_CLASS;
+        return ch;
+    }
+
+    ch = nj_ipc_channel_open_ex(name, (unsigned int)size, options);
+
+    if (ch.status != SUCCESS) {
+        return ch;
+    }
+
+    header = nj_ipc_priority_header(&ch);
+
+    if (!nj_ipc_priority_valid_view(&ch) || header->class_count != class_count) {
+        nj_ipc_channel_close(&ch);
+        ch.status = PRIORITY_INVALID_CHANNEL;
+        return ch;
+    }
+
+    for (i = 0; i < class_count; i++) {
+        if (header->classes[i].slot_size != classes[i].slot_size || header->classes[i].weight != classes[i].weight
+            || header->classes[i].slots != nj_ipc_pow2_ceil(classes[i].slots)) {
+            nj_ipc_channel_close(&ch);
+            ch.status = PRIORITY_INVALID_CHANNEL;
+            return ch;
+        }
+    }
+    return ch;
+}
+
+/**
+ * Sends a message in a priority class without blocking.
+ *
+ * @param ch Pointer to a priority channel, client side.
+ * @param priority The class, 0 being the most urgent.
+ * @param data The message.
+ * @param data_size The size of the message, at most the slot size of the class.
+ * @return SUCCESS, or QUEUE_FULL.
+ */
+nj_ipc_error
+nj_ipc_priority_try_send(nj_ipc_channel *ch, unsigned int priority, const void *data, size_t data_size) {
+    nj_ipc_queue_slot *slot;
+    uint64_t position;
+
+    if (!nj_ipc_priority_valid(ch) || (data_size && !data)) {
+        return PRIORITY_INVALID_CHANNEL;
+    }
+
+    if (priority >= nj_ipc_priority_header(ch)->class_count) {
+        return PRIORITY_INVALID_CLASS;
+    }
+
+    if (data_size > nj_ipc_priority_header(ch)->classes[priority].slot_size) {
+        return CHANNEL_WRITE_TOO_BIG;
+    }
+
+    if (!(slot = nj_ipc_queue_ring_claim(nj_ipc_priority_ring(ch, priority), &position))) {
+        return QUEUE_FULL;
     }
 
+    /* Only the message itself is copied, not the whole slot */
+    *(uint32_t*)nj_ipc_queue_item(slot) = (uint32_t)data_size;
+    memcpy(nj_ipc_queue_item(slot) + sizeof(uint32_t), data, data_size);
+    nj_ipc_queue_ring_publish(slot, position);
+
+    if (ch->tap) {
+        nj_ipc_iovec part = { data, data_size };
+        nj_ipc_tap_append(ch->tap, nj_ipc_channel_tap_direction(ch), &part, 1);
+    }
     return nj_ipc_sync_notify(&(ch->client_event));
 }
 
 /**
- * Frees an IPC channel
+ * Sends a message in a priority class, sleeping while the class is full.
  *
- * @param channel Pointer to the nj_ipc_channel object to be freed.
- * @return Nothing.
+ * @param ch Pointer to a priority channel, client side.
+ * @param priority The class, 0 being the most urgent.
+ * @param data The message.
+ * @param data_size The size of the message, at most the slot size of the class.
+ * @return The send status.
  */
-void
-nj_ipc_channel_free(nj_ipc_channel *ch) {
-    if (!ch) {
-        return;
+nj_ipc_error
+nj_ipc_priority_send(nj_ipc_channel *ch, unsigned int priority, const void *data, size_t data_size) {
+    nj_ipc_priority_class *cls;
+    nj_ipc_error err;
+    uint32_t drained;
+
+    for (;;) {
+        if ((err = nj_ipc_priority_try_send(ch, priority, data, data_size)) != QUEUE_FULL) {
+            return err;
+        }
+
+        cls = &nj_ipc_priority_header(ch)->classes[priority];
+        drained = nj_ipc_atomic_load32(&cls->drained);
+        nj_ipc_atomic_add32(&cls->waiters, 1);
+
+        if ((err = nj_ipc_priority_try_send(ch, priority, data, data_size)) != QUEUE_FULL) {
+            nj_ipc_atomic_add32(&cls->waiters, (uint32_t)-1);
+            return err;
+        }
+
+        nj_ipc_futex_wait(&cls->drained, drained, 0);
+        nj_ipc_atomic_add32(&cls->waiters, (uint32_t)-1);
     }
-    if (ch->server_event.handle) nj_ipc_sync_free(&(ch->server_event));
-    if (ch->client_event.handle) nj_ipc_sync_free(&(ch->client_event));
-    if (ch->shmem.handle) nj_ipc_shmem_free(&(ch->shmem));
-    if (ch->name) free(ch->name);
+}
+
+/**
+ * Waits for the next message by priority and weight.
+ *
+ * @param ch Pointer to a priority channel, server side.
+ * @param buffer The buffer to read into.
+ * @param buffer_size Size of buffer, a smaller one than the message drops it with CHANNEL_READ_TOO_BIG.
+ * @param received Receives the size of the message, may be NULL.
+ * @param priority Receives the class of the message, may be NULL.
+ * @return The receive status.
+ */
+nj_ipc_error
+nj_ipc_priority_recv(nj_ipc_channel *ch, void *buffer, size_t buffer_size, size_t *received, unsigned int *priority) {
+    nj_ipc_priority_header *header;
+    nj_ipc_priority_class *cls;
+    nj_ipc_queue_ring *ring;
+    nj_ipc_error status = SUCCESS;
+    uint64_t position;
+    uint32_t size, credit;
+    unsigned int i;
+    int pending;
+
+    if (!nj_ipc_priority_valid(ch)) {
+        return PRIORITY_INVALID_CHANNEL;
+    }
+
+    if ((status = nj_ipc_sync_wait(&(ch->client_event))) != SUCCESS) {
+        return status;
+    }
+
+    header = nj_ipc_priority_header(ch);
+
+    for (;;) {
+        pending = 0;
+
+        for (i = 0; i < header->class_count; i++) {
+            ring = nj_ipc_priority_ring(ch, i);
+            credit = nj_ipc_atomic_load32(&header->classes[i].credit);
+
+            if (!credit) {
+                /* Out of credit, only note whether it has messages waiting */
+                position = nj_ipc_atomic_load64(&ring->dequeue_pos);
+                pending |= nj_ipc_atomic_load64(&nj_ipc_queue_slot(ring, position)->sequence) == position + 1;
+            } else if (nj_ipc_queue_ring_claim_filled(ring, 1, &position)) {
+                nj_ipc_atomic_cas32(&header->classes[i].credit, credit, credit - 1);
+                break;
+            }
+        }
+
+        if (i < header->class_count) {
+            break;
+        }
+
+        if (pending) {
+            for (i = 0; i < header->class_count; i++) {
+                nj_ipc_atomic_store32(&header->classes[i].credit, header->classes[i].weight);
+            }
+        } else {
+            /* The message announced is behind a slot its sender hasn't filled yet */
+            nj_ipc_thread_yield();
+        }
+    }
+
+    cls = &header->classes[i];
+    size = *(uint32_t*)nj_ipc_queue_item(nj_ipc_queue_slot(ring, position));
+
+    if (received) {
+        *received = size;
+    }
+
+    if (priority) {
+        *priority = i;
+    }
+
+    if (size > buffer_size) {
+        status = CHANNEL_READ_TOO_BIG;
+    } else {
+        memcpy(buffer, nj_ipc_queue_item(nj_ipc_queue_slot(ring, position)) + sizeof(uint32_t), size);
+    }
+
+    nj_ipc_queue_ring_release(ring, position);
+    nj_ipc_atomic_add32(&cls->drained, 1);
+
+    if (nj_ipc_atomic_load32(&cls->waiters)) {
+        nj_ipc_futex_wake(&cls->drained, 0x7fffffff);
+    }
+    return status;
+}
+
+/* Traffic Replay */
+typedef enum {
+    NJ_IPC_TAP_REPLAY_REALTIME,
+    NJ_IPC_TAP_REPLAY_FAST,
+} nj_ipc_tap_replay_pace;
+
+/**
+ * Drives a server channel with the client requests recorded in a traffic log.
+ *
+ * Each client-to-server record is written into the channel as a request and the
+ * reply is awaited before moving on, just like a client would.
+ *
+ * @param tap The traffic log to replay.
+ * @param ch Pointer to a channel opened on the server under test.
+ * @param pace NJ_IPC_TAP_REPLAY_REALTIME keeps the recorded gaps, NJ_IPC_TAP_REPLAY_FAST sends back-to-back.
+ * @param replayed Receives the number of requests sent, may be NULL.
+ * @return The replay status.
+ */
+nj_ipc_error
+nj_ipc_tap_replay(nj_ipc_tap *tap, nj_ipc_channel *ch, nj_ipc_tap_replay_pace pace, size_t *replayed) {
+    size_t cursor = 0, count = 0;
+    uint64_t first_timestamp = 0, start = 0, now;
+    nj_ipc_tap_record *record;
+    nj_ipc_error err = SUCCESS;
+
+    if (!tap || !tap->view) {
+        return TAP_INVALID_OBJECT;
+    }
+
+    while (nj_ipc_tap_next(tap, &cursor, &record) == SUCCESS) {
+        if (record->direction != NJ_IPC_TAP_CLIENT_TO_SERVER) {
+            continue;
+        }
+
+        if (!count) {
+            first_timestamp = record->timestamp;
+            start = nj_ipc_clock_ns();
+        } else if (pace == NJ_IPC_TAP_REPLAY_REALTIME) {
+            now = nj_ipc_clock_ns();
+            if (record->timestamp - first_timestamp > now - start) {
+                nj_ipc_clock_sleep((record->timestamp - first_timestamp) - (now - start));
+            }
+        }
+
+        if ((err = nj_ipc_channel_write(ch, nj_ipc_tap_record_data(record), record->size)) != SUCCESS) break;
+        if ((err = nj_ipc_channel_notify_client(ch)) != SUCCESS) break;
+        if ((err = nj_ipc_channel_wait_server(ch)) != SUCCESS) break;
+        count++;
+    }
+
+    if (replayed) {
+        *replayed = count;
+    }
+    return err;
 }
 
 #endif
@@ -748,22 +6507,257 @@ nj_ipc_channel_free(nj_ipc_channel *ch) {
 #include <string>
 #include <mutex>
 #include <memory>
+#include <stdexcept>
+#include <initializer_list>
+#include <thread>
+#include <functional>
+#include <vector>
+#include <type_traits>
+#include <chrono>
+#include <list>
+#include <unordered_map>
 
 namespace NinjaIPC {
+    /* Bounded LRU of replies keyed on request bytes; entries expire after a TTL or once the generation moves */
+    class ReplyCache {
+    public:
+        ReplyCache(size_t max_bytes, std::chrono::steady_clock::duration ttl)
+            : max_bytes_(max_bytes), ttl_(ttl) {}
+
+        bool find(const std::string& key, uint64_t generation, std::string& value) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            advance(generation);
+
+            auto found = index_.find(key);
+            if (found == index_.end() || generation != generation_) {
+                return false;
+            }
+
+            if (found->second->expires <= std::chrono::steady_clock::now()) {
+                erase(found->second);
+                return false;
+            }
+
+            entries_.splice(entries_.begin(), entries_, found->second);
+            value = found->second->value;
+            return true;
+        }
+
+        /* generation is the one read before the request was sent, so a reply racing an invalidation is dropped */
+        void insert(const std::string& key, uint64_t generation, const std::string& value) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            size_t cost = entry_cost(key, value);
+
+            advance(generation);
+            if (generation != generation_ || cost > max_bytes_) {
+                return;
+            }
+
+            auto found = index_.find(key);
+            if (found != index_.end()) {
+                erase(found->second);
+            }
+
+            while (bytes_ + cost > max_bytes_) {
+                erase(std::prev(entries_.end()));
+            }
+
+            entries_.push_front(Entry{ key, value, std::chrono::steady_clock::now() + ttl_ });
+            index_.emplace(key, entries_.begin());
+            bytes_ += cost;
+        }
+
+        void clear() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            entries_.clear();
+            index_.clear();
+            bytes_ = 0;
+        }
+
+        size_t bytes() const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return bytes_;
+        }
+    private:
+        struct Entry {
+            std::string key;
+            std::string value;
+            std::chrono::steady_clock::time_point expires;
+        };
+
+        /* The key is held twice, once in the list and once in the index */
+        static size_t entry_cost(const std::string& key, const std::string& value) {
+            return sizeof(Entry) + 2 * key.size() + value.size();
+        }
+
+        void advance(uint64_t generation) {
+            if (generation > generation_) {
+                entries_.clear();
+                index_.clear();
+                bytes_ = 0;
+                generation_ = generation;
+            }
+        }
+
+        void erase(std::list<Entry>::iterator entry) {
+            bytes_ -= entry_cost(entry->key, entry->value);
+            index_.erase(entry->key);
+            entries_.erase(entry);
+        }
+
+        std::list<Entry> entries_;
+        std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+        size_t max_bytes_;
+        size_t bytes_ = 0;
+        std::chrono::steady_clock::duration ttl_;
+        uint64_t generation_ = 0;
+        mutable std::mutex mutex_;
+    };
+
     class Channel {
     public:
         enum class ChannelRole { CLIENT, SERVER };
 
-        static std::unique_ptr<Channel> make(const std::string& name, unsigned int size) {
-            return std::make_unique<Channel>(name, size, ChannelRole::SERVER);
+        static std::unique_ptr<Channel> make(const std::string& name, unsigned int size,
+                                             const nj_ipc_shmem_options* options = nullptr) {
+            return std::make_unique<Channel>(name, size, ChannelRole::SERVER, options);
+        }
+
+        static std::unique_ptr<Channel> connect(const std::string& name, unsigned int size,
+                                                const nj_ipc_shmem_options* options = nullptr) {
+            return std::make_unique<Channel>(name, size, ChannelRole::CLIENT, options);
+        }
+
+        static std::unique_ptr<Channel> make_lanes(const std::string& name, unsigned int size, unsigned int lanes,
+                                                   const nj_ipc_shmem_options* options = nullptr) {
+            return std::make_unique<Channel>(name, size, ChannelRole::SERVER, options, lanes);
+        }
+
+        static std::unique_ptr<Channel> connect_lanes(const std::string& name, unsigned int size, unsigned int lanes,
+                                                      const nj_ipc_shmem_options* options = nullptr) {
+            return std::make_unique<Channel>(name, size, ChannelRole::CLIENT, options, lanes);
+        }
+
+        /* Both sides push and pull messages independently, see nj_ipc_channel_create_duplex */
+        static std::unique_ptr<Channel> make_duplex(const std::string& name, unsigned int size,
+                                                    const nj_ipc_shmem_options* options = nullptr) {
+            return std::unique_ptr<Channel>(new Channel(nj_ipc_channel_create_duplex(name.c_str(), size, options),
+                                                        ChannelRole::SERVER));
+        }
+
+        static std::unique_ptr<Channel> connect_duplex(const std::string& name, unsigned int size,
+                                                       const nj_ipc_shmem_options* options = nullptr) {
+            return std::unique_ptr<Channel>(new Channel(nj_ipc_channel_open_duplex(name.c_str(), size, options),
+                                                        ChannelRole::CLIENT));
         }
 
-        static std::unique_ptr<Channel> connect(const std::string& name, unsigned int size) {
-            return std::make_unique<Channel>(name, size, ChannelRole::CLIENT);
+        /* Classes are given most urgent first, the client must pass the same ones */
+        static std::unique_ptr<Channel> make_priority(const std::string& name,
+                                                      const std::vector<nj_ipc_priority_config>& classes,
+                                                      const nj_ipc_shmem_options* options = nullptr) {
+            return std::unique_ptr<Channel>(new Channel(nj_ipc_channel_create_priority(name.c_str(), classes.data(),
+                                                                                       (unsigned int)classes.size(), options),
+                                                        ChannelRole::SERVER));
+        }
+
+        static std::unique_ptr<Channel> connect_priority(const std::string& name,
+                                                         const std::vector<nj_ipc_priority_config>& classes,
+                                                         const nj_ipc_shmem_options* options = nullptr) {
+            return std::unique_ptr<Channel>(new Channel(nj_ipc_channel_open_priority(name.c_str(), classes.data(),
+                                                                                     (unsigned int)classes.size(), options),
+                                                        ChannelRole::CLIENT));
+        }
+
+        /* Client channel shared through the process-wide handle cache, see nj_ipc_channel_acquire.
+           Callers asking for the same name share one object, so its lock keeps their round trips apart;
+           C code acquiring the name as well takes no part in that lock and must not send concurrently */
+        static std::shared_ptr<Channel> cached(const std::string& name, unsigned int size) {
+            static std::mutex registry_mutex;
+            static std::unordered_map<std::string, std::weak_ptr<Channel>> registry;
+            std::lock_guard<std::mutex> lock(registry_mutex);
+
+            /* Acquire even when the object exists, the handle cache checks the size */
+            nj_ipc_channel* channel = nj_ipc_channel_acquire(name.c_str(), size, nullptr);
+
+            if (!channel) {
+                throw std::runtime_error("Failed to open channel");
+            }
+
+            std::shared_ptr<Channel> shared = registry[name].lock();
+            if (shared) {
+                nj_ipc_channel_release(channel);
+                return shared;
+            }
+
+            shared.reset(new Channel(channel));
+            registry[name] = shared;
+            return shared;
+        }
+
+#ifdef NJ_IPC_LINUX
+        /* Nameless channel, see nj_ipc_channel_create_anon; hand it over with send_fds */
+        static std::unique_ptr<Channel> make_anon(unsigned int size) {
+            return std::unique_ptr<Channel>(new Channel(nj_ipc_channel_create_anon(size), ChannelRole::SERVER));
+        }
+
+        static std::unique_ptr<Channel> receive_fds(int socket) {
+            return std::unique_ptr<Channel>(new Channel(nj_ipc_channel_recv_fds(socket), ChannelRole::CLIENT));
+        }
+
+        void send_fds(int socket) {
+            if (nj_ipc_channel_send_fds(handle_, socket) != SUCCESS) {
+                throw std::runtime_error("Failed to send channel descriptors");
+            }
+        }
+#endif
+
+        /* A lane held by one client thread for as long as the handle lives */
+        class Lane {
+        public:
+            explicit Lane(Channel& channel)
+                : channel_(&channel), lane_(channel.acquire_lane()) {}
+
+            Lane(Lane&& other) noexcept
+                : channel_(other.channel_), lane_(other.lane_) {
+                other.channel_ = nullptr;
+            }
+
+            Lane(const Lane&) = delete;
+            Lane& operator=(const Lane&) = delete;
+
+            ~Lane() {
+                if (channel_) nj_ipc_lane_release(channel_->handle_, lane_);
+            }
+
+            template<typename T>
+            T send(const T& data) {
+                return channel_->lane_call(lane_, data);
+            }
+
+            unsigned int index() const { return lane_; }
+        private:
+            Channel* channel_;
+            unsigned int lane_;
+        };
+
+        Lane lane() {
+            if (role_ != ChannelRole::CLIENT || !lanes_) {
+                throw std::runtime_error("Lanes are only held by CLIENT role on a lane channel");
+            }
+            return Lane(*this);
         }
 
         ~Channel() {
-            nj_ipc_channel_free(&channel_);
+            if (cached_) {
+                nj_ipc_channel_release(cached_);
+            } else {
+                nj_ipc_channel_free(handle_);
+            }
+        }
+
+        void set_tap(nj_ipc_tap *tap) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            nj_ipc_channel_set_tap(handle_, tap);
         }
 
         template<typename T>
@@ -771,68 +6765,193 @@ namespace NinjaIPC {
             if (role_ != ChannelRole::CLIENT) {
                 throw std::runtime_error("Send operation not allowed for SERVER role");
             }
+
+            if (lanes_) {
+                Lane lane(*this);
+                return lane.send(data);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            if (nj_ipc_channel_write(handle_, (void*)&data, sizeof(T)) != SUCCESS) {
+                throw std::runtime_error("Failed to write data");
+            }
+
+            nj_ipc_channel_notify_client(handle_);
+
+            if (nj_ipc_channel_wait_server(handle_) != SUCCESS) {
+                throw std::runtime_error("Failed to wait for server");
+            }
+
+            T response;
+            if (nj_ipc_channel_read(handle_, &response, sizeof(T)) != SUCCESS) {
+                throw std::runtime_error("Failed to read response");
+            }
+
+            return response;
+        }
+
+        /* Opt-in memoization for idempotent requests sent with send_cached */
+        void enable_reply_cache(size_t max_bytes, std::chrono::steady_clock::duration ttl) {
+            if (role_ != ChannelRole::CLIENT) {
+                throw std::runtime_error("Reply cache is only kept by CLIENT role");
+            }
+            if (nj_ipc_channel_generation_attach(handle_) != SUCCESS) {
+                throw std::runtime_error("Failed to map the invalidation generation");
+            }
+            reply_cache_ = std::make_unique<ReplyCache>(max_bytes, ttl);
+        }
+
+        /* Like send, but repeated requests are answered from the reply cache until the server invalidates */
+        template<typename T>
+        T send_cached(const T& data) {
+            static_assert(std::is_trivially_copyable<T>::value, "Cached requests are keyed bytewise");
+
+            if (!reply_cache_) {
+                return send(data);
+            }
+
+            std::string key(reinterpret_cast<const char*>(&data), sizeof(T));
+            std::string value;
+            uint64_t generation = nj_ipc_channel_generation(handle_);
+            T response;
+
+            if (reply_cache_->find(key, generation, value) && value.size() == sizeof(T)) {
+                memcpy(&response, value.data(), sizeof(T));
+                return response;
+            }
+
+            response = send(data);
+            reply_cache_->insert(key, generation, std::string(reinterpret_cast<const char*>(&response), sizeof(T)));
+            return response;
+        }
+
+        /* Server side: every reply clients cached so far goes stale */
+        void invalidate() {
+            if (role_ != ChannelRole::SERVER) {
+                throw std::runtime_error("Invalidate operation not allowed for CLIENT role");
+            }
+            if (nj_ipc_channel_invalidate(handle_) != SUCCESS) {
+                throw std::runtime_error("Failed to invalidate cached replies");
+            }
+        }
+
+        template<typename R>
+        R sendv(std::initializer_list<nj_ipc_iovec> parts) {
+            if (role_ != ChannelRole::CLIENT) {
+                throw std::runtime_error("Send operation not allowed for SERVER role");
+            }
             std::lock_guard<std::mutex> lock(mutex_);
 
-            if (nj_ipc_channel_write(&channel_, (void*)&data, sizeof(T)) != SUCCESS) {
-                throw std::runtime_error("Failed to write data");
+            if (nj_ipc_channel_writev(handle_, parts.begin(), parts.size()) != SUCCESS) {
+                throw std::runtime_error("Failed to write data");
+            }
+
+            nj_ipc_channel_notify_client(handle_);
+
+            if (nj_ipc_channel_wait_server(handle_) != SUCCESS) {
+                throw std::runtime_error("Failed to wait for server");
+            }
+
+            R response;
+            if (nj_ipc_channel_read(handle_, &response, sizeof(R)) != SUCCESS) {
+                throw std::runtime_error("Failed to read response");
+            }
+
+            return response;
+        }
+
+        template<typename T>
+        T receive() {
+            if (role_ != ChannelRole::SERVER) {
+                throw std::runtime_error("Receive operation not allowed for CLIENT role");
+            }
+
+            if (lanes_) {
+                throw std::runtime_error("Lane channels receive with receive(lane)");
             }
 
-            nj_ipc_channel_notify_client(&channel_);
+            std::lock_guard<std::mutex> lock(mutex_);
 
-            if (nj_ipc_channel_wait_server(&channel_) != SUCCESS) {
-                throw std::runtime_error("Failed to wait for server");
+            if (nj_ipc_channel_wait_client(handle_) != SUCCESS) {
+                throw std::runtime_error("Failed to wait for client");
             }
 
-            T response;
-            if (nj_ipc_channel_read(&channel_, &response, sizeof(T)) != SUCCESS) {
-                throw std::runtime_error("Failed to read response");
+            T request;
+            if (nj_ipc_channel_read(handle_, &request, sizeof(T)) != SUCCESS) {
+                throw std::runtime_error("Failed to read request");
             }
-
-            return response;
+            return request;
         }
 
         template<typename T>
-        T receive() {
+        void reply(const T& data) {
             if (role_ != ChannelRole::SERVER) {
-                throw std::runtime_error("Receive operation not allowed for CLIENT role");
+                throw std::runtime_error("Reply operation not allowed for CLIENT role");
             }
 
             std::lock_guard<std::mutex> lock(mutex_);
 
-            if (nj_ipc_channel_wait_client(&channel_) != SUCCESS) {
+            if (nj_ipc_channel_write(handle_, (void*)&data, sizeof(T)) != SUCCESS) {
+                throw std::runtime_error("Failed to write reply");
+            }
+            nj_ipc_channel_notify_server(handle_);
+        }
+
+        /* Lane channels: any number of server threads may receive and reply concurrently */
+        template<typename T>
+        T receive(unsigned int& lane) {
+            if (role_ != ChannelRole::SERVER || !lanes_) {
+                throw std::runtime_error("Lane receive requires the SERVER role on a lane channel");
+            }
+
+            if (nj_ipc_lane_next(handle_, &lane) != SUCCESS) {
                 throw std::runtime_error("Failed to wait for client");
             }
 
             T request;
-            if (nj_ipc_channel_read(&channel_, &request, sizeof(T)) != SUCCESS) {
+            if (nj_ipc_lane_read(handle_, lane, &request, sizeof(T)) != SUCCESS) {
                 throw std::runtime_error("Failed to read request");
             }
             return request;
         }
 
         template<typename T>
-        void reply(const T& data) {
+        void reply(unsigned int lane, const T& data) {
+            if (role_ != ChannelRole::SERVER || !lanes_) {
+                throw std::runtime_error("Lane reply requires the SERVER role on a lane channel");
+            }
+
+            if (nj_ipc_lane_reply(handle_, lane, &data, sizeof(T)) != SUCCESS) {
+                throw std::runtime_error("Failed to write reply");
+            }
+        }
+
+        void replyv(std::initializer_list<nj_ipc_iovec> parts) {
             if (role_ != ChannelRole::SERVER) {
                 throw std::runtime_error("Reply operation not allowed for CLIENT role");
             }
 
             std::lock_guard<std::mutex> lock(mutex_);
 
-            if (nj_ipc_channel_write(&channel_, (void*)&data, sizeof(T)) != SUCCESS) {
+            if (nj_ipc_channel_writev(handle_, parts.begin(), parts.size()) != SUCCESS) {
                 throw std::runtime_error("Failed to write reply");
             }
-            nj_ipc_channel_notify_server(&channel_);
+            nj_ipc_channel_notify_server(handle_);
         }
 
-        Channel(const std::string& name, unsigned int size, ChannelRole role)
-            : role_(role)
+        Channel(const std::string& name, unsigned int size, ChannelRole role,
+                const nj_ipc_shmem_options* options = nullptr, unsigned int lanes = 0)
+            : role_(role), lanes_(lanes)
         {
             switch (role) {
             case ChannelRole::SERVER:
-                channel_ = nj_ipc_channel_create(name.c_str(), size);
+                channel_ = lanes ? nj_ipc_channel_create_lanes(name.c_str(), size, lanes, options)
+                                 : nj_ipc_channel_create_ex(name.c_str(), size, options);
                 break;
             case ChannelRole::CLIENT:
-                channel_ = nj_ipc_channel_open(name.c_str(), size);
+                channel_ = lanes ? nj_ipc_channel_open_lanes(name.c_str(), size, lanes, options)
+                                 : nj_ipc_channel_open_ex(name.c_str(), size, options);
                 break;
             default:
                 throw std::runtime_error("Unknown role on Channel ctor");
@@ -842,10 +6961,556 @@ namespace NinjaIPC {
                 throw std::runtime_error("Failed to create channel");
             }
         }
+        /* Sends a payload of any size in chunks, the peer must call receive_stream with the same slot count */
+        void send_stream(const void* data, size_t size, unsigned int slots = NJ_IPC_STREAM_SLOTS) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            nj_ipc_stream stream = nj_ipc_stream_init(handle_, slots);
+
+            if (stream.status != SUCCESS || nj_ipc_stream_write(&stream, data, size) != SUCCESS) {
+                throw std::runtime_error("Failed to write stream");
+            }
+        }
+
+        std::vector<char> receive_stream(unsigned int slots = NJ_IPC_STREAM_SLOTS) {
+            std::vector<char> buffer;
+            receive_stream([&buffer](const void* chunk, size_t size) {
+                buffer.insert(buffer.end(), (const char*)chunk, (const char*)chunk + size);
+            }, slots);
+            return buffer;
+        }
+
+#ifdef NJ_IPC_LINUX
+        /* Hands a payload of any size to the peer, which copies it straight out of this process */
+        void send_bulk(const void* data, size_t size) {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            if (nj_ipc_bulk_send(handle_, data, size) != SUCCESS) {
+                throw std::runtime_error("Failed to send bulk payload");
+            }
+        }
+
+        std::vector<char> receive_bulk() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::vector<char> buffer;
+            size_t size;
+
+            if (nj_ipc_bulk_wait(handle_, &size) != SUCCESS) {
+                throw std::runtime_error("Failed to wait for bulk payload");
+            }
+
+            try {
+                buffer.resize(size);
+            } catch (...) {
+                nj_ipc_bulk_accept(handle_, nullptr, 0);
+                throw;
+            }
+
+            if (nj_ipc_bulk_accept(handle_, buffer.data(), size) != SUCCESS) {
+                throw std::runtime_error("Failed to copy bulk payload");
+            }
+            return buffer;
+        }
+#endif
+
+        /* Duplex channels: sends to the other side, whichever role this is */
+        template<typename T>
+        void push(const T& data) {
+            if (nj_ipc_duplex_send(handle_, &data, sizeof(T)) != SUCCESS) {
+                throw std::runtime_error("Failed to push message");
+            }
+        }
+
+        template<typename T>
+        T pull() {
+            T message;
+            size_t size;
+
+            if (nj_ipc_duplex_recv(handle_, &message, sizeof(T), &size) != SUCCESS || size != sizeof(T)) {
+                throw std::runtime_error("Failed to pull message");
+            }
+            return message;
+        }
+
+        /* Priority channels: blocks while the class is full */
+        template<typename T>
+        void send_priority(unsigned int priority, const T& data) {
+            if (nj_ipc_priority_send(handle_, priority, &data, sizeof(T)) != SUCCESS) {
+                throw std::runtime_error("Failed to send priority message");
+            }
+        }
+
+        template<typename T>
+        T receive_priority(unsigned int& priority) {
+            T message;
+            size_t size;
+
+            if (nj_ipc_priority_recv(handle_, &message, sizeof(T), &size, &priority) != SUCCESS || size != sizeof(T)) {
+                throw std::runtime_error("Failed to receive priority message");
+            }
+            return message;
+        }
+
+        /* Hands each chunk to on_chunk in place, without assembling the payload */
+        void receive_stream(const std::function<void(const void*, size_t)>& on_chunk,
+                            unsigned int slots = NJ_IPC_STREAM_SLOTS) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            nj_ipc_stream stream = nj_ipc_stream_init(handle_, slots);
+            const void* chunk;
+            size_t size;
+            nj_ipc_error err;
+
+            if (stream.status != SUCCESS) {
+                throw std::runtime_error("Failed to read stream");
+            }
+
+            while ((err = nj_ipc_stream_next(&stream, &chunk, &size)) == SUCCESS) {
+                on_chunk(chunk, size);
+            }
+
+            if (err != STREAM_END) {
+                throw std::runtime_error("Failed to read stream");
+            }
+        }
+
+        /* Serves this lane channel from forked workers until *stop is set, see nj_ipc_prefork_run */
+        template<typename T, typename R>
+        void serve_prefork(unsigned int workers, const std::function<R(const T&)>& handler,
+                           volatile sig_atomic_t* stop = nullptr) {
+            if (role_ != ChannelRole::SERVER || !lanes_) {
+                throw std::runtime_error("Prefork serving requires the SERVER role on a lane channel");
+            }
+
+            nj_ipc_prefork_handler serve = [](nj_ipc_channel* ch, unsigned int lane, void* ctx) {
+                T request;
+                nj_ipc_error err = nj_ipc_lane_read(ch, lane, &request, sizeof(T));
+
+                if (err != SUCCESS) {
+                    return err;
+                }
+
+                R response = (*static_cast<const std::function<R(const T&)>*>(ctx))(request);
+                return nj_ipc_lane_reply(ch, lane, &response, sizeof(R));
+            };
+
+            if (nj_ipc_prefork_run(handle_, workers, serve, (void*)&handler, stop) != SUCCESS) {
+                throw std::runtime_error("Failed to run prefork workers");
+            }
+        }
+
     private:
+        /* Works on the cached object itself, so state such as the generation mapping is shared with C users */
+        explicit Channel(nj_ipc_channel* cached)
+            : channel_(), handle_(cached), role_(ChannelRole::CLIENT), lanes_(0), cached_(cached) {}
+
+        Channel(nj_ipc_channel channel, ChannelRole role)
+            : channel_(channel), role_(role), lanes_(0)
+        {
+            if (channel_.status != SUCCESS) {
+                throw std::runtime_error("Failed to create channel");
+            }
+        }
+
+        unsigned int acquire_lane() {
+            unsigned int lane;
+            unsigned int hint = (unsigned int)std::hash<std::thread::id>()(std::this_thread::get_id());
+
+            if (nj_ipc_lane_acquire_wait(handle_, hint, &lane) != SUCCESS) {
+                throw std::runtime_error("Failed to acquire lane");
+            }
+            return lane;
+        }
+
+        template<typename T>
+        T lane_call(unsigned int lane, const T& data) {
+            if (nj_ipc_lane_send(handle_, lane, &data, sizeof(T)) != SUCCESS) {
+                throw std::runtime_error("Failed to write data");
+            }
+
+            if (nj_ipc_lane_wait_reply(handle_, lane) != SUCCESS) {
+                throw std::runtime_error("Failed to wait for server");
+            }
+
+            T response;
+            if (nj_ipc_lane_read(handle_, lane, &response, sizeof(T)) != SUCCESS) {
+                throw std::runtime_error("Failed to read response");
+            }
+            return response;
+        }
+
         nj_ipc_channel channel_;
+        nj_ipc_channel* handle_ = &channel_; /* The channel operated on, owned by the handle cache once cached */
         std::mutex mutex_;
         ChannelRole role_;
+        unsigned int lanes_;
+        nj_ipc_channel* cached_ = nullptr;
+        std::unique_ptr<ReplyCache> reply_cache_;
+    };
+
+    template<typename K, typename V>
+    class KeyValue {
+        static_assert(std::is_trivially_copyable<K>::value, "KeyValue keys are copied bytewise");
+        static_assert(std::is_trivially_copyable<V>::value, "KeyValue values are copied bytewise");
+    public:
+        static std::unique_ptr<KeyValue> make(const std::string& name, unsigned int capacity) {
+            return std::make_unique<KeyValue>(nj_ipc_kv_create(name.c_str(), sizeof(K), sizeof(V), capacity));
+        }
+
+        static std::unique_ptr<KeyValue> connect(const std::string& name, unsigned int capacity) {
+            return std::make_unique<KeyValue>(nj_ipc_kv_open(name.c_str(), sizeof(K), sizeof(V), capacity));
+        }
+
+        explicit KeyValue(nj_ipc_kv kv)
+            : kv_(kv)
+        {
+            if (kv_.status != SUCCESS) {
+                throw std::runtime_error("Failed to create key-value store");
+            }
+        }
+
+        KeyValue(const KeyValue&) = delete;
+        KeyValue& operator=(const KeyValue&) = delete;
+
+        ~KeyValue() {
+            nj_ipc_kv_free(&kv_);
+        }
+
+        void put(const K& key, const V& value) {
+            if (nj_ipc_kv_put(&kv_, &key, &value) != SUCCESS) {
+                throw std::runtime_error("Key-value store is full");
+            }
+        }
+
+        bool get(const K& key, V& value) {
+            return nj_ipc_kv_get(&kv_, &key, &value) == SUCCESS;
+        }
+
+        bool contains(const K& key) {
+            return nj_ipc_kv_get(&kv_, &key, nullptr) == SUCCESS;
+        }
+
+        bool remove(const K& key) {
+            return nj_ipc_kv_remove(&kv_, &key) == SUCCESS;
+        }
+
+        unsigned int size() {
+            return nj_ipc_kv_count(&kv_);
+        }
+    private:
+        nj_ipc_kv kv_;
+    };
+
+    template<typename T>
+    class Queue {
+        static_assert(std::is_trivially_copyable<T>::value, "Queue items are copied bytewise");
+    public:
+        static std::unique_ptr<Queue> make(const std::string& name, unsigned int capacity) {
+            return std::make_unique<Queue>(nj_ipc_queue_create(name.c_str(), sizeof(T), capacity));
+        }
+
+        static std::unique_ptr<Queue> connect(const std::string& name, unsigned int capacity) {
+            return std::make_unique<Queue>(nj_ipc_queue_open(name.c_str(), sizeof(T), capacity));
+        }
+
+        explicit Queue(nj_ipc_queue queue)
+            : queue_(queue)
+        {
+            if (queue_.status != SUCCESS) {
+                throw std::runtime_error("Failed to create queue");
+            }
+        }
+
+        Queue(const Queue&) = delete;
+        Queue& operator=(const Queue&) = delete;
+
+        ~Queue() {
+            nj_ipc_queue_free(&queue_);
+        }
+
+        void push(const T& item) {
+            if (nj_ipc_queue_push(&queue_, &item) != SUCCESS) {
+                throw std::runtime_error("Failed to push item");
+            }
+        }
+
+        bool try_push(const T& item) {
+            return nj_ipc_queue_try_push(&queue_, &item) == SUCCESS;
+        }
+
+        T pop() {
+            T item;
+            if (nj_ipc_queue_pop(&queue_, &item) != SUCCESS) {
+                throw std::runtime_error("Failed to pop item");
+            }
+            return item;
+        }
+
+        bool try_pop(T& item) {
+            return nj_ipc_queue_try_pop(&queue_, &item) == SUCCESS;
+        }
+
+        /* Blocks until at least one item is available, then takes up to max_items */
+        std::vector<T> pop_batch(size_t max_items) {
+            std::vector<T> items(max_items);
+            size_t popped;
+            if (nj_ipc_queue_pop_batch(&queue_, items.data(), max_items, &popped) != SUCCESS) {
+                throw std::runtime_error("Failed to pop items");
+            }
+            items.resize(popped);
+            return items;
+        }
+    private:
+        nj_ipc_queue queue_;
+    };
+
+    class Arena {
+    public:
+        /* A channel inside the arena, only valid while the arena lives */
+        class Channel {
+        public:
+            explicit Channel(nj_ipc_arena_channel channel)
+                : channel_(channel)
+            {
+                if (channel_.status != SUCCESS) {
+                    throw std::runtime_error("Failed to create arena channel");
+                }
+            }
+
+            template<typename T>
+            T send(const T& data) {
+                std::lock_guard<std::mutex> lock(mutex_);
+
+                if (nj_ipc_arena_channel_write(&channel_, &data, sizeof(T)) != SUCCESS) {
+                    throw std::runtime_error("Failed to write data");
+                }
+
+                nj_ipc_arena_channel_notify_client(&channel_);
+                nj_ipc_arena_channel_wait_server(&channel_);
+
+                T response;
+                if (nj_ipc_arena_channel_read(&channel_, &response, sizeof(T)) != SUCCESS) {
+                    throw std::runtime_error("Failed to read response");
+                }
+                return response;
+            }
+
+            template<typename T>
+            T receive() {
+                nj_ipc_arena_channel_wait_client(&channel_);
+
+                T request;
+                if (nj_ipc_arena_channel_read(&channel_, &request, sizeof(T)) != SUCCESS) {
+                    throw std::runtime_error("Failed to read request");
+                }
+                return request;
+            }
+
+            template<typename T>
+            void reply(const T& data) {
+                if (nj_ipc_arena_channel_write(&channel_, &data, sizeof(T)) != SUCCESS) {
+                    throw std::runtime_error("Failed to write reply");
+                }
+                nj_ipc_arena_channel_notify_server(&channel_);
+            }
+        private:
+            nj_ipc_arena_channel channel_;
+            std::mutex mutex_;
+        };
+
+        static std::unique_ptr<Arena> make(const std::string& name, unsigned int channel_size, unsigned int capacity) {
+            return std::make_unique<Arena>(nj_ipc_arena_create(name.c_str(), channel_size, capacity));
+        }
+
+        static std::unique_ptr<Arena> connect(const std::string& name, unsigned int channel_size, unsigned int capacity) {
+            return std::make_unique<Arena>(nj_ipc_arena_open(name.c_str(), channel_size, capacity));
+        }
+
+        explicit Arena(nj_ipc_arena arena)
+            : arena_(arena)
+        {
+            if (arena_.status != SUCCESS) {
+                throw std::runtime_error("Failed to create arena");
+            }
+        }
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        ~Arena() {
+            nj_ipc_arena_free(&arena_);
+        }
+
+        std::unique_ptr<Channel> make_channel(const std::string& name) {
+            return std::make_unique<Channel>(nj_ipc_arena_channel_create(&arena_, name.c_str()));
+        }
+
+        std::unique_ptr<Channel> connect_channel(const std::string& name) {
+            return std::make_unique<Channel>(nj_ipc_arena_channel_open(&arena_, name.c_str()));
+        }
+
+        void remove_channel(const std::string& name) {
+            nj_ipc_arena_channel_remove(&arena_, name.c_str());
+        }
+    private:
+        nj_ipc_arena arena_;
+    };
+
+    /* Lockable view of an nj_ipc_mutex placed in shared memory, usable with std::lock_guard and std::unique_lock */
+    class Mutex {
+    public:
+        explicit Mutex(nj_ipc_mutex* mutex)
+            : mutex_(mutex) {}
+
+        /* A lock taken over from a dead holder counts as acquired, see owner_died */
+        void lock() {
+            nj_ipc_error err = nj_ipc_mutex_lock(mutex_);
+            if (err != SUCCESS && err != LOCK_OWNER_DEAD) {
+                throw std::runtime_error("Failed to lock mutex");
+            }
+            owner_died_ = err == LOCK_OWNER_DEAD;
+        }
+
+        bool try_lock() {
+            nj_ipc_error err = nj_ipc_mutex_try_lock(mutex_);
+            owner_died_ = err == LOCK_OWNER_DEAD;
+            return err == SUCCESS || err == LOCK_OWNER_DEAD;
+        }
+
+        void unlock() {
+            nj_ipc_mutex_unlock(mutex_);
+        }
+
+        /* Whether the last acquisition took the lock over from a dead holder, valid while held */
+        bool owner_died() const { return owner_died_; }
+    private:
+        nj_ipc_mutex* mutex_;
+        bool owner_died_ = false;
+    };
+
+    /* SharedLockable view of an nj_ipc_rwlock placed in shared memory, usable with std::shared_lock */
+    class SharedMutex {
+    public:
+        explicit SharedMutex(nj_ipc_rwlock* rwlock)
+            : rwlock_(rwlock) {}
+
+        void lock() {
+            nj_ipc_error err = nj_ipc_rwlock_lock(rwlock_);
+            if (err != SUCCESS && err != LOCK_OWNER_DEAD) {
+                throw std::runtime_error("Failed to lock reader/writer lock");
+            }
+        }
+
+        bool try_lock() {
+            return nj_ipc_rwlock_try_lock(rwlock_) == SUCCESS;
+        }
+
+        void unlock() {
+            nj_ipc_rwlock_unlock(rwlock_);
+        }
+
+        void lock_shared() {
+            nj_ipc_error err = nj_ipc_rwlock_lock_shared(rwlock_);
+            if (err != SUCCESS && err != LOCK_OWNER_DEAD) {
+                throw std::runtime_error("Failed to lock reader/writer lock");
+            }
+        }
+
+        bool try_lock_shared() {
+            return nj_ipc_rwlock_try_lock_shared(rwlock_) == SUCCESS;
+        }
+
+        void unlock_shared() {
+            nj_ipc_rwlock_unlock_shared(rwlock_);
+        }
+    private:
+        nj_ipc_rwlock* rwlock_;
+    };
+
+    class Publication {
+    public:
+        /* A version mapped read-only, held until the snapshot is destroyed */
+        class Snapshot {
+        public:
+            Snapshot(Publication& publication, nj_ipc_publish_snapshot snapshot)
+                : publication_(&publication), snapshot_(snapshot) {}
+
+            Snapshot(Snapshot&& other) noexcept
+                : publication_(other.publication_), snapshot_(other.snapshot_) {
+                other.publication_ = nullptr;
+            }
+
+            Snapshot(const Snapshot&) = delete;
+            Snapshot& operator=(const Snapshot&) = delete;
+
+            ~Snapshot() {
+                if (publication_) nj_ipc_publish_release(&publication_->pub_, &snapshot_);
+            }
+
+            const void* data() const { return snapshot_.data; }
+            size_t size() const { return snapshot_.size; }
+            uint64_t version() const { return snapshot_.version; }
+
+            /* Whether a newer version is live, then acquire a fresh snapshot */
+            bool stale() const { return nj_ipc_publish_changed(&publication_->pub_, &snapshot_) != 0; }
+        private:
+            Publication* publication_;
+            nj_ipc_publish_snapshot snapshot_;
+        };
+
+        static std::unique_ptr<Publication> make(const std::string& name) {
+            return std::make_unique<Publication>(nj_ipc_publish_create(name.c_str()));
+        }
+
+        static std::unique_ptr<Publication> connect(const std::string& name) {
+            return std::make_unique<Publication>(nj_ipc_publish_open(name.c_str()));
+        }
+
+        explicit Publication(nj_ipc_publication pub)
+            : pub_(pub)
+        {
+            if (pub_.status != SUCCESS) {
+                throw std::runtime_error("Failed to create publication");
+            }
+        }
+
+        Publication(const Publication&) = delete;
+        Publication& operator=(const Publication&) = delete;
+
+        ~Publication() {
+            nj_ipc_publish_free(&pub_);
+        }
+
+        /* Writes a new version in place with fill, then swaps it in */
+        uint64_t publish(unsigned int size, const std::function<void(void*)>& fill) {
+            nj_ipc_publish_snapshot snapshot;
+
+            if (nj_ipc_publish_begin(&pub_, size, &snapshot) != SUCCESS) {
+                throw std::runtime_error("Failed to begin publishing");
+            }
+
+            try {
+                fill(snapshot.data);
+            } catch (...) {
+                nj_ipc_publish_abort(&pub_, &snapshot);
+                throw;
+            }
+            nj_ipc_publish_commit(&pub_, &snapshot);
+            return snapshot.version;
+        }
+
+        uint64_t publish(const void* data, unsigned int size) {
+            return publish(size, [data, size](void* target) { memcpy(target, data, size); });
+        }
+
+        Snapshot acquire() {
+            nj_ipc_publish_snapshot snapshot;
+
+            if (nj_ipc_publish_acquire(&pub_, &snapshot) != SUCCESS) {
+                throw std::runtime_error("Failed to acquire snapshot");
+            }
+            return Snapshot(*this, snapshot);
+        }
+    private:
+        nj_ipc_publication pub_;
     };
 }
 #endif
@@ -0,0 +1,85 @@
+/*
+ * Compares a byte ring on a mirrored segment, where every message is one
+ * contiguous copy read in place, with the same ring on a plain segment, where
+ * messages wrapping past the end are split in two.
+ *
+ * Usage: nj_ipc_bench_mirror [ring KiB] [MiB per run]
+ */
+#include "../../src/ninjaipc.h"
+#include <stdio.h>
+
+static uint64_t checksum(const unsigned char *data, size_t size) {
+    uint64_t sum = 0;
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+static double run(nj_ipc_shmem *ring, size_t message_size, size_t total, int mirrored, uint64_t *sink) {
+    static unsigned char message[1 << 16];
+    char *view = (char*)ring->view;
+    size_t ring_size = ring->view_size, position = 0, moved;
+    uint64_t start = nj_ipc_clock_ns(), elapsed;
+
+    for (moved = 0; moved < total; moved += message_size) {
+        size_t offset = position % ring_size, first = ring_size - offset;
+
+        if (mirrored || first >= message_size) {
+            memcpy(view + offset, message, message_size);
+            *sink += checksum((unsigned char*)view + offset, message_size);
+        } else {
+            memcpy(view + offset, message, first);
+            memcpy(view, message + first, message_size - first);
+            *sink += checksum((unsigned char*)view + offset, first)
+                   + checksum((unsigned char*)view, message_size - first);
+        }
+        position += message_size;
+    }
+
+    elapsed = nj_ipc_clock_ns() - start;
+    return (double)total / (1 << 30) / (elapsed / 1e9);
+}
+
+int main(int argc, char **argv) {
+    unsigned int granularity = nj_ipc_shmem_granularity();
+    unsigned int size = (argc > 1 ? (unsigned int)atoi(argv[1]) : 256) << 10;
+    size_t total = (size_t)(argc > 2 ? atoi(argv[2]) : 1024) << 20;
+    size_t message_sizes[] = { 100, 1000, 10000, 60000 };
+    nj_ipc_shmem_options options;
+    uint64_t sink = 0;
+    size_t i;
+
+    memset(&options, 0, sizeof(options));
+    options.mirrored = 1;
+    size = (size + granularity - 1) / granularity * granularity;
+
+    nj_ipc_shmem plain = nj_ipc_shmem_create("nj_ipc_bench_plain", size);
+    nj_ipc_shmem mirror = nj_ipc_shmem_create_ex("nj_ipc_bench_mirror", size, &options);
+
+    if (plain.status != SUCCESS || mirror.status != SUCCESS) {
+        fprintf(stderr, "failed to create segments (%d, %d)\n", plain.status, mirror.status);
+        return 1;
+    }
+
+    /* Fault every page in before timing */
+    memset(plain.view, 0, size);
+    memset(mirror.view, 0, size);
+
+    printf("message_size,split_gib_per_s,mirrored_gib_per_s\n");
+
+    for (i = 0; i < sizeof(message_sizes) / sizeof(message_sizes[0]); i++) {
+        double split = run(&plain, message_sizes[i], total, 0, &sink);
+        double mirrored = run(&mirror, message_sizes[i], total, 1, &sink);
+
+        printf("%zu,%.2f,%.2f\n", message_sizes[i], split, mirrored);
+    }
+
+    fprintf(stderr, "checksum %llu\n", (unsigned long long)sink);
+
+    nj_ipc_shmem_free(&plain);
+    nj_ipc_shmem_free(&mirror);
+    return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * Measures how fast a thread reads a channel segment depending on where the
+ * segment lives, for every (memory node, cpu node) pair on the host.
+ *
+ * Usage: nj_ipc_bench_numa [segment MiB] [passes]
+ */
+#include "../../src/ninjaipc.h"
+#include <stdio.h>
+
+int main(int argc, char **argv) {
+    unsigned int size = (argc > 1 ? (unsigned int)atoi(argv[1]) : 64) << 20;
+    int passes = argc > 2 ? atoi(argv[2]) : 20;
+    int nodes = nj_ipc_numa_node_count();
+    int memory_node, cpu_node, pass;
+
+    printf("memory_node,cpu_node,placement,gib_per_s\n");
+
+    for (memory_node = 0; memory_node < nodes; memory_node++) {
+        nj_ipc_shmem_options options;
+        memset(&options, 0, sizeof(options));
+        options.numa_policy = NJ_IPC_NUMA_BIND;
+        options.numa_node = memory_node;
+
+        nj_ipc_channel ch = nj_ipc_channel_create_ex("nj_ipc_bench_numa", size, &options);
+        if (ch.status != SUCCESS) {
+            fprintf(stderr, "failed to create channel on node %d (%d)\n", memory_node, ch.status);
+            return 1;
+        }
+
+        /* Fault every page in, so placement follows the policy rather than the reader */
+        memset(ch.shmem.view, 1, size);
+
+        for (cpu_node = 0; cpu_node < nodes; cpu_node++) {
+            volatile uint64_t sink = 0;
+            uint64_t start, elapsed;
+            size_t i;
+
+            if (nj_ipc_thread_pin_numa(cpu_node) != SUCCESS) {
+                fprintf(stderr, "failed to pin to node %d\n", cpu_node);
+                continue;
+            }
+
+            start = nj_ipc_clock_ns();
+            for (pass = 0; pass < passes; pass++) {
+                const uint64_t *words = (const uint64_t*)ch.shmem.view;
+                uint64_t sum = 0;
+                for (i = 0; i < size / sizeof(uint64_t); i++) {
+                    sum += words[i];
+                }
+                sink += sum;
+            }
+            elapsed = nj_ipc_clock_ns() - start;
+
+            printf("%d,%d,%s,%.2f\n", memory_node, cpu_node, memory_node == cpu_node ? "local" : "remote",
+                   (double)size * passes / (1 << 30) / (elapsed / 1e9));
+        }
+
+        nj_ipc_channel_free(&ch);
+    }
+    return 0;
+}
@@ -0,0 +1,300 @@
+/*
+ * Measures how request/reply throughput and latency scale with the number of
+ * client processes and server threads, for the C lane API and the C++ Channel,
+ * across payload sizes and CPU pinning. Prints one CSV row per configuration,
+ * meant to be kept and compared across releases.
+ *
+ * Usage: nj_ipc_bench_scaling [max clients] [max server threads] [requests per client]
+ */
+#include "../../src/ninjaipc.h"
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#ifdef NJ_IPC_POSIX
+#include <sys/resource.h>
+#endif
+
+#ifdef NJ_IPC_POSIX
+static const char* bench_name = "nj_ipc_bench_scaling";
+static const char* samples_name = "nj_ipc_bench_scaling_samples";
+
+enum class Api { C, CPP };
+enum class Pinning { NONE, SPREAD };
+
+template<size_t N>
+struct Payload {
+    char stop;
+    char data[N - 1];
+};
+
+/* SPREAD gives every server thread and client process a CPU of its own, as far as there are CPUs */
+static void pin(Pinning pinning, unsigned int index) {
+#ifdef NJ_IPC_LINUX
+    if (pinning == Pinning::SPREAD) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(index % std::max(1u, std::thread::hardware_concurrency()), &cpus);
+        sched_setaffinity(0, sizeof(cpus), &cpus);
+    }
+#else
+    (void)pinning;
+    (void)index;
+#endif
+}
+
+template<size_t N>
+static void serve_c(nj_ipc_channel* ch, Pinning pinning, unsigned int index) {
+    Payload<N> request;
+    unsigned int lane;
+
+    pin(pinning, index);
+    for (;;) {
+        if (nj_ipc_lane_next(ch, &lane) != SUCCESS || nj_ipc_lane_read(ch, lane, &request, sizeof(request)) != SUCCESS) {
+            return;
+        }
+        nj_ipc_lane_reply(ch, lane, &request, sizeof(request));
+        if (request.stop) {
+            return;
+        }
+    }
+}
+
+template<size_t N>
+static void serve_cpp(NinjaIPC::Channel* ch, Pinning pinning, unsigned int index) {
+    unsigned int lane;
+
+    pin(pinning, index);
+    for (;;) {
+        Payload<N> request = ch->receive<Payload<N>>(lane);
+        ch->reply(lane, request);
+        if (request.stop) {
+            return;
+        }
+    }
+}
+
+/* Client processes exit from here, so nothing they opened is freed and unlinked under the server */
+template<size_t N>
+static void client_c(unsigned int clients, unsigned int requests, volatile uint32_t* start, uint64_t* latencies) {
+    nj_ipc_channel ch = nj_ipc_channel_open_lanes(bench_name, sizeof(Payload<N>), clients, NULL);
+    Payload<N> request = {}, reply;
+    unsigned int lane, i;
+
+    if (ch.status != SUCCESS || nj_ipc_lane_acquire(&ch, (unsigned int)getpid(), &lane) != SUCCESS) {
+        _exit(1);
+    }
+
+    while (!nj_ipc_atomic_load32(start)) {
+        nj_ipc_thread_yield();
+    }
+
+    for (i = 0; i < requests; i++) {
+        uint64_t sent = nj_ipc_clock_ns();
+
+        if (nj_ipc_lane_send(&ch, lane, &request, sizeof(request)) != SUCCESS
+            || nj_ipc_lane_wait_reply(&ch, lane) != SUCCESS
+            || nj_ipc_lane_read(&ch, lane, &reply, sizeof(reply)) != SUCCESS) {
+            _exit(1);
+        }
+        latencies[i] = nj_ipc_clock_ns() - sent;
+    }
+    nj_ipc_lane_release(&ch, lane);
+    _exit(0);
+}
+
+template<size_t N>
+static void client_cpp(unsigned int clients, unsigned int requests, volatile uint32_t* start, uint64_t* latencies) {
+    try {
+        auto ch = NinjaIPC::Channel::connect_lanes(bench_name, sizeof(Payload<N>), clients);
+        Payload<N> request = {};
+
+        while (!nj_ipc_atomic_load32(start)) {
+            nj_ipc_thread_yield();
+        }
+
+        {
+            auto lane = ch->lane();
+            for (unsigned int i = 0; i < requests; i++) {
+                uint64_t sent = nj_ipc_clock_ns();
+                lane.send(request);
+                latencies[i] = nj_ipc_clock_ns() - sent;
+            }
+        }
+        _exit(0);
+    } catch (...) {
+        _exit(1);
+    }
+}
+
+/* Each server thread leaves after answering one stop request */
+template<size_t N>
+static void stop_servers(unsigned int clients, unsigned int threads) {
+    nj_ipc_channel ch = nj_ipc_channel_open_lanes(bench_name, sizeof(Payload<N>), clients, NULL);
+    Payload<N> request = {}, reply;
+    unsigned int lane, i;
+
+    request.stop = 1;
+    while (nj_ipc_lane_acquire(&ch, 0, &lane) != SUCCESS) {
+        nj_ipc_thread_yield();
+    }
+    for (i = 0; i < threads; i++) {
+        nj_ipc_lane_send(&ch, lane, &request, sizeof(request));
+        nj_ipc_lane_wait_reply(&ch, lane);
+        nj_ipc_lane_read(&ch, lane, &reply, sizeof(reply));
+    }
+    nj_ipc_lane_release(&ch, lane);
+    nj_ipc_channel_close(&ch);
+}
+
+static double seconds(const struct timeval& time) {
+    return time.tv_sec + time.tv_usec / 1e6;
+}
+
+template<size_t N>
+static bool run(Api api, Pinning pinning, unsigned int clients, unsigned int threads, unsigned int requests) {
+    size_t total = (size_t)clients * requests;
+    nj_ipc_shmem samples = nj_ipc_shmem_create(samples_name, (unsigned int)(NJ_IPC_CACHE_LINE + total * sizeof(uint64_t)));
+    std::unique_ptr<NinjaIPC::Channel> cpp_server;
+    std::vector<std::thread> servers;
+    std::vector<pid_t> pids;
+    nj_ipc_channel c_server;
+    struct rusage self_before, children_before, self_after, children_after;
+    bool passed = true;
+    int status;
+
+    if (samples.status != SUCCESS) {
+        return false;
+    }
+
+    volatile uint32_t* start = (volatile uint32_t*)samples.view;
+    uint64_t* latencies = (uint64_t*)((char*)samples.view + NJ_IPC_CACHE_LINE);
+    *start = 0;
+
+    if (api == Api::C) {
+        c_server = nj_ipc_channel_create_lanes(bench_name, sizeof(Payload<N>), clients, NULL);
+        if (c_server.status != SUCCESS) {
+            nj_ipc_shmem_free(&samples);
+            return false;
+        }
+    } else {
+        cpp_server = NinjaIPC::Channel::make_lanes(bench_name, sizeof(Payload<N>), clients);
+    }
+
+    /* Clients are forked before any server thread exists */
+    for (unsigned int i = 0; i < clients; i++) {
+        pid_t pid = fork();
+
+        if (pid == 0) {
+            pin(pinning, threads + i);
+            if (api == Api::C) {
+                client_c<N>(clients, requests, start, latencies + (size_t)i * requests);
+            } else {
+                client_cpp<N>(clients, requests, start, latencies + (size_t)i * requests);
+            }
+        }
+        pids.push_back(pid);
+    }
+
+    for (unsigned int i = 0; i < threads; i++) {
+        if (api == Api::C) {
+            servers.emplace_back(serve_c<N>, &c_server, pinning, i);
+        } else {
+            servers.emplace_back(serve_cpp<N>, cpp_server.get(), pinning, i);
+        }
+    }
+
+    getrusage(RUSAGE_SELF, &self_before);
+    getrusage(RUSAGE_CHILDREN, &children_before);
+    uint64_t began = nj_ipc_clock_ns();
+    nj_ipc_atomic_store32(start, 1);
+
+    for (pid_t pid : pids) {
+        waitpid(pid, &status, 0);
+        passed = passed && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    double elapsed = (nj_ipc_clock_ns() - began) / 1e9;
+    getrusage(RUSAGE_SELF, &self_after);
+    getrusage(RUSAGE_CHILDREN, &children_after);
+
+    stop_servers<N>(clients, threads);
+    for (std::thread& server : servers) {
+        server.join();
+    }
+
+    if (passed) {
+        std::vector<uint64_t> sorted(latencies, latencies + total);
+        std::sort(sorted.begin(), sorted.end());
+        auto percentile = [&sorted](double q) {
+            return sorted[std::min(sorted.size() - 1, (size_t)(q * sorted.size()))] / 1e3;
+        };
+
+        double cpu = seconds(self_after.ru_utime) - seconds(self_before.ru_utime)
+                   + seconds(self_after.ru_stime) - seconds(self_before.ru_stime)
+                   + seconds(children_after.ru_utime) - seconds(children_before.ru_utime)
+                   + seconds(children_after.ru_stime) - seconds(children_before.ru_stime);
+        long voluntary = self_after.ru_nvcsw - self_before.ru_nvcsw + children_after.ru_nvcsw - children_before.ru_nvcsw;
+        long involuntary = self_after.ru_nivcsw - self_before.ru_nivcsw + children_after.ru_nivcsw - children_before.ru_nivcsw;
+
+        printf("%s,%zu,%u,%u,%s,%zu,%.0f,%.2f,%.2f,%.2f,%.2f,%ld,%ld,%.1f\n",
+               api == Api::C ? "c" : "cpp", N, clients, threads, pinning == Pinning::NONE ? "none" : "spread",
+               total, total / elapsed, percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999),
+               voluntary, involuntary, cpu / elapsed / std::max(1u, std::thread::hardware_concurrency()) * 100);
+        fflush(stdout);
+    }
+
+    if (api == Api::C) {
+        nj_ipc_channel_free(&c_server);
+    }
+    cpp_server.reset();
+    nj_ipc_shmem_free(&samples);
+    return passed;
+}
+
+/* 1, 2, 4, ... up to and including max */
+static std::vector<unsigned int> counts(unsigned int max) {
+    std::vector<unsigned int> values;
+
+    for (unsigned int value = 1; value < max; value *= 2) {
+        values.push_back(value);
+    }
+    values.push_back(max);
+    return values;
+}
+
+int main(int argc, char** argv) {
+    unsigned int max_clients = argc > 1 ? (unsigned int)atoi(argv[1]) : std::max(1u, std::thread::hardware_concurrency() / 2);
+    unsigned int max_threads = argc > 2 ? (unsigned int)atoi(argv[2]) : std::max(1u, std::thread::hardware_concurrency() / 2);
+    unsigned int requests = argc > 3 ? (unsigned int)atoi(argv[3]) : 20000;
+#ifdef NJ_IPC_LINUX
+    std::vector<Pinning> pinnings = { Pinning::NONE, Pinning::SPREAD };
+#else
+    std::vector<Pinning> pinnings = { Pinning::NONE };
+#endif
+
+    printf("api,payload_bytes,clients,server_threads,pinning,requests,throughput_rps,"
+           "p50_us,p90_us,p99_us,p999_us,voluntary_csw,involuntary_csw,cpu_util_percent\n");
+
+    for (Api api : { Api::C, Api::CPP }) {
+        for (Pinning pinning : pinnings) {
+            for (unsigned int clients : counts(std::max(1u, max_clients))) {
+                for (unsigned int threads : counts(std::max(1u, max_threads))) {
+                    if (!run<64>(api, pinning, clients, threads, requests)
+                        || !run<1024>(api, pinning, clients, threads, requests)
+                        || !run<16384>(api, pinning, clients, threads, requests)) {
+                        fprintf(stderr, "run with %u clients and %u server threads failed\n", clients, threads);
+                        return 1;
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
+#else
+int main() {
+    fprintf(stderr, "nj_ipc_bench_scaling forks its clients, POSIX only\n");
+    return 0;
+}
+#endif
@@ -0,0 +1,157 @@
+#include "../src/ninjaipc.h"
+#include <assert.h>
+#include <stdio.h>
+#ifdef NJ_IPC_POSIX
+#include <sys/wait.h>
+#endif
+
+void test_anon_fork() {
+#ifdef NJ_IPC_LINUX
+    int request, reply, status;
+    pid_t pid;
+
+    nj_ipc_channel ch = nj_ipc_channel_create_anon(64);
+    assert(ch.status == SUCCESS);
+    assert(ch.name == NULL && ch.shmem.name == NULL);
+
+    /* The child's copy of the channel is already connected */
+    pid = fork();
+    if (pid == 0) {
+        if (nj_ipc_channel_wait_client(&ch) != SUCCESS) _exit(1);
+        nj_ipc_channel_read(&ch, &request, sizeof(request));
+        reply = request + 1;
+        nj_ipc_channel_write(&ch, &reply, sizeof(reply));
+        nj_ipc_channel_notify_server(&ch);
+        _exit(0);
+    }
+
+    request = 41;
+    assert(nj_ipc_channel_write(&ch, &request, sizeof(request)) == SUCCESS);
+    assert(nj_ipc_channel_notify_client(&ch) == SUCCESS);
+    assert(nj_ipc_channel_wait_server(&ch) == SUCCESS);
+    assert(nj_ipc_channel_read(&ch, &reply, sizeof(reply)) == SUCCESS && reply == 42);
+
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    printf("Test for anonymous channels shared by fork passed.\n");
+
+    nj_ipc_channel_free(&ch);
+#endif
+}
+
+void test_anon_fd_passing() {
+#ifdef NJ_IPC_LINUX
+    int sockets[2], request, reply, status;
+    pid_t pid;
+
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+
+    /* The child is forked first, so it only gets the channel through the socket */
+    pid = fork();
+    if (pid == 0) {
+        close(sockets[0]);
+        nj_ipc_channel client = nj_ipc_channel_recv_fds(sockets[1]);
+        if (client.status != SUCCESS || client.capacity != 128) _exit(1);
+
+        request = 20;
+        nj_ipc_channel_write(&client, &request, sizeof(request));
+        nj_ipc_channel_notify_client(&client);
+        if (nj_ipc_channel_wait_server(&client) != SUCCESS) _exit(2);
+        nj_ipc_channel_read(&client, &reply, sizeof(reply));
+        nj_ipc_channel_free(&client);
+        _exit(reply == 40 ? 0 : 3);
+    }
+    close(sockets[1]);
+
+    nj_ipc_channel server = nj_ipc_channel_create_anon(128);
+    assert(server.status == SUCCESS);
+    assert(nj_ipc_channel_send_fds(&server, sockets[0]) == SUCCESS);
+
+    assert(nj_ipc_channel_wait_client(&server) == SUCCESS);
+    assert(nj_ipc_channel_read(&server, &request, sizeof(request)) == SUCCESS);
+    reply = request * 2;
+    assert(nj_ipc_channel_write(&server, &reply, sizeof(reply)) == SUCCESS);
+    assert(nj_ipc_channel_notify_server(&server) == SUCCESS);
+
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    /* Named channels can't be passed */
+    nj_ipc_channel named = nj_ipc_channel_create("test_anon_named", 64);
+    assert(named.status == SUCCESS);
+    assert(nj_ipc_channel_send_fds(&named, sockets[0]) != SUCCESS);
+    nj_ipc_channel_free(&named);
+
+    printf("Test for anonymous channels passed over a socket passed.\n");
+
+    close(sockets[0]);
+    nj_ipc_channel_free(&server);
+#endif
+}
+
+#ifdef NJ_IPC_LINUX
+static void send_rights(int socket, const int *fds, int count) {
+    char control[CMSG_SPACE(sizeof(int) * 4)];
+    char marker = 0;
+    struct iovec part;
+    struct msghdr message;
+    struct cmsghdr *header;
+
+    memset(&message, 0, sizeof(message));
+    memset(control, 0, sizeof(control));
+    part.iov_base = &marker;
+    part.iov_len = 1;
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+    header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    memcpy(CMSG_DATA(header), fds, sizeof(int) * count);
+    assert(sendmsg(socket, &message, 0) == 1);
+}
+#endif
+
+void test_anon_fd_passing_invalid() {
+#ifdef NJ_IPC_LINUX
+    int sockets[2], pipes[4], lowest;
+
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+    assert(pipe(pipes) == 0 && pipe(pipes + 2) == 0);
+
+    lowest = dup(pipes[0]);
+    close(lowest);
+
+    /* Too few descriptors, then too many for the control buffer: each received one is closed again */
+    send_rights(sockets[0], pipes, 1);
+    assert(nj_ipc_channel_recv_fds(sockets[1]).status == FD_RECV_FAIL);
+    assert(dup(pipes[0]) == lowest);
+    close(lowest);
+
+    send_rights(sockets[0], pipes, 4);
+    assert(nj_ipc_channel_recv_fds(sockets[1]).status == FD_RECV_FAIL);
+    assert(dup(pipes[0]) == lowest);
+    close(lowest);
+
+    printf("Test for rejected descriptor messages passed.\n");
+
+    close(pipes[0]);
+    close(pipes[1]);
+    close(pipes[2]);
+    close(pipes[3]);
+    close(sockets[0]);
+    close(sockets[1]);
+#endif
+}
+
+int main() {
+    test_anon_fork();
+    test_anon_fd_passing();
+    test_anon_fd_passing_invalid();
+    printf("All Anonymous Channel API tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,156 @@
+#include "../src/ninjaipc.h"
+#include <assert.h>
+#include <stdio.h>
+#ifdef NJ_IPC_POSIX
+#include <sys/wait.h>
+#endif
+
+void test_arena_create_open() {
+    nj_ipc_arena arena = nj_ipc_arena_create("test_arena", 64, 1000);
+    assert(arena.status == SUCCESS);
+
+    nj_ipc_arena other = nj_ipc_arena_open("test_arena", 64, 1000);
+    assert(other.status == SUCCESS);
+
+    nj_ipc_arena mismatch = nj_ipc_arena_open("test_arena", 128, 500);
+    assert(mismatch.status != SUCCESS);
+
+    /* A failed open leaves the segment to its creator */
+    nj_ipc_arena again = nj_ipc_arena_open("test_arena", 64, 1000);
+    assert(again.status == SUCCESS);
+
+    nj_ipc_arena invalid = nj_ipc_arena_create("test_arena_invalid", 64, 0);
+    assert(invalid.status == SHMEM_INVALID_SIZE);
+
+    printf("Test for create and open arenas passed.\n");
+
+    nj_ipc_arena_free(&again);
+    nj_ipc_arena_free(&other);
+    nj_ipc_arena_free(&arena);
+}
+
+void test_arena_directory() {
+    char name[32];
+    int i;
+
+    nj_ipc_arena arena = nj_ipc_arena_create("test_arena", 64, 8);
+    assert(arena.status == SUCCESS);
+
+    for (i = 0; i < 8; i++) {
+        sprintf(name, "channel_%d", i);
+        assert(nj_ipc_arena_channel_create(&arena, name).status == SUCCESS);
+    }
+    assert(arena.header->count == 8);
+    assert(nj_ipc_arena_channel_create(&arena, "channel_8").status == ARENA_FULL);
+    assert(nj_ipc_arena_channel_create(&arena, "channel_3").status == ARENA_CHANNEL_EXISTS);
+    assert(nj_ipc_arena_channel_open(&arena, "missing").status == ARENA_CHANNEL_NOT_FOUND);
+    assert(nj_ipc_arena_channel_create(&arena,
+        "a_channel_name_that_is_far_too_long_to_fit_into_a_directory_entry").status == INVALID_NAME);
+
+    /* Removed entries are reused, and lookups probe past them */
+    assert(nj_ipc_arena_channel_remove(&arena, "channel_3") == SUCCESS);
+    assert(nj_ipc_arena_channel_remove(&arena, "channel_3") == ARENA_CHANNEL_NOT_FOUND);
+    assert(nj_ipc_arena_channel_create(&arena, "channel_8").status == SUCCESS);
+
+    for (i = 0; i <= 8; i++) {
+        sprintf(name, "channel_%d", i);
+        assert(nj_ipc_arena_channel_open(&arena, name).status == (i == 3 ? ARENA_CHANNEL_NOT_FOUND : SUCCESS));
+    }
+
+    printf("Test for the arena directory passed.\n");
+
+    nj_ipc_arena_free(&arena);
+}
+
+void test_arena_round_trip() {
+#ifdef NJ_IPC_POSIX
+    int request, reply, i, status;
+    char name[32];
+    pid_t pid;
+
+    nj_ipc_arena arena = nj_ipc_arena_create("test_arena", 64, 256);
+    assert(arena.status == SUCCESS);
+
+    for (i = 0; i < 200; i++) {
+        sprintf(name, "channel_%d", i);
+        assert(nj_ipc_arena_channel_create(&arena, name).status == SUCCESS);
+    }
+
+    /* The server answers on every channel, the client talks to them in turn */
+    pid = fork();
+    if (pid == 0) {
+        nj_ipc_arena mine = nj_ipc_arena_open("test_arena", 64, 256);
+        nj_ipc_arena_channel ch;
+
+        for (i = 0; i < 200; i++) {
+            sprintf(name, "channel_%d", i);
+            ch = nj_ipc_arena_channel_open(&mine, name);
+            if (ch.status != SUCCESS) _exit(1);
+
+            nj_ipc_arena_channel_wait_client(&ch);
+            nj_ipc_arena_channel_read(&ch, &request, sizeof(request));
+            reply = request * 3;
+            nj_ipc_arena_channel_write(&ch, &reply, sizeof(reply));
+            nj_ipc_arena_channel_notify_server(&ch);
+        }
+        _exit(0);
+    }
+
+    for (i = 0; i < 200; i++) {
+        sprintf(name, "channel_%d", i);
+        nj_ipc_arena_channel ch = nj_ipc_arena_channel_open(&arena, name);
+        assert(ch.status == SUCCESS);
+
+        request = i;
+        assert(nj_ipc_arena_channel_write(&ch, &request, sizeof(request)) == SUCCESS);
+        assert(nj_ipc_arena_channel_notify_client(&ch) == SUCCESS);
+        assert(nj_ipc_arena_channel_wait_server(&ch) == SUCCESS);
+        assert(nj_ipc_arena_channel_read(&ch, &reply, sizeof(reply)) == SUCCESS);
+        assert(reply == i * 3);
+    }
+
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    printf("Test for round-trips on arena channels passed.\n");
+
+    nj_ipc_arena_free(&arena);
+#endif
+}
+
+void test_arena_dead_holder() {
+#ifdef NJ_IPC_POSIX
+    int status;
+    pid_t pid;
+
+    nj_ipc_arena arena = nj_ipc_arena_create("test_arena", 64, 8);
+    assert(arena.status == SUCCESS);
+
+    /* The child dies holding the directory lock */
+    pid = fork();
+    if (pid == 0) {
+        nj_ipc_arena mine = nj_ipc_arena_open("test_arena", 64, 8);
+        nj_ipc_spin_lock_owned(&mine.header->lock);
+        _exit(0);
+    }
+    waitpid(pid, &status, 0);
+    assert(arena.header->lock == (uint32_t)pid);
+
+    assert(nj_ipc_arena_channel_create(&arena, "channel").status == SUCCESS);
+    assert(arena.header->lock == 0);
+    assert(nj_ipc_arena_channel_open(&arena, "channel").status == SUCCESS);
+
+    printf("Test for a directory lock held by a dead process passed.\n");
+
+    nj_ipc_arena_free(&arena);
+#endif
+}
+
+int main() {
+    test_arena_create_open();
+    test_arena_directory();
+    test_arena_round_trip();
+    test_arena_dead_holder();
+    printf("All Arena API tests passed!\n");
+    return 0;
+}
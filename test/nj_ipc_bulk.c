@@ -0,0 +1,89 @@
+#include "../src/ninjaipc.h"
+#include <assert.h>
+#include <stdio.h>
+
+void test_bulk_invalid() {
+#ifdef NJ_IPC_LINUX
+    size_t size;
+    char byte = 0;
+
+    nj_ipc_channel small = nj_ipc_channel_create("test_bulk_small", 8);
+    assert(small.status == SUCCESS);
+
+    assert(nj_ipc_bulk_send(NULL, &byte, 1) == BULK_INVALID_OBJECT);
+    assert(nj_ipc_bulk_send(&small, NULL, 1) == BULK_INVALID_OBJECT);
+    assert(nj_ipc_bulk_send(&small, &byte, 1) == CHANNEL_WRITE_TOO_BIG);
+    assert(nj_ipc_bulk_wait(&small, &size) == BULK_INVALID_OBJECT);
+
+    printf("Test for bulk transfers on invalid channels passed.\n");
+
+    nj_ipc_channel_free(&small);
+#endif
+}
+
+void test_bulk_transfer() {
+#ifdef NJ_IPC_LINUX
+    size_t size = 16 << 20, received, i;
+    nj_ipc_error status;
+    int child_status;
+    char small[16];
+    pid_t pid;
+
+    nj_ipc_channel server = nj_ipc_channel_create("test_bulk", 64);
+    assert(server.status == SUCCESS);
+
+    /* The child sends twice and exits with what its sends returned */
+    pid = fork();
+    if (pid == 0) {
+        nj_ipc_channel client = nj_ipc_channel_open("test_bulk", 64);
+        unsigned char *payload = (unsigned char*)malloc(size);
+        nj_ipc_error first, second;
+
+        for (i = 0; i < size; i++) {
+            payload[i] = (unsigned char)(i * 7);
+        }
+
+        first = nj_ipc_bulk_send(&client, payload, size);
+        second = nj_ipc_bulk_send(&client, payload, size);
+        _exit(first == SUCCESS && second == BULK_TOO_BIG ? 0 : first == BULK_ACCESS_DENIED ? 2 : 1);
+    }
+
+    unsigned char *buffer = (unsigned char*)malloc(size);
+
+    assert(nj_ipc_bulk_wait(&server, &received) == SUCCESS);
+    assert(received == size);
+    status = nj_ipc_bulk_accept(&server, buffer, size);
+
+    /* Hardened hosts may forbid reading another process, the sender still gets released */
+    assert(status == SUCCESS || status == BULK_ACCESS_DENIED);
+    if (status == SUCCESS) {
+        for (i = 0; i < size; i++) {
+            assert(buffer[i] == (unsigned char)(i * 7));
+        }
+    }
+
+    assert(nj_ipc_bulk_wait(&server, &received) == SUCCESS);
+    assert(nj_ipc_bulk_accept(&server, small, sizeof(small)) == BULK_TOO_BIG);
+
+    waitpid(pid, &child_status, 0);
+    assert(WIFEXITED(child_status));
+
+    if (status == SUCCESS) {
+        assert(WEXITSTATUS(child_status) == 0);
+        printf("Test for bulk transfers between processes passed.\n");
+    } else {
+        assert(WEXITSTATUS(child_status) == 2);
+        printf("Test for bulk transfers between processes skipped, access denied.\n");
+    }
+
+    free(buffer);
+    nj_ipc_channel_free(&server);
+#endif
+}
+
+int main() {
+    test_bulk_invalid();
+    test_bulk_transfer();
+    printf("All Bulk API tests passed!\n");
+    return 0;
+}
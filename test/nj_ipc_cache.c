@@ -0,0 +1,71 @@
+#include "../src/ninjaipc.h"
+#include <assert.h>
+#include <stdio.h>
+
+void test_cache_channel() {
+    nj_ipc_error err;
+    int request = 7, read;
+
+    nj_ipc_channel server = nj_ipc_channel_create("test_cache", 64);
+    assert(server.status == SUCCESS);
+
+    nj_ipc_channel *first = nj_ipc_channel_acquire("test_cache", 64, &err);
+    assert(first && err == SUCCESS);
+    nj_ipc_channel *second = nj_ipc_channel_acquire("test_cache", 64, &err);
+    assert(second == first);
+
+    assert(nj_ipc_channel_acquire("test_cache", 128, &err) == NULL && err == CACHE_SIZE_MISMATCH);
+    assert(nj_ipc_channel_acquire("test_cache_missing", 64, &err) == NULL && err != SUCCESS);
+
+    /* The cached channel talks to the server like a freshly opened one */
+    assert(nj_ipc_channel_write(first, &request, sizeof(request)) == SUCCESS);
+    assert(nj_ipc_channel_notify_client(first) == SUCCESS);
+    assert(nj_ipc_channel_wait_client(&server) == SUCCESS);
+    assert(nj_ipc_channel_read(&server, &read, sizeof(read)) == SUCCESS && read == 7);
+
+    nj_ipc_channel_release(second);
+    assert(nj_ipc_cache_flush() == 1);
+    nj_ipc_channel_release(first);
+
+    /* Released entries stay open until flushed */
+    assert(nj_ipc_channel_acquire("test_cache", 64, NULL) == first);
+    nj_ipc_channel_release(first);
+    assert(nj_ipc_cache_flush() == 0);
+
+    /* Flushing closes without unlinking, the server's channel can still be opened */
+    nj_ipc_channel other = nj_ipc_channel_open("test_cache", 64);
+    assert(other.status == SUCCESS);
+    nj_ipc_channel_close(&other);
+
+    printf("Test for cached channels passed.\n");
+
+    nj_ipc_channel_free(&server);
+}
+
+void test_cache_shmem() {
+    nj_ipc_error err;
+
+    nj_ipc_shmem owner = nj_ipc_shmem_create("test_cache_shmem", 4096);
+    assert(owner.status == SUCCESS);
+    ((char*)owner.view)[0] = 'x';
+
+    nj_ipc_shmem *first = nj_ipc_shmem_acquire("test_cache_shmem", 4096, &err);
+    assert(first && err == SUCCESS && ((char*)first->view)[0] == 'x');
+    nj_ipc_shmem *second = nj_ipc_shmem_acquire("test_cache_shmem", 4096, &err);
+    assert(second == first);
+
+    nj_ipc_shmem_release(first);
+    nj_ipc_shmem_release(second);
+    assert(nj_ipc_cache_flush() == 0);
+
+    printf("Test for cached segments passed.\n");
+
+    nj_ipc_shmem_free(&owner);
+}
+
+int main() {
+    test_cache_channel();
+    test_cache_shmem();
+    printf("All Handle Cache API tests passed!\n");
+    return 0;
+}
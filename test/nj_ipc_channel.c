@@ -10,6 +10,11 @@ void test_channel_create_open() {
     nj_ipc_channel ch2 = nj_ipc_channel_open("test_channel", 1024);
     assert(ch2.status == SUCCESS);
 
+    /* A client may map less than the creator did */
+    nj_ipc_channel ch3 = nj_ipc_channel_open("test_channel", 64);
+    assert(ch3.status == SUCCESS && ch3.shmem.view_size == 64);
+    nj_ipc_channel_close(&ch3);
+
     printf("Test for create and open IPC channels passed.\n");
 
     nj_ipc_channel_free(&ch1);
@@ -40,6 +45,40 @@ void test_channel_write_read() {
     nj_ipc_channel_free(&ch2);
 }
 
+void test_channel_writev() {
+    char buffer[32];
+    const char header[] = "HDR:";
+    const char body[] = "payload";
+    const char trailer[] = ":END";
+    nj_ipc_iovec parts[3] = {
+        { header, sizeof(header) - 1 },
+        { body, sizeof(body) - 1 },
+        { trailer, sizeof(trailer) },
+    };
+
+    nj_ipc_channel ch1 = nj_ipc_channel_create("test_channel", 32);
+    assert(ch1.status == SUCCESS);
+
+    nj_ipc_error err = nj_ipc_channel_writev(&ch1, parts, 3);
+    assert(err == SUCCESS);
+
+    nj_ipc_channel ch2 = nj_ipc_channel_open("test_channel", 32);
+    assert(ch2.status == SUCCESS);
+
+    err = nj_ipc_channel_read(&ch2, buffer, sizeof("HDR:payload:END"));
+    assert(err == SUCCESS);
+    assert(strcmp(buffer, "HDR:payload:END") == 0);
+
+    nj_ipc_iovec too_big[2] = { { buffer, 20 }, { buffer, 20 } };
+    err = nj_ipc_channel_writev(&ch1, too_big, 2);
+    assert(err == CHANNEL_WRITE_TOO_BIG);
+
+    printf("Test for scatter-gather write IPC channels passed.\n");
+
+    nj_ipc_channel_free(&ch1);
+    nj_ipc_channel_free(&ch2);
+}
+
 void test_channel_wait_notify() {
     nj_ipc_channel ch1 = nj_ipc_channel_create("test_channel", 1024);
     assert(ch1.status == SUCCESS);
@@ -59,10 +98,39 @@ void test_channel_wait_notify() {
     nj_ipc_channel_free(&ch2);
 }
 
+void test_channel_invalidate() {
+    nj_ipc_channel ch1 = nj_ipc_channel_create("test_channel", 100);
+    assert(ch1.status == SUCCESS);
+
+    nj_ipc_channel ch2 = nj_ipc_channel_open("test_channel", 100);
+    assert(ch2.status == SUCCESS);
+
+    /* The generation lives in a side segment, the channel segment keeps its size */
+    assert(ch1.shmem.view_size == 100);
+    assert(nj_ipc_channel_generation(&ch2) == 0);
+    assert(nj_ipc_channel_generation_attach(&ch2) == SUCCESS);
+    assert(nj_ipc_channel_generation(&ch2) == 0);
+
+    assert(nj_ipc_channel_invalidate(&ch1) == SUCCESS);
+    assert(nj_ipc_channel_invalidate(&ch1) == SUCCESS);
+    assert(nj_ipc_channel_generation(&ch2) == 2);
+    assert(nj_ipc_channel_generation(&ch1) == 2);
+
+    assert(nj_ipc_channel_invalidate(NULL) == CHANNEL_WRITE_INVALID_SHMEM);
+    assert(nj_ipc_channel_generation(NULL) == 0);
+
+    printf("Test for invalidating cached replies on IPC channels passed.\n");
+
+    nj_ipc_channel_free(&ch1);
+    nj_ipc_channel_free(&ch2);
+}
+
 int main() {
     test_channel_create_open();
     test_channel_write_read();
+    test_channel_writev();
     test_channel_wait_notify();
+    test_channel_invalidate();
     printf("All High-Level IPC API tests passed!\n");
     return 0;
 }
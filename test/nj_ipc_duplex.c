@@ -0,0 +1,128 @@
+#include "../src/ninjaipc.h"
+#include <assert.h>
+#include <stdio.h>
+#ifdef NJ_IPC_POSIX
+#include <sys/wait.h>
+#endif
+
+void test_duplex_create_open() {
+    nj_ipc_channel server = nj_ipc_channel_create_duplex("test_duplex", 64, NULL);
+    assert(server.status == SUCCESS);
+
+    nj_ipc_channel client = nj_ipc_channel_open_duplex("test_duplex", 64, NULL);
+    assert(client.status == SUCCESS);
+
+    nj_ipc_channel mismatch = nj_ipc_channel_open_duplex("test_duplex", 128, NULL);
+    assert(mismatch.status != SUCCESS);
+
+    /* A failed open leaves the channel to its creator */
+    nj_ipc_channel again = nj_ipc_channel_open_duplex("test_duplex", 64, NULL);
+    assert(again.status == SUCCESS);
+    nj_ipc_channel_close(&again);
+
+    nj_ipc_channel plain = nj_ipc_channel_create("test_duplex_plain", 1024);
+    assert(plain.status == SUCCESS);
+    assert(nj_ipc_duplex_send(&plain, "x", 1) == DUPLEX_INVALID_CHANNEL);
+
+    /* A plain channel of the same size maps fine but isn't duplex */
+    nj_ipc_channel sized = nj_ipc_channel_create("test_duplex_sized", (unsigned int)nj_ipc_duplex_segment_size(64));
+    assert(sized.status == SUCCESS);
+    assert(nj_ipc_channel_open_duplex("test_duplex_sized", 64, NULL).status == DUPLEX_INVALID_CHANNEL);
+    again = nj_ipc_channel_open("test_duplex_sized", (unsigned int)nj_ipc_duplex_segment_size(64));
+    assert(again.status == SUCCESS);
+    nj_ipc_channel_close(&again);
+
+    printf("Test for create and open duplex channels passed.\n");
+
+    nj_ipc_channel_free(&sized);
+    nj_ipc_channel_free(&plain);
+    nj_ipc_channel_free(&client);
+    nj_ipc_channel_free(&server);
+}
+
+void test_duplex_both_directions() {
+    char buffer[64], big[65] = { 0 };
+    size_t size;
+
+    nj_ipc_channel server = nj_ipc_channel_create_duplex("test_duplex", 64, NULL);
+    assert(server.status == SUCCESS);
+    nj_ipc_channel client = nj_ipc_channel_open_duplex("test_duplex", 64, NULL);
+    assert(client.status == SUCCESS);
+
+    /* Both sides have a message in flight at once, neither overwrites the other */
+    assert(nj_ipc_duplex_send(&client, "request", 8) == SUCCESS);
+    assert(nj_ipc_duplex_send(&server, "event", 6) == SUCCESS);
+
+    assert(nj_ipc_duplex_recv(&server, buffer, sizeof(buffer), &size) == SUCCESS);
+    assert(size == 8 && strcmp(buffer, "request") == 0);
+    assert(nj_ipc_duplex_recv(&client, buffer, sizeof(buffer), &size) == SUCCESS);
+    assert(size == 6 && strcmp(buffer, "event") == 0);
+
+    /* Oversized messages are refused by the sender, or dropped by a receiver with a small buffer */
+    assert(nj_ipc_duplex_send(&client, big, sizeof(big)) == CHANNEL_WRITE_TOO_BIG);
+    assert(nj_ipc_duplex_send(&client, big, 64) == SUCCESS);
+    assert(nj_ipc_duplex_recv(&server, buffer, 8, &size) == CHANNEL_READ_TOO_BIG);
+    assert(size == 64);
+    assert(nj_ipc_duplex_send(&client, "next", 5) == SUCCESS);
+    assert(nj_ipc_duplex_recv(&server, buffer, sizeof(buffer), &size) == SUCCESS);
+    assert(strcmp(buffer, "next") == 0);
+
+    printf("Test for messages in both directions passed.\n");
+
+    nj_ipc_channel_free(&client);
+    nj_ipc_channel_free(&server);
+}
+
+void test_duplex_multi_process() {
+#ifdef NJ_IPC_POSIX
+    int process, i, value, status;
+    pid_t pids[3];
+
+    nj_ipc_channel server = nj_ipc_channel_create_duplex("test_duplex", 64, NULL);
+    assert(server.status == SUCCESS);
+
+    /* One process sends each way and one receives each way, all at the same time */
+    for (process = 0; process < 3; process++) {
+        pids[process] = fork();
+        if (pids[process] != 0) {
+            continue;
+        }
+
+        /* 0 sends as the client, 1 receives as the client, 2 sends as the server */
+        nj_ipc_channel ch = nj_ipc_channel_open_duplex("test_duplex", 64, NULL);
+        if (ch.status != SUCCESS) _exit(1);
+        if (process == 2) ch.role = NJ_IPC_CHANNEL_SERVER;
+
+        for (i = 0; i < 5000; i++) {
+            if (process == 1) {
+                if (nj_ipc_duplex_recv(&ch, &value, sizeof(value), NULL) != SUCCESS || value != i) _exit(2);
+            } else if (nj_ipc_duplex_send(&ch, &i, sizeof(i)) != SUCCESS) {
+                _exit(3);
+            }
+        }
+        _exit(0);
+    }
+
+    for (i = 0; i < 5000; i++) {
+        assert(nj_ipc_duplex_recv(&server, &value, sizeof(value), NULL) == SUCCESS);
+        assert(value == i);
+    }
+
+    for (process = 0; process < 3; process++) {
+        waitpid(pids[process], &status, 0);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    printf("Test for duplex channels used from several processes passed.\n");
+
+    nj_ipc_channel_free(&server);
+#endif
+}
+
+int main() {
+    test_duplex_create_open();
+    test_duplex_both_directions();
+    test_duplex_multi_process();
+    printf("All Duplex API tests passed!\n");
+    return 0;
+}
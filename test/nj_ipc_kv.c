@@ -0,0 +1,179 @@
+#include "../src/ninjaipc.h"
+#include <assert.h>
+#include <stdio.h>
+#ifdef NJ_IPC_POSIX
+#include <sys/wait.h>
+#endif
+
+typedef struct {
+    int id;
+    char label[12];
+} test_value;
+
+void test_kv_create_open() {
+    nj_ipc_kv kv = nj_ipc_kv_create("test_kv", sizeof(int), sizeof(test_value), 100);
+    assert(kv.status == SUCCESS);
+    assert(kv.header->capacity == 128);
+
+    nj_ipc_kv other = nj_ipc_kv_open("test_kv", sizeof(int), sizeof(test_value), 100);
+    assert(other.status == SUCCESS);
+
+    nj_ipc_kv mismatch = nj_ipc_kv_open("test_kv", sizeof(int), sizeof(int), 100);
+    assert(mismatch.status == KV_INVALID_LAYOUT);
+
+    /* A failed open leaves the segment to its creator */
+    nj_ipc_kv again = nj_ipc_kv_open("test_kv", sizeof(int), sizeof(test_value), 100);
+    assert(again.status == SUCCESS);
+
+    nj_ipc_kv invalid = nj_ipc_kv_create("test_kv_invalid", 0, sizeof(int), 100);
+    assert(invalid.status == SHMEM_INVALID_SIZE);
+
+    printf("Test for create and open key-value stores passed.\n");
+
+    nj_ipc_kv_free(&again);
+    nj_ipc_kv_free(&other);
+    nj_ipc_kv_free(&kv);
+}
+
+void test_kv_put_get_remove() {
+    test_value value = { 1, "one" }, read;
+    int key = 1, missing = 2;
+
+    nj_ipc_kv kv = nj_ipc_kv_create("test_kv", sizeof(int), sizeof(test_value), 16);
+    assert(kv.status == SUCCESS);
+    nj_ipc_kv other = nj_ipc_kv_open("test_kv", sizeof(int), sizeof(test_value), 16);
+    assert(other.status == SUCCESS);
+
+    assert(nj_ipc_kv_put(&kv, &key, &value) == SUCCESS);
+    assert(nj_ipc_kv_get(&other, &key, &read) == SUCCESS);
+    assert(read.id == 1 && strcmp(read.label, "one") == 0);
+    assert(nj_ipc_kv_get(&other, &missing, &read) == KV_NOT_FOUND);
+
+    value.id = 11;
+    assert(nj_ipc_kv_put(&kv, &key, &value) == SUCCESS);
+    assert(nj_ipc_kv_count(&other) == 1);
+    assert(nj_ipc_kv_get(&other, &key, &read) == SUCCESS && read.id == 11);
+
+    assert(nj_ipc_kv_remove(&other, &key) == SUCCESS);
+    assert(nj_ipc_kv_remove(&other, &key) == KV_NOT_FOUND);
+    assert(nj_ipc_kv_get(&kv, &key, NULL) == KV_NOT_FOUND);
+    assert(nj_ipc_kv_count(&kv) == 0);
+
+    printf("Test for put, get and remove passed.\n");
+
+    nj_ipc_kv_free(&other);
+    nj_ipc_kv_free(&kv);
+}
+
+void test_kv_full_and_tombstones() {
+    int key, value;
+
+    nj_ipc_kv kv = nj_ipc_kv_create("test_kv", sizeof(int), sizeof(int), 8);
+    assert(kv.status == SUCCESS);
+
+    for (key = 0; key < 8; key++) {
+        value = key * 10;
+        assert(nj_ipc_kv_put(&kv, &key, &value) == SUCCESS);
+    }
+    assert(nj_ipc_kv_put(&kv, &key, &value) == KV_FULL);
+
+    /* Removed buckets are reused, and lookups probe past them */
+    key = 3;
+    assert(nj_ipc_kv_remove(&kv, &key) == SUCCESS);
+    key = 8;
+    assert(nj_ipc_kv_put(&kv, &key, &value) == SUCCESS);
+
+    for (key = 0; key <= 8; key++) {
+        assert(nj_ipc_kv_get(&kv, &key, &value) == (key == 3 ? KV_NOT_FOUND : SUCCESS));
+    }
+
+    printf("Test for full store and removed buckets passed.\n");
+
+    nj_ipc_kv_free(&kv);
+}
+
+void test_kv_concurrent_writers() {
+#ifdef NJ_IPC_POSIX
+    int key, value, child;
+    pid_t pids[2];
+
+    nj_ipc_kv kv = nj_ipc_kv_create("test_kv", sizeof(int), sizeof(int), 4096);
+    assert(kv.status == SUCCESS);
+
+    for (child = 0; child < 2; child++) {
+        pids[child] = fork();
+        if (pids[child] == 0) {
+            nj_ipc_kv mine = nj_ipc_kv_open("test_kv", sizeof(int), sizeof(int), 4096);
+            for (key = 0; key < 2000; key++) {
+                value = key + child;
+                if (nj_ipc_kv_put(&mine, &key, &value) != SUCCESS) _exit(1);
+            }
+            _exit(0);
+        }
+    }
+
+    for (child = 0; child < 2; child++) {
+        int status;
+        waitpid(pids[child], &status, 0);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    /* Both processes wrote every key, each key must exist once with either value */
+    assert(nj_ipc_kv_count(&kv) == 2000);
+    for (key = 0; key < 2000; key++) {
+        assert(nj_ipc_kv_get(&kv, &key, &value) == SUCCESS);
+        assert(value == key || value == key + 1);
+    }
+
+    printf("Test for concurrent writers passed.\n");
+
+    nj_ipc_kv_free(&kv);
+#endif
+}
+
+void test_kv_dead_writer() {
+#ifdef NJ_IPC_POSIX
+    int key = 7, value = 70, status;
+    uint32_t tag;
+    pid_t pid;
+
+    nj_ipc_kv kv = nj_ipc_kv_create("test_kv", sizeof(int), sizeof(int), 16);
+    assert(kv.status == SUCCESS);
+    assert(nj_ipc_kv_put(&kv, &key, &value) == SUCCESS);
+    tag = nj_ipc_kv_hash(&key, sizeof(int));
+
+    /* The child dies in the middle of replacing the value, holding the stripe and the bucket */
+    pid = fork();
+    if (pid == 0) {
+        nj_ipc_kv mine = nj_ipc_kv_open("test_kv", sizeof(int), sizeof(int), 16);
+        nj_ipc_spin_lock_owned(&mine.header->stripes[(tag & 15) % NJ_IPC_KV_STRIPES]);
+        nj_ipc_kv_bucket_lock(&mine, nj_ipc_kv_bucket(&mine, tag & 15));
+        _exit(0);
+    }
+    waitpid(pid, &status, 0);
+
+    /* Readers give up on the half-written key instead of spinning */
+    assert(nj_ipc_kv_get(&kv, &key, &value) == KV_NOT_FOUND);
+    assert(nj_ipc_kv_count(&kv) == 0);
+
+    /* Writers take the stripe over */
+    value = 71;
+    assert(nj_ipc_kv_put(&kv, &key, &value) == SUCCESS);
+    assert(nj_ipc_kv_get(&kv, &key, &value) == SUCCESS && value == 71);
+    assert(nj_ipc_kv_count(&kv) == 1);
+
+    printf("Test for writers that died mid-write passed.\n");
+
+    nj_ipc_kv_free(&kv);
+#endif
+}
+
+int main() {
+    test_kv_create_open();
+    test_kv_put_get_remove();
+    test_kv_full_and_tombstones();
+    test_kv_concurrent_writers();
+    test_kv_dead_writer();
+    printf("All Key-Value API tests passed!\n");
+    return 0;
+}
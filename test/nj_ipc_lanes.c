@@ -0,0 +1,122 @@
+#include "../src/ninjaipc.h"
+#include <assert.h>
+#include <stdio.h>
+#ifdef NJ_IPC_POSIX
+#include <sys/wait.h>
+#endif
+
+void test_lanes_create_open() {
+    nj_ipc_channel server = nj_ipc_channel_create_lanes("test_lanes", 64, 4, NULL);
+    assert(server.status == SUCCESS);
+    assert(server.lane_count == 4);
+
+    nj_ipc_channel client = nj_ipc_channel_open_lanes("test_lanes", 64, 4, NULL);
+    assert(client.status == SUCCESS);
+
+    nj_ipc_channel mismatch = nj_ipc_channel_open_lanes("test_lanes", 64, 8, NULL);
+    assert(mismatch.status != SUCCESS);
+
+    /* A failed open leaves the server's names in place */
+    nj_ipc_channel again = nj_ipc_channel_open_lanes("test_lanes", 64, 4, NULL);
+    assert(again.status == SUCCESS);
+    nj_ipc_channel_close(&again);
+
+    nj_ipc_channel invalid = nj_ipc_channel_create_lanes("test_lanes_invalid", 64, 0, NULL);
+    assert(invalid.status == SHMEM_INVALID_SIZE);
+
+    printf("Test for create and open lane channels passed.\n");
+
+    nj_ipc_channel_free(&client);
+    nj_ipc_channel_free(&server);
+}
+
+void test_lanes_acquire_release() {
+    unsigned int lanes[4], extra, i;
+
+    nj_ipc_channel server = nj_ipc_channel_create_lanes("test_lanes", 64, 4, NULL);
+    assert(server.status == SUCCESS);
+    nj_ipc_channel client = nj_ipc_channel_open_lanes("test_lanes", 64, 4, NULL);
+    assert(client.status == SUCCESS);
+
+    for (i = 0; i < 4; i++) {
+        assert(nj_ipc_lane_acquire(&client, 1, &lanes[i]) == SUCCESS);
+    }
+    assert(lanes[0] == 1);
+    assert(nj_ipc_lane_acquire(&client, 0, &extra) == LANE_BUSY);
+
+    assert(nj_ipc_lane_release(&client, lanes[2]) == SUCCESS);
+    assert(nj_ipc_lane_acquire(&client, 0, &extra) == SUCCESS);
+    assert(extra == lanes[2]);
+
+    assert(nj_ipc_lane_release(&client, 4) == LANE_INVALID);
+
+#ifdef NJ_IPC_POSIX
+    /* Every lane is taken again, a waiting acquire sleeps until the child releases one */
+    pid_t pid = fork();
+    if (pid == 0) {
+        nj_ipc_clock_sleep(50000000ull);
+        _exit(nj_ipc_lane_release(&client, lanes[0]) == SUCCESS ? 0 : 1);
+    }
+
+    assert(nj_ipc_lane_acquire_wait(&client, 2, &extra) == SUCCESS);
+    assert(extra == lanes[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+#endif
+
+    printf("Test for acquire and release lanes passed.\n");
+
+    nj_ipc_channel_free(&client);
+    nj_ipc_channel_free(&server);
+}
+
+void test_lanes_in_flight() {
+    unsigned int a, b, served, i;
+    int request, reply;
+    char big[65] = { 0 };
+
+    nj_ipc_channel server = nj_ipc_channel_create_lanes("test_lanes", 64, 4, NULL);
+    assert(server.status == SUCCESS);
+    nj_ipc_channel client = nj_ipc_channel_open_lanes("test_lanes", 64, 4, NULL);
+    assert(client.status == SUCCESS);
+
+    assert(nj_ipc_lane_acquire(&client, 0, &a) == SUCCESS);
+    assert(nj_ipc_lane_acquire(&client, 0, &b) == SUCCESS);
+
+    /* Two requests in flight at once */
+    request = 10;
+    assert(nj_ipc_lane_send(&client, a, &request, sizeof(request)) == SUCCESS);
+    request = 20;
+    assert(nj_ipc_lane_send(&client, b, &request, sizeof(request)) == SUCCESS);
+    assert(nj_ipc_lane_send(&client, b, big, sizeof(big)) == LANE_TOO_BIG);
+
+    for (i = 0; i < 2; i++) {
+        assert(nj_ipc_lane_next(&server, &served) == SUCCESS);
+        assert(nj_ipc_lane_read(&server, served, &request, sizeof(request)) == SUCCESS);
+        reply = request + 1;
+        assert(nj_ipc_lane_reply(&server, served, &reply, sizeof(reply)) == SUCCESS);
+    }
+
+    assert(nj_ipc_lane_wait_reply(&client, b) == SUCCESS);
+    assert(nj_ipc_lane_read(&client, b, &reply, sizeof(reply)) == SUCCESS);
+    assert(reply == 21);
+
+    assert(nj_ipc_lane_wait_reply(&client, a) == SUCCESS);
+    assert(nj_ipc_lane_read(&client, a, &reply, sizeof(reply)) == SUCCESS);
+    assert(reply == 11);
+
+    printf("Test for requests in flight on several lanes passed.\n");
+
+    nj_ipc_channel_free(&client);
+    nj_ipc_channel_free(&server);
+}
+
+int main() {
+    test_lanes_create_open();
+    test_lanes_acquire_release();
+    test_lanes_in_flight();
+    printf("All Lane API tests passed!\n");
+    return 0;
+}
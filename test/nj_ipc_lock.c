@@ -0,0 +1,177 @@
+#include "../src/ninjaipc.h"
+#include <assert.h>
+#include <stdio.h>
+#ifdef NJ_IPC_POSIX
+#include <sys/wait.h>
+#endif
+
+typedef struct {
+    nj_ipc_mutex mutex;
+    nj_ipc_rwlock rwlock;
+    volatile long long first;
+    volatile long long second;
+} test_shared;
+
+void test_mutex_lock_unlock() {
+    nj_ipc_shmem shmem = nj_ipc_shmem_create("test_lock", sizeof(test_shared));
+    assert(shmem.status == SUCCESS);
+    test_shared *shared = (test_shared*)shmem.view;
+
+    assert(nj_ipc_mutex_lock(&shared->mutex) == SUCCESS);
+    assert(nj_ipc_mutex_owner(&shared->mutex) == nj_ipc_process_id());
+    assert(nj_ipc_mutex_try_lock(&shared->mutex) == LOCK_BUSY);
+    assert(nj_ipc_mutex_unlock(&shared->mutex) == SUCCESS);
+    assert(nj_ipc_mutex_try_lock(&shared->mutex) == SUCCESS);
+    assert(nj_ipc_mutex_unlock(&shared->mutex) == SUCCESS);
+    assert(shared->mutex.owner == 0);
+    assert(nj_ipc_mutex_unlock(&shared->mutex) == LOCK_INVALID_OBJECT);
+
+    /* Only the holder releases, whether or not someone sleeps on it */
+    shared->mutex.owner = nj_ipc_process_id() + 1;
+    assert(nj_ipc_mutex_unlock(&shared->mutex) == LOCK_INVALID_OBJECT);
+    shared->mutex.owner = (nj_ipc_process_id() + 1) | NJ_IPC_MUTEX_WAITERS;
+    assert(nj_ipc_mutex_unlock(&shared->mutex) == LOCK_INVALID_OBJECT);
+    assert(shared->mutex.owner == ((nj_ipc_process_id() + 1) | NJ_IPC_MUTEX_WAITERS));
+    shared->mutex.owner = nj_ipc_process_id() | NJ_IPC_MUTEX_WAITERS;
+    assert(nj_ipc_mutex_unlock(&shared->mutex) == SUCCESS);
+    assert(shared->mutex.owner == 0);
+
+    assert(nj_ipc_mutex_lock(NULL) == LOCK_INVALID_OBJECT);
+
+    printf("Test for mutex lock and unlock passed.\n");
+
+    nj_ipc_shmem_free(&shmem);
+}
+
+void test_rwlock_lock_unlock() {
+    nj_ipc_shmem shmem = nj_ipc_shmem_create("test_lock", sizeof(test_shared));
+    assert(shmem.status == SUCCESS);
+    test_shared *shared = (test_shared*)shmem.view;
+
+    assert(nj_ipc_rwlock_lock_shared(&shared->rwlock) == SUCCESS);
+    assert(nj_ipc_rwlock_try_lock_shared(&shared->rwlock) == SUCCESS);
+    assert(nj_ipc_rwlock_try_lock(&shared->rwlock) == LOCK_BUSY);
+    assert(nj_ipc_rwlock_unlock_shared(&shared->rwlock) == SUCCESS);
+    assert(nj_ipc_rwlock_unlock_shared(&shared->rwlock) == SUCCESS);
+    assert(nj_ipc_rwlock_unlock_shared(&shared->rwlock) == LOCK_INVALID_OBJECT);
+
+    assert(nj_ipc_rwlock_try_lock(&shared->rwlock) == SUCCESS);
+    assert(nj_ipc_rwlock_try_lock_shared(&shared->rwlock) == LOCK_BUSY);
+    assert(nj_ipc_rwlock_unlock(&shared->rwlock) == SUCCESS);
+    assert(nj_ipc_rwlock_lock(&shared->rwlock) == SUCCESS);
+    assert(nj_ipc_rwlock_unlock(&shared->rwlock) == SUCCESS);
+    assert(nj_ipc_rwlock_unlock(&shared->rwlock) == LOCK_INVALID_OBJECT);
+
+    printf("Test for reader/writer lock and unlock passed.\n");
+
+    nj_ipc_shmem_free(&shmem);
+}
+
+void test_locks_multi_process() {
+#ifdef NJ_IPC_POSIX
+    int process, i, status;
+    pid_t pids[4];
+
+    nj_ipc_shmem shmem = nj_ipc_shmem_create("test_lock", sizeof(test_shared));
+    assert(shmem.status == SUCCESS);
+    test_shared *shared = (test_shared*)shmem.view;
+
+    /* Two processes increment under the mutex, two update a pair under the rwlock that readers check */
+    for (process = 0; process < 4; process++) {
+        pids[process] = fork();
+        if (pids[process] != 0) {
+            continue;
+        }
+
+        for (i = 0; i < 20000; i++) {
+            if (process < 2) {
+                if (nj_ipc_mutex_lock(&shared->mutex) != SUCCESS) _exit(1);
+                shared->first = shared->first + 1;
+                nj_ipc_mutex_unlock(&shared->mutex);
+            } else if (i % 4 == 0) {
+                if (nj_ipc_rwlock_lock(&shared->rwlock) != SUCCESS) _exit(1);
+                shared->second = shared->second + 1;
+                shared->second = shared->second + 1;
+                nj_ipc_rwlock_unlock(&shared->rwlock);
+            } else {
+                if (nj_ipc_rwlock_lock_shared(&shared->rwlock) != SUCCESS) _exit(1);
+                if (shared->second % 2 != 0) _exit(2);
+                nj_ipc_rwlock_unlock_shared(&shared->rwlock);
+            }
+        }
+        _exit(0);
+    }
+
+    for (process = 0; process < 4; process++) {
+        waitpid(pids[process], &status, 0);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    assert(shared->first == 40000);
+    assert(shared->second == 20000);
+
+    printf("Test for locks shared by several processes passed.\n");
+
+    nj_ipc_shmem_free(&shmem);
+#endif
+}
+
+void test_locks_dead_holder() {
+#ifdef NJ_IPC_POSIX
+    int status;
+    pid_t pid;
+
+    nj_ipc_shmem shmem = nj_ipc_shmem_create("test_lock", sizeof(test_shared));
+    assert(shmem.status == SUCCESS);
+    test_shared *shared = (test_shared*)shmem.view;
+
+    /* The child dies holding the mutex and a read side */
+    pid = fork();
+    if (pid == 0) {
+        nj_ipc_mutex_lock(&shared->mutex);
+        nj_ipc_rwlock_lock_shared(&shared->rwlock);
+        _exit(0);
+    }
+    waitpid(pid, &status, 0);
+
+    assert(nj_ipc_mutex_lock(&shared->mutex) == LOCK_OWNER_DEAD);
+    assert(nj_ipc_mutex_owner(&shared->mutex) == nj_ipc_process_id());
+    assert(nj_ipc_mutex_unlock(&shared->mutex) == SUCCESS);
+    assert(nj_ipc_mutex_lock(&shared->mutex) == SUCCESS);
+    assert(nj_ipc_mutex_unlock(&shared->mutex) == SUCCESS);
+
+    assert(nj_ipc_rwlock_try_lock(&shared->rwlock) == LOCK_BUSY);
+    assert(nj_ipc_rwlock_lock(&shared->rwlock) == LOCK_OWNER_DEAD);
+    assert(nj_ipc_rwlock_unlock(&shared->rwlock) == SUCCESS);
+    assert(nj_ipc_rwlock_lock(&shared->rwlock) == SUCCESS);
+    assert(nj_ipc_rwlock_unlock(&shared->rwlock) == SUCCESS);
+
+#ifdef NJ_IPC_LINUX
+    /* A holder that exited but wasn't reaped yet is dead too */
+    pid = fork();
+    if (pid == 0) {
+        nj_ipc_mutex_lock(&shared->mutex);
+        _exit(0);
+    }
+    while (nj_ipc_mutex_owner(&shared->mutex) != (uint32_t)pid || nj_ipc_process_alive((uint32_t)pid)) {
+        nj_ipc_thread_yield();
+    }
+    assert(nj_ipc_mutex_lock(&shared->mutex) == LOCK_OWNER_DEAD);
+    assert(nj_ipc_mutex_unlock(&shared->mutex) == SUCCESS);
+    waitpid(pid, &status, 0);
+#endif
+
+    printf("Test for locks held by a dead process passed.\n");
+
+    nj_ipc_shmem_free(&shmem);
+#endif
+}
+
+int main() {
+    test_mutex_lock_unlock();
+    test_rwlock_lock_unlock();
+    test_locks_multi_process();
+    test_locks_dead_holder();
+    printf("All Lock API tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,58 @@
+#include "../src/ninjaipc.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+void test_numa_invalid_node() {
+    nj_ipc_shmem_options options;
+    memset(&options, 0, sizeof(options));
+    options.numa_policy = NJ_IPC_NUMA_BIND;
+    options.numa_node = nj_ipc_numa_node_count();
+
+    nj_ipc_shmem shmem = nj_ipc_shmem_create_ex("numaShmemInvalid", 4096, &options);
+    assert(shmem.status == NUMA_INVALID_NODE);
+
+    assert(nj_ipc_thread_pin_numa(-1) == NUMA_INVALID_NODE);
+
+    printf("Test for invalid NUMA node passed.\n");
+}
+
+void test_numa_bind_and_interleave() {
+#if defined(NJ_IPC_LINUX) || defined(NJ_IPC_WIN)
+    nj_ipc_shmem_options options;
+    memset(&options, 0, sizeof(options));
+    options.numa_policy = NJ_IPC_NUMA_BIND;
+
+    nj_ipc_channel server = nj_ipc_channel_create_ex("numaChannel", 1 << 20, &options);
+    assert(server.status == SUCCESS);
+    nj_ipc_channel client = nj_ipc_channel_open_ex("numaChannel", 1 << 20, &options);
+    assert(client.status == SUCCESS);
+
+    memset(server.shmem.view, 0xab, server.shmem.view_size);
+    assert(((unsigned char*)client.shmem.view)[12345] == 0xab);
+
+    assert(nj_ipc_thread_pin_numa(0) == SUCCESS);
+
+    nj_ipc_channel_free(&client);
+    nj_ipc_channel_free(&server);
+
+    printf("Test for NUMA bound channel passed.\n");
+#endif
+#ifdef NJ_IPC_LINUX
+    options.numa_policy = NJ_IPC_NUMA_INTERLEAVE;
+
+    nj_ipc_shmem shmem = nj_ipc_shmem_create_ex("numaShmemInterleave", 1 << 20, &options);
+    assert(shmem.status == SUCCESS);
+    memset(shmem.view, 0, shmem.view_size);
+    nj_ipc_shmem_free(&shmem);
+
+    printf("Test for NUMA interleaved shmem passed.\n");
+#endif
+}
+
+int main() {
+    test_numa_invalid_node();
+    test_numa_bind_and_interleave();
+    printf("All NUMA tests passed!\n");
+    return 0;
+}
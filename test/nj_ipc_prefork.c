@@ -0,0 +1,186 @@
+#include "../src/ninjaipc.h"
+#include <assert.h>
+#include <stdio.h>
+
+#ifdef NJ_IPC_POSIX
+static volatile sig_atomic_t stop_master = 0;
+
+static void on_stop(int signo) {
+    (void)signo;
+    stop_master = 1;
+}
+
+typedef struct {
+    int value;
+    int worker;
+} test_reply;
+
+/* Doubles the request, crashes the worker the first time it sees -1 and every time it sees -2, fails -3, never answers -4 */
+static nj_ipc_error handle_request(nj_ipc_channel *ch, unsigned int lane, void *ctx) {
+    volatile uint32_t *crashed = (volatile uint32_t*)ctx;
+    test_reply reply;
+    int request;
+
+    nj_ipc_lane_read(ch, lane, &request, sizeof(request));
+
+    if ((request == -1 && nj_ipc_atomic_cas32(crashed, 0, 1)) || request == -2) {
+        abort();
+    }
+
+    if (request == -3) {
+        return LANE_TOO_BIG;
+    }
+
+    while (request == -4) {
+        pause();
+    }
+
+    reply.value = request * 2;
+    reply.worker = (int)getpid();
+    return nj_ipc_lane_reply(ch, lane, &reply, sizeof(reply));
+}
+
+static int send_request(nj_ipc_channel *client, int request, test_reply *reply) {
+    unsigned int lane;
+
+    if (nj_ipc_lane_acquire(client, (unsigned int)getpid(), &lane) != SUCCESS) return 0;
+    if (nj_ipc_lane_send(client, lane, &request, sizeof(request)) != SUCCESS) return 0;
+    if (nj_ipc_lane_wait_reply(client, lane) != SUCCESS) return 0;
+    if (nj_ipc_lane_read(client, lane, reply, sizeof(*reply)) != SUCCESS) return 0;
+    return nj_ipc_lane_release(client, lane) == SUCCESS;
+}
+
+/* Sends a request the server gives up on, returns whether the client was told so */
+static int send_failing(nj_ipc_channel *client, int request) {
+    unsigned int lane;
+    nj_ipc_error err;
+
+    if (nj_ipc_lane_acquire(client, (unsigned int)getpid(), &lane) != SUCCESS) return 0;
+    if (nj_ipc_lane_send(client, lane, &request, sizeof(request)) != SUCCESS) return 0;
+    err = nj_ipc_lane_wait_reply(client, lane);
+    return nj_ipc_lane_release(client, lane) == SUCCESS && err == LANE_REQUEST_FAILED;
+}
+#endif
+
+void test_prefork_serve_and_recover() {
+#ifdef NJ_IPC_POSIX
+    int process, request, status;
+    pid_t clients[2];
+
+    nj_ipc_shmem flag = nj_ipc_shmem_create("test_prefork_flag", sizeof(uint32_t));
+    assert(flag.status == SUCCESS);
+    *(volatile uint32_t*)flag.view = 0;
+
+    nj_ipc_channel server = nj_ipc_channel_create_lanes("test_prefork", 64, 4, NULL);
+    assert(server.status == SUCCESS);
+
+    signal(SIGUSR1, on_stop);
+
+    /* A driver process runs the clients and stops the master once they are done */
+    if (fork() == 0) {
+        for (process = 0; process < 2; process++) {
+            clients[process] = fork();
+            if (clients[process] != 0) {
+                continue;
+            }
+
+            nj_ipc_channel client = nj_ipc_channel_open_lanes("test_prefork", 64, 4, NULL);
+            test_reply reply;
+
+            /* The crashing request is serviced again by the replacement worker */
+            if (process == 0 && (!send_request(&client, -1, &reply) || reply.value != -2)) _exit(1);
+
+            /* A request that crashes every worker, and one the handler refuses, come back as failed */
+            if (process == 1 && (!send_failing(&client, -2) || !send_failing(&client, -3))) _exit(1);
+
+            for (request = 0; request < 500; request++) {
+                if (!send_request(&client, request, &reply) || reply.value != request * 2) _exit(1);
+            }
+            _exit(0);
+        }
+
+        for (process = 0; process < 2; process++) {
+            waitpid(clients[process], &status, 0);
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) _exit(1);
+        }
+        kill(getppid(), SIGUSR1);
+        _exit(0);
+    }
+
+    assert(nj_ipc_prefork_run(&server, 2, handle_request, flag.view, &stop_master) == SUCCESS);
+    assert(*(volatile uint32_t*)flag.view == 1);
+
+    wait(&status);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    printf("Test for prefork serving and worker recovery passed.\n");
+
+    nj_ipc_channel_free(&server);
+    nj_ipc_shmem_free(&flag);
+#endif
+}
+
+void test_prefork_shutdown() {
+#ifdef NJ_IPC_POSIX
+    int status;
+    pid_t client;
+
+    stop_master = 0;
+    signal(SIGUSR1, on_stop);
+
+    nj_ipc_channel server = nj_ipc_channel_create_lanes("test_prefork", 64, 4, NULL);
+    assert(server.status == SUCCESS);
+
+    /* The master stops while a worker holds the request, the client is told it failed */
+    if (fork() == 0) {
+        nj_ipc_channel watcher = nj_ipc_channel_open_lanes("test_prefork", 64, 4, NULL);
+        unsigned int lane;
+
+        client = fork();
+        if (client == 0) {
+            nj_ipc_channel mine = nj_ipc_channel_open_lanes("test_prefork", 64, 4, NULL);
+            _exit(send_failing(&mine, -4) ? 0 : 1);
+        }
+
+        for (lane = 0; nj_ipc_lane_status(&watcher, lane) != NJ_IPC_LANE_SERVICING; lane = (lane + 1) % 4) {
+            nj_ipc_thread_yield();
+        }
+        kill(getppid(), SIGUSR1);
+
+        waitpid(client, &status, 0);
+        _exit(WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : 1);
+    }
+
+    assert(nj_ipc_prefork_run(&server, 2, handle_request, NULL, &stop_master) == SUCCESS);
+
+    wait(&status);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    printf("Test for failing pending requests on shutdown passed.\n");
+
+    nj_ipc_channel_free(&server);
+#endif
+}
+
+void test_prefork_invalid() {
+    nj_ipc_channel plain = nj_ipc_channel_create("test_prefork_plain", 64);
+    assert(plain.status == SUCCESS);
+
+#ifdef NJ_IPC_POSIX
+    assert(nj_ipc_prefork_run(&plain, 2, NULL, NULL, NULL) == LANE_INVALID_CHANNEL);
+#else
+    assert(nj_ipc_prefork_run(&plain, 2, NULL, NULL, NULL) == PREFORK_UNSUPPORTED);
+#endif
+
+    printf("Test for prefork on an invalid channel passed.\n");
+
+    nj_ipc_channel_free(&plain);
+}
+
+int main() {
+    test_prefork_serve_and_recover();
+    test_prefork_shutdown();
+    test_prefork_invalid();
+    printf("All Prefork API tests passed!\n");
+    return 0;
+}
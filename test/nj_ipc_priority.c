@@ -0,0 +1,159 @@
+#include "../src/ninjaipc.h"
+#include <assert.h>
+#include <stdio.h>
+#ifdef NJ_IPC_POSIX
+#include <sys/wait.h>
+#endif
+
+void test_priority_create_open() {
+    nj_ipc_priority_config classes[2] = { { 16, 4, 2 }, { 64, 8, 1 } };
+    nj_ipc_priority_config mismatch[2] = { { 16, 4, 3 }, { 64, 8, 1 } };
+    nj_ipc_priority_config no_weight[1] = { { 16, 4, 0 } };
+    nj_ipc_priority_config many[NJ_IPC_PRIORITY_MAX_CLASSES + 1];
+    unsigned int i;
+
+    for (i = 0; i < NJ_IPC_PRIORITY_MAX_CLASSES + 1; i++) {
+        many[i] = classes[0];
+    }
+
+    assert(nj_ipc_channel_create_priority("test_priority", classes, 0, NULL).status == PRIORITY_INVALID_CLASS);
+    assert(nj_ipc_channel_create_priority("test_priority", no_weight, 1, NULL).status == PRIORITY_INVALID_CLASS);
+    assert(nj_ipc_channel_create_priority("test_priority", many, NJ_IPC_PRIORITY_MAX_CLASSES + 1, NULL).status
+           == PRIORITY_INVALID_CLASS);
+
+    nj_ipc_channel server = nj_ipc_channel_create_priority("test_priority", classes, 2, NULL);
+    assert(server.status == SUCCESS);
+
+    nj_ipc_channel client = nj_ipc_channel_open_priority("test_priority", classes, 2, NULL);
+    assert(client.status == SUCCESS);
+
+    assert(nj_ipc_channel_open_priority("test_priority", mismatch, 2, NULL).status == PRIORITY_INVALID_CHANNEL);
+    assert(nj_ipc_priority_try_send(&client, 2, "x", 1) == PRIORITY_INVALID_CLASS);
+    assert(nj_ipc_priority_try_send(&client, 0, many, 17) == CHANNEL_WRITE_TOO_BIG);
+
+    /* Class 0 holds 4 messages, class 1 is unaffected when it fills up */
+    for (i = 0; i < 4; i++) {
+        assert(nj_ipc_priority_try_send(&client, 0, &i, sizeof(i)) == SUCCESS);
+    }
+    assert(nj_ipc_priority_try_send(&client, 0, &i, sizeof(i)) == QUEUE_FULL);
+    assert(nj_ipc_priority_try_send(&client, 1, &i, sizeof(i)) == SUCCESS);
+
+    nj_ipc_channel plain = nj_ipc_channel_create("test_priority_plain", 1024);
+    assert(plain.status == SUCCESS);
+    assert(nj_ipc_priority_try_send(&plain, 0, "x", 1) == PRIORITY_INVALID_CHANNEL);
+
+    printf("Test for create and open priority channels passed.\n");
+
+    nj_ipc_channel_free(&plain);
+    nj_ipc_channel_free(&client);
+    nj_ipc_channel_free(&server);
+}
+
+static void expect_order(nj_ipc_channel *server, const char *expected) {
+    unsigned int priority;
+    char buffer[16];
+    size_t size;
+
+    for (; *expected; expected++) {
+        assert(nj_ipc_priority_recv(server, buffer, sizeof(buffer), &size, &priority) == SUCCESS);
+        assert(size == 1 && buffer[0] == *expected);
+        assert(priority == (*expected == 'C' ? 0u : 1u));
+    }
+}
+
+void test_priority_weights() {
+    nj_ipc_priority_config classes[2] = { { 16, 8, 2 }, { 16, 8, 1 } };
+    unsigned int priority;
+    char buffer[4], big[16] = { 'D' };
+    size_t size;
+    int i;
+
+    nj_ipc_channel server = nj_ipc_channel_create_priority("test_priority", classes, 2, NULL);
+    assert(server.status == SUCCESS);
+    nj_ipc_channel client = nj_ipc_channel_open_priority("test_priority", classes, 2, NULL);
+    assert(client.status == SUCCESS);
+
+    /* Data queued first still waits behind control, until control runs out */
+    for (i = 0; i < 4; i++) assert(nj_ipc_priority_try_send(&client, 1, "D", 1) == SUCCESS);
+    for (i = 0; i < 2; i++) assert(nj_ipc_priority_try_send(&client, 0, "C", 1) == SUCCESS);
+    expect_order(&server, "CCDDDD");
+
+    /* A round in progress carries over, start the next case on a fresh channel */
+    nj_ipc_channel_free(&client);
+    nj_ipc_channel_free(&server);
+    server = nj_ipc_channel_create_priority("test_priority", classes, 2, NULL);
+    assert(server.status == SUCCESS);
+    client = nj_ipc_channel_open_priority("test_priority", classes, 2, NULL);
+    assert(client.status == SUCCESS);
+
+    /* With both busy, data gets one message for every two of control and never starves */
+    for (i = 0; i < 3; i++) assert(nj_ipc_priority_try_send(&client, 1, "D", 1) == SUCCESS);
+    for (i = 0; i < 5; i++) assert(nj_ipc_priority_try_send(&client, 0, "C", 1) == SUCCESS);
+    expect_order(&server, "CCDCCDCD");
+
+    /* A receiver with a small buffer drops the message and moves on */
+    assert(nj_ipc_priority_try_send(&client, 1, big, sizeof(big)) == SUCCESS);
+    assert(nj_ipc_priority_try_send(&client, 1, "D", 1) == SUCCESS);
+    assert(nj_ipc_priority_recv(&server, buffer, sizeof(buffer), &size, &priority) == CHANNEL_READ_TOO_BIG);
+    assert(size == sizeof(big) && priority == 1);
+    expect_order(&server, "D");
+
+    printf("Test for priority order and weights passed.\n");
+
+    nj_ipc_channel_free(&client);
+    nj_ipc_channel_free(&server);
+}
+
+void test_priority_multi_process() {
+#ifdef NJ_IPC_POSIX
+    nj_ipc_priority_config classes[3] = { { 8, 2, 4 }, { 8, 2, 2 }, { 8, 2, 1 } };
+    unsigned int priority, next[3] = { 0, 0, 0 }, value[2];
+    int process, i, status;
+    pid_t pids[3];
+
+    nj_ipc_channel server = nj_ipc_channel_create_priority("test_priority", classes, 3, NULL);
+    assert(server.status == SUCCESS);
+
+    /* Each process sends in its own class, the small classes keep them blocked on space */
+    for (process = 0; process < 3; process++) {
+        pids[process] = fork();
+        if (pids[process] != 0) {
+            continue;
+        }
+
+        nj_ipc_channel ch = nj_ipc_channel_open_priority("test_priority", classes, 3, NULL);
+        if (ch.status != SUCCESS) _exit(1);
+
+        for (i = 0; i < 5000; i++) {
+            value[0] = (unsigned int)process;
+            value[1] = (unsigned int)i;
+            if (nj_ipc_priority_send(&ch, (unsigned int)process, value, sizeof(value)) != SUCCESS) _exit(2);
+        }
+        _exit(0);
+    }
+
+    for (i = 0; i < 3 * 5000; i++) {
+        assert(nj_ipc_priority_recv(&server, value, sizeof(value), NULL, &priority) == SUCCESS);
+        assert(priority == value[0] && value[1] == next[priority]);
+        next[priority]++;
+    }
+
+    for (process = 0; process < 3; process++) {
+        waitpid(pids[process], &status, 0);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        assert(next[process] == 5000);
+    }
+
+    printf("Test for priority channels used from several processes passed.\n");
+
+    nj_ipc_channel_free(&server);
+#endif
+}
+
+int main() {
+    test_priority_create_open();
+    test_priority_weights();
+    test_priority_multi_process();
+    printf("All Priority API tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,237 @@
+#include "../src/ninjaipc.h"
+#include <assert.h>
+#include <stdio.h>
+#ifdef NJ_IPC_POSIX
+#include <sys/wait.h>
+#endif
+
+static uint64_t publish_filled(nj_ipc_publication *pub, unsigned int size, int fill) {
+    nj_ipc_publish_snapshot snapshot;
+
+    assert(nj_ipc_publish_begin(pub, size, &snapshot) == SUCCESS);
+    memset(snapshot.data, fill, size);
+    assert(nj_ipc_publish_commit(pub, &snapshot) == SUCCESS);
+    return snapshot.version;
+}
+
+static int segment_exists(const char *name, unsigned int size) {
+    nj_ipc_shmem_options options;
+    nj_ipc_shmem shmem;
+
+    memset(&options, 0, sizeof(options));
+    options.read_only = 1;
+    shmem = nj_ipc_shmem_open_ex(name, size, &options);
+
+    if (shmem.status != SUCCESS) {
+        return 0;
+    }
+    nj_ipc_shmem_close(&shmem);
+    return 1;
+}
+
+void test_publish_create_open() {
+    nj_ipc_publish_snapshot snapshot;
+
+    nj_ipc_publication pub = nj_ipc_publish_create("test_publish");
+    assert(pub.status == SUCCESS);
+
+    nj_ipc_publication reader = nj_ipc_publish_open("test_publish");
+    assert(reader.status == SUCCESS);
+
+    assert(nj_ipc_publish_acquire(&reader, &snapshot) == PUBLISH_NONE);
+    assert(nj_ipc_publish_begin(&reader, 16, &snapshot) == PUBLISH_INVALID_OBJECT);
+
+    printf("Test for create and open publications passed.\n");
+
+    nj_ipc_publish_free(&reader);
+    nj_ipc_publish_free(&pub);
+}
+
+void test_publish_version_swap() {
+    nj_ipc_publish_snapshot old_snapshot, new_snapshot;
+
+    nj_ipc_publication pub = nj_ipc_publish_create("test_publish");
+    assert(pub.status == SUCCESS);
+    nj_ipc_publication reader = nj_ipc_publish_open("test_publish");
+    assert(reader.status == SUCCESS);
+
+    assert(publish_filled(&pub, 4096, 1) == 1);
+    assert(nj_ipc_publish_acquire(&reader, &old_snapshot) == SUCCESS);
+    assert(old_snapshot.version == 1 && old_snapshot.size == 4096);
+    assert(((unsigned char*)old_snapshot.data)[4095] == 1);
+    assert(!nj_ipc_publish_changed(&reader, &old_snapshot));
+
+    /* The old version stays mapped and linked while the reader holds it */
+    assert(publish_filled(&pub, 8192, 2) == 2);
+    assert(nj_ipc_publish_changed(&reader, &old_snapshot));
+    assert(((unsigned char*)old_snapshot.data)[0] == 1);
+    assert(segment_exists("test_publish_v1", 4096));
+
+    assert(nj_ipc_publish_acquire(&reader, &new_snapshot) == SUCCESS);
+    assert(new_snapshot.version == 2 && ((unsigned char*)new_snapshot.data)[8191] == 2);
+
+    nj_ipc_publish_release(&reader, &old_snapshot);
+#ifdef NJ_IPC_POSIX
+    assert(!segment_exists("test_publish_v1", 4096));
+#endif
+    assert(reader.header->slots[old_snapshot.slot].state == NJ_IPC_PUBLISH_FREE);
+
+    nj_ipc_publish_release(&reader, &new_snapshot);
+    assert(segment_exists("test_publish_v2", 8192));
+
+    printf("Test for swapping versions passed.\n");
+
+    nj_ipc_publish_free(&reader);
+    nj_ipc_publish_free(&pub);
+}
+
+void test_publish_busy() {
+    nj_ipc_publish_snapshot held[NJ_IPC_PUBLISH_SLOTS], snapshot;
+    int i;
+
+    nj_ipc_publication pub = nj_ipc_publish_create("test_publish");
+    assert(pub.status == SUCCESS);
+
+    /* Every slot holds a version some reader still references */
+    for (i = 0; i < NJ_IPC_PUBLISH_SLOTS; i++) {
+        publish_filled(&pub, 64, i);
+        assert(nj_ipc_publish_acquire(&pub, &held[i]) == SUCCESS);
+    }
+    assert(nj_ipc_publish_begin(&pub, 64, &snapshot) == PUBLISH_BUSY);
+
+    nj_ipc_publish_release(&pub, &held[0]);
+    assert(nj_ipc_publish_begin(&pub, 64, &snapshot) == SUCCESS);
+    assert(nj_ipc_publish_commit(&pub, &snapshot) == SUCCESS);
+
+    for (i = 1; i < NJ_IPC_PUBLISH_SLOTS; i++) {
+        nj_ipc_publish_release(&pub, &held[i]);
+    }
+
+    printf("Test for a publication with every slot referenced passed.\n");
+
+    nj_ipc_publish_free(&pub);
+}
+
+void test_publish_abort() {
+    nj_ipc_publish_snapshot snapshot;
+    int i;
+
+    nj_ipc_publication pub = nj_ipc_publish_create("test_publish");
+    assert(pub.status == SUCCESS);
+    publish_filled(&pub, 64, 1);
+
+    /* Abandoned versions give their slot back, more of them than there are slots */
+    for (i = 0; i < 2 * NJ_IPC_PUBLISH_SLOTS; i++) {
+        assert(nj_ipc_publish_begin(&pub, 64, &snapshot) == SUCCESS);
+        assert(nj_ipc_publish_abort(&pub, &snapshot) == SUCCESS);
+        assert(pub.header->slots[snapshot.slot].state == NJ_IPC_PUBLISH_FREE);
+    }
+    assert(nj_ipc_publish_abort(&pub, &snapshot) == PUBLISH_INVALID_OBJECT);
+#ifdef NJ_IPC_POSIX
+    assert(!segment_exists("test_publish_v2", 64));
+#endif
+
+    /* The live version is untouched */
+    assert(nj_ipc_publish_acquire(&pub, &snapshot) == SUCCESS && snapshot.version == 1);
+    nj_ipc_publish_release(&pub, &snapshot);
+
+    printf("Test for aborting versions passed.\n");
+
+    nj_ipc_publish_free(&pub);
+}
+
+void test_publish_concurrent_readers() {
+#ifdef NJ_IPC_POSIX
+    int process, version, status;
+    pid_t pids[2];
+
+    nj_ipc_publication pub = nj_ipc_publish_create("test_publish");
+    assert(pub.status == SUCCESS);
+    publish_filled(&pub, 65536, 0);
+
+    for (process = 0; process < 2; process++) {
+        pids[process] = fork();
+        if (pids[process] != 0) {
+            continue;
+        }
+
+        nj_ipc_publication reader = nj_ipc_publish_open("test_publish");
+        nj_ipc_publish_snapshot snapshot;
+        uint64_t last = 0;
+        size_t i;
+
+        /* Every version must be seen whole, and versions only move forward */
+        while (last < 50) {
+            if (nj_ipc_publish_acquire(&reader, &snapshot) != SUCCESS) _exit(1);
+            if (snapshot.version < last) _exit(2);
+            for (i = 0; i < snapshot.size; i++) {
+                if (((unsigned char*)snapshot.data)[i] != (unsigned char)(snapshot.version - 1)) _exit(3);
+            }
+            last = snapshot.version;
+            nj_ipc_publish_release(&reader, &snapshot);
+        }
+        _exit(0);
+    }
+
+    for (version = 1; version < 50; version++) {
+        nj_ipc_publish_snapshot snapshot;
+
+        while (nj_ipc_publish_begin(&pub, 65536, &snapshot) == PUBLISH_BUSY) {
+            nj_ipc_thread_yield();
+        }
+        memset(snapshot.data, version, 65536);
+        assert(nj_ipc_publish_commit(&pub, &snapshot) == SUCCESS);
+    }
+
+    for (process = 0; process < 2; process++) {
+        waitpid(pids[process], &status, 0);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    printf("Test for readers following new versions passed.\n");
+
+    nj_ipc_publish_free(&pub);
+#endif
+}
+
+void test_publish_dead_reader() {
+#ifdef NJ_IPC_POSIX
+    nj_ipc_publish_snapshot snapshot;
+    int status;
+    pid_t pid;
+
+    nj_ipc_publication pub = nj_ipc_publish_create("test_publish");
+    assert(pub.status == SUCCESS);
+    publish_filled(&pub, 64, 1);
+
+    /* The child dies holding the first version */
+    pid = fork();
+    if (pid == 0) {
+        nj_ipc_publication reader = nj_ipc_publish_open("test_publish");
+        if (nj_ipc_publish_acquire(&reader, &snapshot) != SUCCESS) _exit(1);
+        _exit(0);
+    }
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    /* Retiring the version finds its reader gone and unlinks it */
+    publish_filled(&pub, 64, 2);
+    assert(!segment_exists("test_publish_v1", 64));
+    assert(pub.header->slots[0].state == NJ_IPC_PUBLISH_FREE);
+
+    printf("Test for versions held by a dead reader passed.\n");
+
+    nj_ipc_publish_free(&pub);
+#endif
+}
+
+int main() {
+    test_publish_create_open();
+    test_publish_version_swap();
+    test_publish_busy();
+    test_publish_abort();
+    test_publish_concurrent_readers();
+    test_publish_dead_reader();
+    printf("All Publish API tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include "../src/ninjaipc.h"
+#include <assert.h>
+#include <stdio.h>
+#ifdef NJ_IPC_POSIX
+#include <sys/wait.h>
+#endif
+
+void test_queue_create_open() {
+    nj_ipc_queue queue = nj_ipc_queue_create("test_queue", sizeof(int), 100);
+    assert(queue.status == SUCCESS);
+    assert(queue.ring->capacity == 128);
+
+    nj_ipc_queue other = nj_ipc_queue_open("test_queue", sizeof(int), 100);
+    assert(other.status == SUCCESS);
+
+    nj_ipc_queue mismatch = nj_ipc_queue_open("test_queue", sizeof(long long), 100);
+    assert(mismatch.status == QUEUE_INVALID_LAYOUT);
+
+    nj_ipc_queue again = nj_ipc_queue_open("test_queue", sizeof(int), 100);
+    assert(again.status == SUCCESS);
+
+    nj_ipc_queue invalid = nj_ipc_queue_create("test_queue_invalid", 0, 100);
+    assert(invalid.status == SHMEM_INVALID_SIZE);
+
+    printf("Test for create and open queues passed.\n");
+
+    nj_ipc_queue_free(&again);
+    nj_ipc_queue_free(&other);
+    nj_ipc_queue_free(&queue);
+}
+
+void test_queue_push_pop() {
+    int item, items[8];
+    size_t popped;
+
+    nj_ipc_queue queue = nj_ipc_queue_create("test_queue", sizeof(int), 4);
+    assert(queue.status == SUCCESS);
+    nj_ipc_queue other = nj_ipc_queue_open("test_queue", sizeof(int), 4);
+    assert(other.status == SUCCESS);
+
+    assert(nj_ipc_queue_try_pop(&other, &item) == QUEUE_EMPTY);
+
+    for (item = 0; item < 4; item++) {
+        assert(nj_ipc_queue_try_push(&queue, &item) == SUCCESS);
+    }
+    assert(nj_ipc_queue_try_push(&queue, &item) == QUEUE_FULL);
+
+    assert(nj_ipc_queue_pop(&other, &item) == SUCCESS && item == 0);
+
+    /* A batch takes every ready item, in order */
+    assert(nj_ipc_queue_pop_batch(&other, items, 8, &popped) == SUCCESS);
+    assert(popped == 3 && items[0] == 1 && items[1] == 2 && items[2] == 3);
+    assert(nj_ipc_queue_try_pop_batch(&other, items, 8, &popped) == QUEUE_EMPTY && popped == 0);
+
+    /* Positions wrap around the ring */
+    for (item = 10; item < 13; item++) {
+        assert(nj_ipc_queue_push(&queue, &item) == SUCCESS);
+    }
+    assert(nj_ipc_queue_try_pop_batch(&other, items, 2, &popped) == SUCCESS);
+    assert(popped == 2 && items[0] == 10 && items[1] == 11);
+    assert(nj_ipc_queue_try_pop(&other, &item) == SUCCESS && item == 12);
+
+    printf("Test for push and pop passed.\n");
+
+    nj_ipc_queue_free(&other);
+    nj_ipc_queue_free(&queue);
+}
+
+void test_queue_multi_process() {
+#ifdef NJ_IPC_POSIX
+    const int producers = 2, consumers = 3, per_producer = 20000;
+    long long total = 0, expected = 0;
+    int process, item;
+    pid_t pids[5];
+
+    /* A small ring makes producers block on space and consumers on items */
+    nj_ipc_queue queue = nj_ipc_queue_create("test_queue", sizeof(int), 16);
+    assert(queue.status == SUCCESS);
+    nj_ipc_queue results = nj_ipc_queue_create("test_queue_results", sizeof(long long), 16);
+    assert(results.status == SUCCESS);
+
+    for (process = 0; process < producers + consumers; process++) {
+        pids[process] = fork();
+        if (pids[process] != 0) {
+            continue;
+        }
+
+        nj_ipc_queue mine = nj_ipc_queue_open("test_queue", sizeof(int), 16);
+        if (process < producers) {
+            for (item = 1; item <= per_producer; item++) {
+                if (nj_ipc_queue_push(&mine, &item) != SUCCESS) _exit(1);
+            }
+        } else {
+            nj_ipc_queue sums = nj_ipc_queue_open("test_queue_results", sizeof(long long), 16);
+            int batch[8];
+            size_t popped, i;
+            long long sum = 0;
+
+            for (;;) {
+                if (nj_ipc_queue_pop_batch(&mine, batch, 8, &popped) != SUCCESS) _exit(1);
+                for (i = 0; i < popped && batch[i] != 0; i++) {
+                    sum += batch[i];
+                }
+                if (i < popped) {
+                    break;
+                }
+            }
+            if (nj_ipc_queue_push(&sums, &sum) != SUCCESS) _exit(1);
+        }
+        _exit(0);
+    }
+
+    for (process = 0; process < producers; process++) {
+        int status;
+        waitpid(pids[process], &status, 0);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    /* Every item is queued, hand out one stop marker at a time so each consumer gets exactly one */
+    for (process = 0; process < consumers; process++) {
+        long long sum;
+        item = 0;
+        assert(nj_ipc_queue_push(&queue, &item) == SUCCESS);
+        assert(nj_ipc_queue_pop(&results, &sum) == SUCCESS);
+        total += sum;
+    }
+
+    for (process = producers; process < producers + consumers; process++) {
+        int status;
+        waitpid(pids[process], &status, 0);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    expected = (long long)producers * per_producer * (per_producer + 1) / 2;
+    assert(total == expected);
+
+    printf("Test for producers and consumers in several processes passed.\n");
+
+    nj_ipc_queue_free(&results);
+    nj_ipc_queue_free(&queue);
+#endif
+}
+
+int main() {
+    test_queue_create_open();
+    test_queue_push_pop();
+    test_queue_multi_process();
+    printf("All Queue API tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include "../src/ninjaipc.h"
+#include <assert.h>
+#include <stdio.h>
+
+using NinjaIPC::Channel;
+using NinjaIPC::ReplyCache;
+
+static size_t entry_cost(const std::string& key, const std::string& value) {
+    ReplyCache probe(1 << 20, std::chrono::hours(1));
+    probe.insert(key, 0, value);
+    return probe.bytes();
+}
+
+void test_reply_cache_lru_eviction() {
+    std::string value;
+    ReplyCache cache(2 * entry_cost("a", "1"), std::chrono::hours(1));
+
+    cache.insert("a", 0, "1");
+    cache.insert("b", 0, "2");
+
+    /* Touching a leaves b as the least recently used entry */
+    assert(cache.find("a", 0, value) && value == "1");
+    cache.insert("c", 0, "3");
+
+    assert(!cache.find("b", 0, value));
+    assert(cache.find("a", 0, value) && value == "1");
+    assert(cache.find("c", 0, value) && value == "3");
+
+    printf("Test for evicting the least recently used reply passed.\n");
+}
+
+void test_reply_cache_ttl() {
+    std::string value;
+    ReplyCache cache(1 << 20, std::chrono::milliseconds(20));
+
+    cache.insert("a", 0, "1");
+    assert(cache.find("a", 0, value) && value == "1");
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    assert(!cache.find("a", 0, value));
+    assert(cache.bytes() == 0);
+
+    printf("Test for expiring replies passed.\n");
+}
+
+void test_reply_cache_byte_bound() {
+    std::string value;
+    size_t max_bytes = 4 * entry_cost("key_00", std::string(100, 'x'));
+    ReplyCache cache(max_bytes, std::chrono::hours(1));
+    char key[16];
+    int i;
+
+    for (i = 0; i < 64; i++) {
+        sprintf(key, "key_%02d", i);
+        cache.insert(key, 0, std::string(100, 'x'));
+        assert(cache.bytes() <= max_bytes);
+    }
+    assert(cache.bytes() == max_bytes);
+    assert(cache.find("key_63", 0, value) && !cache.find("key_59", 0, value));
+
+    /* A reply larger than the whole budget is never kept */
+    cache.insert("huge", 0, std::string(max_bytes, 'x'));
+    assert(!cache.find("huge", 0, value));
+    assert(cache.bytes() == max_bytes);
+
+    printf("Test for bounding the cached bytes passed.\n");
+}
+
+void test_reply_cache_generation_race() {
+    std::string value;
+    ReplyCache cache(1 << 20, std::chrono::hours(1));
+
+    cache.insert("a", 1, "1");
+    assert(cache.find("a", 1, value));
+
+    /* A newer generation drops everything cached before it */
+    assert(!cache.find("a", 2, value));
+    assert(cache.bytes() == 0);
+
+    /* A reply requested before the invalidation arrives after it and is dropped */
+    cache.insert("a", 1, "stale");
+    assert(!cache.find("a", 2, value));
+    assert(cache.bytes() == 0);
+
+    cache.insert("a", 2, "2");
+    assert(cache.find("a", 2, value) && value == "2");
+
+    printf("Test for dropping replies that raced an invalidation passed.\n");
+}
+
+void test_reply_cache_send_cached() {
+    int served = 0;
+
+    auto server = Channel::make("test_reply_cache", 64);
+    auto client = Channel::connect("test_reply_cache", 64);
+    client->enable_reply_cache(1 << 20, std::chrono::hours(1));
+
+    std::thread worker([&server, &served]() {
+        for (int i = 0; i < 2; i++) {
+            int request = server->receive<int>();
+            served++;
+            server->reply(request * 2);
+        }
+    });
+
+    assert(client->send_cached(21) == 42);
+    assert(client->send_cached(21) == 42);
+    assert(served == 1);
+
+    /* After the server invalidates, the next request goes through again */
+    server->invalidate();
+    assert(client->send_cached(21) == 42);
+    worker.join();
+    assert(served == 2);
+
+    printf("Test for answering repeated requests from the reply cache passed.\n");
+}
+
+void test_reply_cache_shared_channel() {
+    auto server = Channel::make("test_reply_cache", 64);
+    auto client = Channel::cached("test_reply_cache", 64);
+    assert(Channel::cached("test_reply_cache", 64) == client);
+
+    /* The wrapper works on the cached object, so C users of the name see the same mapping */
+    client->enable_reply_cache(1 << 20, std::chrono::hours(1));
+    nj_ipc_channel* shared = nj_ipc_channel_acquire("test_reply_cache", 64, nullptr);
+    assert(shared && shared->generation.view);
+
+    server->invalidate();
+    assert(nj_ipc_channel_generation(shared) == 1);
+    nj_ipc_channel_release(shared);
+
+    printf("Test for sharing the cached channel with C users passed.\n");
+}
+
+int main() {
+    test_reply_cache_lru_eviction();
+    test_reply_cache_ttl();
+    test_reply_cache_byte_bound();
+    test_reply_cache_generation_race();
+    test_reply_cache_send_cached();
+    test_reply_cache_shared_channel();
+    printf("All Reply Cache tests passed!\n");
+    return 0;
+}
@@ -34,11 +34,22 @@ void test_shmem_open_with_invalid_size() {
     printf("Test for opening shmem with zero size passed.\n");
 }
 
+void test_shmem_mirrored_with_invalid_size() {
+    nj_ipc_shmem_options options;
+    memset(&options, 0, sizeof(options));
+    options.mirrored = 1;
+
+    nj_ipc_shmem shmem = nj_ipc_shmem_create_ex("shmem1", nj_ipc_shmem_granularity() + 1, &options);
+    assert(shmem.status == SHMEM_INVALID_SIZE);
+    printf("Test for creating mirrored shmem with an unaligned size passed.\n");
+}
+
 int main() {
     test_shmem_create_with_invalid_name();
     test_shmem_create_with_invalid_size();
     test_shmem_open_with_invalid_name();
     test_shmem_open_with_invalid_size();
+    test_shmem_mirrored_with_invalid_size();
     printf("All shmem tests passed!\n");
     return 0;
 }
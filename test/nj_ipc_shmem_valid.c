@@ -25,9 +25,35 @@ void test_shmem_open_and_free_valid() {
     printf("Test for freeing valid opened shmem passed.\n");
 }
 
+void test_shmem_mirrored_valid() {
+    nj_ipc_shmem_options options;
+    unsigned int size = nj_ipc_shmem_granularity();
+    const char message[] = "wraps past the end";
+
+    memset(&options, 0, sizeof(options));
+    options.mirrored = 1;
+
+    nj_ipc_shmem shmem_create = nj_ipc_shmem_create_ex("validShmemMirror", size, &options);
+    assert(shmem_create.status == SUCCESS);
+
+    nj_ipc_shmem shmem = nj_ipc_shmem_open_ex("validShmemMirror", size, &options);
+    assert(shmem.status == SUCCESS);
+
+    /* A write crossing the end lands at the start, for this mapping and the other one */
+    char *view = (char*)shmem_create.view;
+    memcpy(view + size - 5, message, sizeof(message));
+    assert(memcmp(view, message + 5, sizeof(message) - 5) == 0);
+    assert(memcmp((char*)shmem.view + size - 5, message, sizeof(message)) == 0);
+    printf("Test for mirrored shmem passed.\n");
+
+    nj_ipc_shmem_free(&shmem);
+    nj_ipc_shmem_free(&shmem_create);
+}
+
 int main() {
     test_shmem_create_and_free_valid();
     test_shmem_open_and_free_valid();
+    test_shmem_mirrored_valid();
 
     printf("All valid shmem tests passed!\n");
     return 0;
@@ -0,0 +1,115 @@
+#include "../src/ninjaipc.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef NJ_IPC_POSIX
+#include <sys/wait.h>
+#endif
+
+/* Header plus two slots of 64 bytes of payload */
+#define SMALL_CHANNEL_SIZE (sizeof(nj_ipc_stream_header) + 2 * 128)
+
+void test_stream_init_invalid() {
+    nj_ipc_stream stream = nj_ipc_stream_init(NULL, 2);
+    assert(stream.status == STREAM_INVALID_OBJECT);
+
+    nj_ipc_channel ch = nj_ipc_channel_create("test_stream", 64);
+    assert(ch.status == SUCCESS);
+
+    stream = nj_ipc_stream_init(&ch, 2);
+    assert(stream.status == STREAM_INVALID_SIZE);
+
+    printf("Test for invalid streams passed.\n");
+
+    nj_ipc_channel_free(&ch);
+}
+
+void test_stream_within_slots() {
+    char data[100], buffer[100];
+    const void *chunk;
+    size_t size, i;
+
+    for (i = 0; i < sizeof(data); i++) data[i] = (char)i;
+
+    nj_ipc_channel server = nj_ipc_channel_create("test_stream", SMALL_CHANNEL_SIZE);
+    assert(server.status == SUCCESS);
+    nj_ipc_channel client = nj_ipc_channel_open("test_stream", SMALL_CHANNEL_SIZE);
+    assert(client.status == SUCCESS);
+
+    nj_ipc_stream writer = nj_ipc_stream_init(&client, 2);
+    assert(writer.status == SUCCESS);
+    assert(writer.chunk_size == 64);
+    nj_ipc_stream reader = nj_ipc_stream_init(&server, 2);
+    assert(reader.status == SUCCESS);
+
+    /* Two chunks, both slots filled before the reader drains anything */
+    assert(nj_ipc_stream_write(&writer, data, sizeof(data)) == SUCCESS);
+
+    assert(nj_ipc_stream_read(&reader, buffer, 10, &size) == STREAM_TOO_BIG);
+    assert(size == sizeof(data));
+    assert(nj_ipc_stream_read(&reader, buffer, sizeof(buffer), &size) == SUCCESS);
+    assert(memcmp(data, buffer, sizeof(data)) == 0);
+
+    /* Chunk iteration, including an empty transfer */
+    assert(nj_ipc_stream_write(&writer, data, 70) == SUCCESS);
+    assert(nj_ipc_stream_next(&reader, &chunk, &size) == SUCCESS && size == 64);
+    assert(memcmp(chunk, data, 64) == 0);
+    assert(nj_ipc_stream_next(&reader, &chunk, &size) == SUCCESS && size == 6);
+    assert(memcmp(chunk, data + 64, 6) == 0);
+    assert(nj_ipc_stream_next(&reader, &chunk, &size) == STREAM_END);
+
+    assert(nj_ipc_stream_write(&writer, data, 0) == SUCCESS);
+    assert(nj_ipc_stream_next(&reader, &chunk, &size) == SUCCESS && size == 0);
+    assert(nj_ipc_stream_next(&reader, &chunk, &size) == STREAM_END);
+
+    printf("Test for streaming within the slots passed.\n");
+
+    nj_ipc_channel_free(&client);
+    nj_ipc_channel_free(&server);
+}
+
+void test_stream_larger_than_channel() {
+#ifdef NJ_IPC_POSIX
+    size_t total = 1 << 20, size, i;
+    unsigned char *data = (unsigned char*) malloc(total);
+    unsigned char *buffer = (unsigned char*) malloc(total);
+
+    for (i = 0; i < total; i++) data[i] = (unsigned char)(i * 7);
+
+    nj_ipc_channel server = nj_ipc_channel_create("test_stream", 4096);
+    assert(server.status == SUCCESS);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        nj_ipc_channel client = nj_ipc_channel_open("test_stream", 4096);
+        nj_ipc_stream writer = nj_ipc_stream_init(&client, 4);
+        if (writer.status != SUCCESS) _exit(1);
+        if (nj_ipc_stream_write(&writer, data, total) != SUCCESS) _exit(2);
+        _exit(0);
+    }
+
+    nj_ipc_stream reader = nj_ipc_stream_init(&server, 4);
+    assert(reader.status == SUCCESS);
+    assert(nj_ipc_stream_read(&reader, buffer, total, &size) == SUCCESS);
+    assert(size == total);
+    assert(memcmp(data, buffer, total) == 0);
+
+    int status;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    printf("Test for streaming more than the channel size passed.\n");
+
+    nj_ipc_channel_free(&server);
+    free(data);
+    free(buffer);
+#endif
+}
+
+int main() {
+    test_stream_init_invalid();
+    test_stream_within_slots();
+    test_stream_larger_than_channel();
+    printf("All Stream API tests passed!\n");
+    return 0;
+}
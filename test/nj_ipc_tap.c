@@ -0,0 +1,134 @@
+#include "../src/ninjaipc.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef NJ_IPC_POSIX
+#include <sys/wait.h>
+#endif
+
+#define TAP_PATH "nj_ipc_tap_test.log"
+
+void test_tap_records_channel_writes() {
+    const char *request = "request";
+    const char *reply = "reply";
+    nj_ipc_iovec parts[2] = { { "re", 2 }, { "ply", 4 } };
+    nj_ipc_tap_record *record;
+    size_t cursor = 0;
+
+    nj_ipc_tap tap = nj_ipc_tap_create(TAP_PATH, 4096);
+    assert(tap.status == SUCCESS);
+
+    nj_ipc_channel server = nj_ipc_channel_create("test_tap_channel", 64);
+    assert(server.status == SUCCESS);
+    nj_ipc_channel client = nj_ipc_channel_open("test_tap_channel", 64);
+    assert(client.status == SUCCESS);
+
+    nj_ipc_channel_set_tap(&server, &tap);
+    nj_ipc_channel_set_tap(&client, &tap);
+
+    assert(nj_ipc_channel_write(&client, (void*)request, strlen(request) + 1) == SUCCESS);
+    assert(nj_ipc_channel_writev(&server, parts, 2) == SUCCESS);
+
+    assert(nj_ipc_tap_next(&tap, &cursor, &record) == SUCCESS);
+    assert(record->direction == NJ_IPC_TAP_CLIENT_TO_SERVER);
+    assert(record->size == strlen(request) + 1);
+    assert(strcmp((char*)nj_ipc_tap_record_data(record), request) == 0);
+    uint64_t first_timestamp = record->timestamp;
+
+    assert(nj_ipc_tap_next(&tap, &cursor, &record) == SUCCESS);
+    assert(record->direction == NJ_IPC_TAP_SERVER_TO_CLIENT);
+    assert(record->timestamp >= first_timestamp);
+    assert(strcmp((char*)nj_ipc_tap_record_data(record), reply) == 0);
+
+    assert(nj_ipc_tap_next(&tap, &cursor, &record) == TAP_END);
+
+    printf("Test for tapping channel writes passed.\n");
+
+    nj_ipc_channel_free(&client);
+    nj_ipc_channel_free(&server);
+    nj_ipc_tap_free(&tap);
+}
+
+void test_tap_open_and_full() {
+    char payload[64] = { 0 };
+    nj_ipc_iovec part = { payload, sizeof(payload) };
+    nj_ipc_tap_record *record;
+    size_t cursor = 0;
+
+    nj_ipc_tap tap = nj_ipc_tap_create(TAP_PATH, 128);
+    assert(tap.status == SUCCESS);
+
+    nj_ipc_tap appender = nj_ipc_tap_open(TAP_PATH);
+    assert(appender.status == SUCCESS);
+
+    assert(nj_ipc_tap_append(&appender, NJ_IPC_TAP_CLIENT_TO_SERVER, &part, 1) == SUCCESS);
+    assert(nj_ipc_tap_append(&appender, NJ_IPC_TAP_CLIENT_TO_SERVER, &part, 1) == TAP_FULL);
+
+    assert(nj_ipc_tap_next(&tap, &cursor, &record) == SUCCESS);
+    assert(record->size == sizeof(payload));
+    assert(nj_ipc_tap_next(&tap, &cursor, &record) == TAP_END);
+
+    nj_ipc_tap invalid = nj_ipc_tap_open("");
+    assert(invalid.status == INVALID_NAME);
+
+    printf("Test for opening and filling a tap passed.\n");
+
+    nj_ipc_tap_free(&appender);
+    nj_ipc_tap_free(&tap);
+}
+
+void test_tap_replay() {
+#ifdef NJ_IPC_POSIX
+    int i, request;
+    size_t replayed = 0;
+
+    nj_ipc_tap tap = nj_ipc_tap_create(TAP_PATH, 4096);
+    assert(tap.status == SUCCESS);
+
+    for (i = 0; i < 3; i++) {
+        nj_ipc_iovec part = { &i, sizeof(i) };
+        assert(nj_ipc_tap_append(&tap, NJ_IPC_TAP_CLIENT_TO_SERVER, &part, 1) == SUCCESS);
+        assert(nj_ipc_tap_append(&tap, NJ_IPC_TAP_SERVER_TO_CLIENT, &part, 1) == SUCCESS);
+    }
+
+    nj_ipc_channel server = nj_ipc_channel_create("test_tap_replay", sizeof(int));
+    assert(server.status == SUCCESS);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        for (i = 0; i < 3; i++) {
+            if (nj_ipc_channel_wait_client(&server) != SUCCESS) _exit(1);
+            nj_ipc_channel_read(&server, &request, sizeof(request));
+            if (request != i) _exit(2);
+            nj_ipc_channel_write(&server, &request, sizeof(request));
+            nj_ipc_channel_notify_server(&server);
+        }
+        _exit(0);
+    }
+
+    nj_ipc_channel client = nj_ipc_channel_open("test_tap_replay", sizeof(int));
+    assert(client.status == SUCCESS);
+
+    assert(nj_ipc_tap_replay(&tap, &client, NJ_IPC_TAP_REPLAY_FAST, &replayed) == SUCCESS);
+    assert(replayed == 3);
+
+    int status;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    printf("Test for replaying a tap passed.\n");
+
+    nj_ipc_channel_free(&client);
+    nj_ipc_channel_free(&server);
+    nj_ipc_tap_free(&tap);
+#endif
+}
+
+int main() {
+    test_tap_records_channel_writes();
+    test_tap_open_and_full();
+    test_tap_replay();
+    remove(TAP_PATH);
+    printf("All Traffic Tap API tests passed!\n");
+    return 0;
+}